@@ -0,0 +1,145 @@
+#ifndef BENCH_SCENES_H
+#define BENCH_SCENES_H
+
+// Fixed scenes shared by the benchmarks. Scene contents only depend on the seed passed
+// in, so every benchmark binary (float or double build) renders exactly the same scene.
+
+#include "../src/common.h"
+
+#include "../src/camera.h"
+#include "../src/material_table.h"
+#include "../src/scene_objects_list.h"
+#include "../src/sphere.h"
+#include "../src/triangle.h"
+#include "../src/triangle_mesh.h"
+
+#include <vector>
+
+inline void build_main_scene(scene_objects_list& world, material_table& materials) {
+    // The scene from main.cpp
+    auto material_ground = materials.add(make_shared<lambertian1>(color(0.8, 0.8, 0.0), 0.0));
+    auto material_center = materials.add(make_shared<lambertian1>(color(0.1, 0.2, 0.5), 0.0));
+    auto material_left   = materials.add(make_shared<dielectric>(1.5));
+    auto material_right  = materials.add(make_shared<metal>(color(0.8, 0.6, 0.2), 0.0));
+
+    world.add(make_shared<sphere>(point3( 0.0, -100.5, -1.0), 100.0, material_ground));
+    world.add(make_shared<sphere>(point3( 0.0,    0.0, -1.0),   0.5, material_center));
+    world.add(make_shared<triangle>(point3(-1.0, 0.0, 0.0), point3(0.0, 0.0, 2.0), point3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0), material_center));
+    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),   0.5, material_left));
+    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),  -0.4, material_left));
+    world.add(make_shared<sphere>(point3( 1.0,    0.0, -1.0),   0.5, material_right));
+}
+
+inline void setup_main_camera(camera& cam) {
+    cam.aspect_ratio  = 16.0 / 9.0;
+    cam.max_depth     = 50;
+    cam.v_fov         = 90;
+    cam.look_from     = point3(-2, 2, 1);
+    cam.look_at       = point3(0, 0, -1);
+    cam.v_up          = vec3(0, 1, 0);
+    cam.defocus_angle = 10.0;
+    cam.focus_dist    = 3.4;
+}
+
+inline void build_random_spheres(scene_objects_list& world, material_table& materials, int count, uint64_t seed) {
+    // count small spheres of mixed materials scattered over a 100 x 100 field above a
+    // large ground sphere
+    rng_engine rng;
+    rng.seed(seed, 0);
+    auto next = [&rng](double min, double max) { return min + (max - min) * rng.next_double(); };
+
+    world.add(make_shared<sphere>(point3(0, -10000, 0), 10000,
+        materials.add(make_shared<lambertian1>(color(0.5, 0.5, 0.5), 0.0))));
+    auto glass = materials.add(make_shared<dielectric>(1.5));
+    for (int n = 0; n < count; ++n) {
+        point3 center(next(-50, 50), next(0.1, 2.0), next(-50, 50));
+        double radius = next(0.05, 0.2);
+        double choice = next(0, 1);
+        if (choice < 0.7)
+            world.add(make_shared<sphere>(center, radius,
+                materials.add(make_shared<lambertian1>(color(next(0, 1), next(0, 1), next(0, 1)), 0.0))));
+        else if (choice < 0.9)
+            world.add(make_shared<sphere>(center, radius,
+                materials.add(make_shared<metal>(color(next(0.5, 1), next(0.5, 1), next(0.5, 1)), next(0, 0.5)))));
+        else
+            world.add(make_shared<sphere>(center, radius, glass));
+    }
+}
+
+inline void build_random_primitives(scene_objects_list& world, material_table& materials, int count,
+                                    uint64_t seed) {
+    // count primitives, alternately small spheres and small triangles, scattered uniformly
+    // through the cube [-50, 50]^3. Used to time intersection code rather than to look nice.
+    rng_engine rng;
+    rng.seed(seed, 1);
+    auto next = [&rng](double min, double max) { return min + (max - min) * rng.next_double(); };
+
+    auto diffuse = materials.add(make_shared<lambertian1>(color(0.5, 0.5, 0.5), 0.0));
+    for (int n = 0; n < count; ++n) {
+        point3 center(next(-50, 50), next(-50, 50), next(-50, 50));
+        if (n % 2 == 0) {
+            world.add(make_shared<sphere>(center, next(0.05, 0.3), diffuse));
+        }
+        else {
+            point3 a = center + vec3(next(-0.3, 0.3), next(-0.3, 0.3), next(-0.3, 0.3));
+            point3 b = center + vec3(next(-0.3, 0.3), next(-0.3, 0.3), next(-0.3, 0.3));
+            point3 c = center + vec3(next(-0.3, 0.3), next(-0.3, 0.3), next(-0.3, 0.3));
+            world.add(make_shared<triangle>(a, b, c, unit_vector(cross(b - a, c - a)), diffuse));
+        }
+    }
+}
+
+inline void build_torus_mesh(int rings, int segments, mesh_data& mesh) {
+    // Closed torus around the y axis (major radius 1, minor radius 0.35) with vertex
+    // normals, 2 * rings * segments triangles
+    const double major = 1.0, minor = 0.35;
+    mesh = mesh_data();
+    for (int i = 0; i < rings; ++i) {
+        for (int j = 0; j < segments; ++j) {
+            double u = 2 * pi * i / rings, v = 2 * pi * j / segments;
+            vec3 n(std::cos(u) * std::cos(v), std::sin(v), std::sin(u) * std::cos(v));
+            mesh.positions.push_back(point3(major * std::cos(u), 0, major * std::sin(u)) + minor * n);
+            mesh.normals.push_back(n);
+        }
+    }
+    for (int i = 0; i < rings; ++i) {
+        for (int j = 0; j < segments; ++j) {
+            uint32_t a = i * segments + j, b = ((i + 1) % rings) * segments + j;
+            uint32_t c = ((i + 1) % rings) * segments + (j + 1) % segments, d = i * segments + (j + 1) % segments;
+            uint32_t quad[6] = { a, b, c, a, c, d };
+            mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+inline std::vector<ray> make_random_rays(int count, uint64_t seed) {
+    // Rays from random points on a sphere of radius 100 aimed at random points inside
+    // the cube used by build_random_primitives
+    rng_engine rng;
+    rng.seed(seed, 2);
+    auto next = [&rng](double min, double max) { return min + (max - min) * rng.next_double(); };
+
+    std::vector<ray> rays;
+    rays.reserve(count);
+    for (int n = 0; n < count; ++n) {
+        vec3 from(next(-1, 1), next(-1, 1), next(-1, 1));
+        while (from.length_squared() > 1 || from.length_squared() < 1e-6)
+            from = vec3(next(-1, 1), next(-1, 1), next(-1, 1));
+        point3 origin = 100 * unit_vector(from);
+        point3 target(next(-50, 50), next(-50, 50), next(-50, 50));
+        rays.push_back(ray(origin, target - origin));
+    }
+    return rays;
+}
+
+inline void setup_random_spheres_camera(camera& cam) {
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.max_depth    = 16;
+    cam.v_fov        = 40;
+    cam.look_from    = point3(0, 6, 30);
+    cam.look_at      = point3(0, 0, 0);
+    cam.v_up         = vec3(0, 1, 0);
+    cam.focus_dist   = 30;
+}
+
+#endif
@@ -0,0 +1,93 @@
+// Benchmark for the BVH builders in src/bvh.h: the binned SAH build and the Morton code
+// LBVH build, each with one thread and with several. Reports the build time, the tree
+// metrics (SAH cost, depth, leaf size histogram) and the trace speed the tree gives, on
+// 1M primitives of a scene_objects_list under a bvh and on a 2M triangle triangle_mesh.
+// The SAH and LBVH trees must not depend on the thread count, which is checked too.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/bvh.h"
+#include "../src/triangle_mesh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct trace_result {
+    double seconds = 0;
+    long hits = 0;
+    double t_sum = 0; // identical trees give identical sums
+};
+
+static trace_result trace(const scene_object& world, const std::vector<ray>& rays) {
+    trace_result result;
+    hit_record rec;
+    auto start = bench_clock::now();
+    for (const auto& r : rays) {
+        if (world.hit(r, interval(0.001, infinity), rec)) {
+            ++result.hits;
+            result.t_sum += rec.t;
+        }
+    }
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return result;
+}
+
+static void report(const char* method, int threads, double build_seconds, const bvh_metrics& m,
+                   const trace_result& result, size_t ray_count) {
+    std::printf("%-5s %2d thread(s) build %7.3f s  SAH cost %7.2f  nodes %8d  depth %2d max %5.1f avg  "
+                "%6.2f Mrays/s  t sum %.9g\n", method, threads, build_seconds, m.sah_cost, m.node_count,
+                m.max_depth, m.average_leaf_depth, ray_count / result.seconds / 1e6, result.t_sum);
+    std::printf("      leaf sizes:");
+    for (size_t n = 1; n < m.leaf_sizes.size(); ++n)
+        std::printf(" %zu:%d", n, m.leaf_sizes[n]);
+    std::printf("\n");
+}
+
+int main() {
+    const bvh_build_method methods[] = { bvh_build_method::sah, bvh_build_method::lbvh };
+    const char* method_names[] = { "sah", "lbvh" };
+    // At least 4 threads so the parallel path runs even on a single core machine
+    const int thread_counts[] = { 1, std::max(4, default_thread_count()) };
+
+    std::printf("%d hardware thread(s)\n\n", default_thread_count());
+
+    {
+        scene_objects_list world;
+        material_table materials;
+        build_random_primitives(world, materials, 1000000, 17);
+        auto rays = make_random_rays(200000, 23);
+        std::printf("%zu spheres and triangles, bvh, %zu rays\n", world.objects.size(), rays.size());
+        for (int m = 0; m < 2; ++m) {
+            for (int threads : thread_counts) {
+                bvh tree(world, methods[m], threads);
+                report(method_names[m], threads, tree.build_seconds(), tree.metrics(), trace(tree, rays),
+                       rays.size());
+            }
+        }
+        std::printf("\n");
+    }
+
+    {
+        mesh_data torus;
+        build_torus_mesh(1000, 1000, torus);
+        material_table materials;
+        auto diffuse = materials.add(make_shared<lambertian1>(color(0.5, 0.5, 0.5), 0.0));
+        auto rays = make_random_rays(200000, 29);
+        for (auto& r : rays)
+            r = ray(r.origin() / 40, r.direction()); // aim at the torus
+        std::printf("%zu triangle triangle_mesh, %zu rays\n", torus.triangle_count(), rays.size());
+        for (int m = 0; m < 2; ++m) {
+            for (int threads : thread_counts) {
+                triangle_mesh mesh(torus, diffuse, methods[m], threads);
+                report(method_names[m], threads, mesh.build_seconds(), mesh.metrics(), trace(mesh, rays),
+                       rays.size());
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Compares two PFM images of the same size, e.g. the float and double renders written by
+// precision_bench. Reports the RMSE and largest difference of the linear values, and the
+// PSNR and share of differing pixels after 8-bit gamma encoding.
+//
+// Usage: image_diff a.pfm b.pfm
+
+#include "../src/common.h"
+
+#include "../src/color.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static bool read_pfm(const std::string& path, int& width, int& height, std::vector<float>& data) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::string magic;
+    double scale;
+    if (!(in >> magic >> width >> height >> scale) || magic != "PF")
+        return false;
+    in.get(); // the single whitespace character before the data
+    data.resize(static_cast<size_t>(width) * height * 3);
+    in.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+    return static_cast<bool>(in);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::fprintf(stderr, "usage: %s a.pfm b.pfm\n", argv[0]);
+        return 2;
+    }
+
+    int width_a, height_a, width_b, height_b;
+    std::vector<float> a, b;
+    if (!read_pfm(argv[1], width_a, height_a, a) || !read_pfm(argv[2], width_b, height_b, b)) {
+        std::fprintf(stderr, "could not read both images\n");
+        return 1;
+    }
+    if (width_a != width_b || height_a != height_b) {
+        std::fprintf(stderr, "image sizes differ\n");
+        return 1;
+    }
+
+    double squared_error = 0, max_error = 0, squared_error_8bit = 0;
+    long differing_pixels = 0;
+    size_t pixels = a.size() / 3;
+    for (size_t k = 0; k < pixels; ++k) {
+        uint8_t rgb_a[3], rgb_b[3];
+        color_to_rgb8(color(a[3*k], a[3*k + 1], a[3*k + 2]), 1, rgb_a);
+        color_to_rgb8(color(b[3*k], b[3*k + 1], b[3*k + 2]), 1, rgb_b);
+        bool differs = false;
+        for (int c = 0; c < 3; ++c) {
+            double error = std::fabs(static_cast<double>(a[3*k + c]) - b[3*k + c]);
+            squared_error += error * error;
+            max_error = std::fmax(max_error, error);
+            double error_8bit = static_cast<double>(rgb_a[c]) - rgb_b[c];
+            squared_error_8bit += error_8bit * error_8bit;
+            differs = differs || rgb_a[c] != rgb_b[c];
+        }
+        if (differs)
+            ++differing_pixels;
+    }
+
+    double rmse = std::sqrt(squared_error / a.size());
+    double rmse_8bit = std::sqrt(squared_error_8bit / a.size());
+    double psnr = rmse_8bit > 0 ? 20 * std::log10(255.0 / rmse_8bit) : INFINITY;
+    std::printf("%s vs %s: linear RMSE %.6f, max %.6f, 8-bit PSNR %.2f dB, %.3f%% of pixels differ\n",
+                argv[1], argv[2], rmse, max_error, psnr, 100.0 * differing_pixels / pixels);
+    return 0;
+}
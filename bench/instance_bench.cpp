@@ -0,0 +1,109 @@
+// Benchmark for instancing in src/instance.h. Places copies of one 20k triangle torus with
+// random rotations, scales and offsets, once as instances of the shared mesh under a bvh
+// and once flattened into a single mesh holding every transformed triangle. Reports the
+// memory and trace speed of both; they must find the same hits (t and normals within
+// rounding). The 10,000 copy scene is only built with instances.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/bvh.h"
+#include "../src/instance.h"
+
+#include <chrono>
+#include <cstdio>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static std::vector<affine_transform> random_placements(int count, double min_scale, double max_scale, uint64_t seed) {
+    rng_engine rng;
+    rng.seed(seed, 3);
+    auto next = [&rng](double min, double max) { return min + (max - min) * rng.next_double(); };
+    std::vector<affine_transform> placements;
+    for (int i = 0; i < count; ++i) {
+        double s = next(min_scale, max_scale);
+        affine_transform t = affine_transform::scale(vec3(s, s * next(0.5, 1.5), s));
+        t = affine_transform::rotate(vec3(next(-1, 1), next(-1, 1), next(-1, 1)), next(0, 360)) * t;
+        placements.push_back(affine_transform::translate(vec3(next(-45, 45), next(-45, 45), next(-45, 45))) * t);
+    }
+    return placements;
+}
+
+static double trace(const scene_object& world, const std::vector<ray>& rays, std::vector<hit_record>& hits,
+                    std::vector<char>& hit) {
+    hits.resize(rays.size());
+    hit.resize(rays.size());
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < rays.size(); ++i)
+        hit[i] = world.hit(rays[i], interval(0.001, infinity), hits[i]);
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+int main() {
+    material_table materials;
+    auto diffuse = materials.add(make_shared<lambertian1>(color(0.5, 0.5, 0.5), 0.0));
+    mesh_data torus;
+    build_torus_mesh(100, 100, torus);
+    auto mesh = make_shared<triangle_mesh>(mesh_data(torus), diffuse);
+    auto rays = make_random_rays(200000, 41);
+    std::printf("shared mesh: %zu triangles, %.2f MB\n\n", mesh->triangle_count(), mesh->memory_bytes() / 1e6);
+
+    const int counts[] = { 64, 10000 };
+    for (int count : counts) {
+        auto placements = random_placements(count, count < 1000 ? 4 : 0.5, count < 1000 ? 9 : 1.5, count);
+
+        auto start = bench_clock::now();
+        scene_objects_list list;
+        for (const auto& t : placements)
+            list.add(make_shared<instance>(mesh, t));
+        bvh instances(list);
+        double build_seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+        size_t instance_bytes = mesh->memory_bytes() + count * sizeof(instance)
+                              + instances.node_count() * sizeof(bvh_node);
+
+        std::vector<hit_record> instance_hits, flat_hits;
+        std::vector<char> instance_hit, flat_hit;
+        double seconds = trace(instances, rays, instance_hits, instance_hit);
+        long hit_count = 0;
+        for (char h : instance_hit)
+            hit_count += h;
+        std::printf("%5d instances  build %6.3f s  %8.2f MB  %6.2f Mrays/s  %ld hits\n", count, build_seconds,
+                    instance_bytes / 1e6, rays.size() / seconds / 1e6, hit_count);
+
+        if (count > 1000) {
+            std::printf("%5d flattened copies would hold %zu triangles in about %.0f MB\n\n", count,
+                        count * mesh->triangle_count(), count * mesh->memory_bytes() / 1e6);
+            continue;
+        }
+
+        mesh_data flat;
+        for (const auto& t : placements) {
+            uint32_t offset = static_cast<uint32_t>(flat.positions.size());
+            affine_transform normal_map = t.inverse();
+            for (size_t v = 0; v < torus.positions.size(); ++v) {
+                flat.positions.push_back(t.point(torus.positions[v]));
+                flat.normals.push_back(unit_vector(normal_map.transposed_vector(torus.normals[v])));
+            }
+            for (uint32_t index : torus.indices)
+                flat.indices.push_back(offset + index);
+        }
+        start = bench_clock::now();
+        triangle_mesh flattened(std::move(flat), diffuse);
+        build_seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+        seconds = trace(flattened, rays, flat_hits, flat_hit);
+        std::printf("%5d flattened  build %6.3f s  %8.2f MB  %6.2f Mrays/s\n", count, build_seconds,
+                    flattened.memory_bytes() / 1e6, rays.size() / seconds / 1e6);
+
+        long same = 0;
+        for (size_t i = 0; i < rays.size(); ++i) {
+            const hit_record& a = instance_hits[i];
+            const hit_record& b = flat_hits[i];
+            same += instance_hit[i] == flat_hit[i]
+                 && (!instance_hit[i] || (std::fabs(a.t - b.t) <= 1e-4 * b.t && dot(a.normal, b.normal) > 0.999
+                                          && a.ray_facing_inwards == b.ray_facing_inwards));
+        }
+        std::printf("matching hits %ld / %zu\n\n", same, rays.size());
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Benchmark for triangle_mesh and the loaders in src/mesh_io.h.
+// Writes a finely tessellated torus as OBJ (with vertex normals) and as binary PLY, times
+// loading both with one thread and with all threads, checks the loaders agree, and
+// compares the heap memory of a triangle_mesh with that of the same triangles as separate
+// triangle objects under a bvh. The files are written to bench/ and removed afterwards.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/bvh.h"
+#include "../src/mesh_io.h"
+#include "../src/triangle_mesh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <malloc.h>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static void write_obj(const char* path, const std::vector<point3>& positions, const std::vector<vec3>& normals,
+                      const std::vector<uint32_t>& indices) {
+    FILE* out = std::fopen(path, "w");
+    for (const auto& p : positions)
+        std::fprintf(out, "v %.7g %.7g %.7g\n", p[0], p[1], p[2]);
+    for (const auto& n : normals)
+        std::fprintf(out, "vn %.6g %.6g %.6g\n", n[0], n[1], n[2]);
+    for (size_t t = 0; t < indices.size(); t += 3)
+        std::fprintf(out, "f %u//%u %u//%u %u//%u\n", indices[t] + 1, indices[t] + 1, indices[t + 1] + 1,
+                     indices[t + 1] + 1, indices[t + 2] + 1, indices[t + 2] + 1);
+    std::fclose(out);
+}
+
+static void write_ply(const char* path, const std::vector<point3>& positions, const std::vector<vec3>& normals,
+                      const std::vector<uint32_t>& indices) {
+    FILE* out = std::fopen(path, "wb");
+    std::fprintf(out, "ply\nformat binary_little_endian 1.0\nelement vertex %zu\n"
+                      "property float x\nproperty float y\nproperty float z\n"
+                      "property float nx\nproperty float ny\nproperty float nz\n"
+                      "element face %zu\nproperty list uchar int vertex_indices\nend_header\n",
+                 positions.size(), indices.size() / 3);
+    for (size_t i = 0; i < positions.size(); ++i) {
+        float v[6] = { float(positions[i][0]), float(positions[i][1]), float(positions[i][2]),
+                       float(normals[i][0]), float(normals[i][1]), float(normals[i][2]) };
+        std::fwrite(v, sizeof(v), 1, out);
+    }
+    for (size_t t = 0; t < indices.size(); t += 3) {
+        unsigned char count = 3;
+        int32_t face[3] = { int32_t(indices[t]), int32_t(indices[t + 1]), int32_t(indices[t + 2]) };
+        std::fwrite(&count, 1, 1, out);
+        std::fwrite(face, sizeof(face), 1, out);
+    }
+    std::fclose(out);
+}
+
+static long file_size(const char* path) {
+    mapped_file file(path);
+    return static_cast<long>(file.size());
+}
+
+static double time_load(const char* path, mesh_data& mesh, int threads) {
+    auto start = bench_clock::now();
+    if (!load_mesh(path, mesh, threads))
+        std::printf("loading %s failed\n", path);
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static size_t heap_in_use() {
+    // Small blocks plus the large ones malloc hands out as separate mappings
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+int main() {
+    const char* obj_path = "bench/mesh_bench.obj";
+    const char* ply_path = "bench/mesh_bench.ply";
+    const int rings = 1000, segments = 1000; // 2M triangles
+
+    {
+        mesh_data torus;
+        build_torus_mesh(rings, segments, torus);
+        write_obj(obj_path, torus.positions, torus.normals, torus.indices);
+        write_ply(ply_path, torus.positions, torus.normals, torus.indices);
+    }
+
+    const char* paths[] = { obj_path, ply_path };
+    mesh_data meshes[2];
+    for (int f = 0; f < 2; ++f) {
+        double mb = file_size(paths[f]) / 1e6;
+        time_load(paths[f], meshes[f], 0); // warm up the page cache and the allocator
+        for (int threads : { 1, 0 }) {
+            double seconds = time_load(paths[f], meshes[f], threads);
+            std::printf("%-22s %7.1f MB  %d thread(s) %7.3f s %8.1f MB/s  %zu triangles\n", paths[f], mb,
+                        threads ? threads : default_thread_count(), seconds, mb / seconds,
+                        meshes[f].triangle_count());
+        }
+    }
+    bool same = meshes[0].indices == meshes[1].indices && meshes[0].positions.size() == meshes[1].positions.size()
+             && meshes[0].normals.size() == meshes[1].normals.size() && meshes[0].normal_indices.empty();
+    std::printf("OBJ and PLY meshes %s\n\n", same ? "agree" : "DIFFER");
+    std::remove(obj_path);
+    std::remove(ply_path);
+
+    // Memory: the mesh as one triangle_mesh against separate triangle objects in a bvh
+    material_table materials;
+    auto diffuse = materials.add(make_shared<lambertian1>(color(0.5, 0.5, 0.5), 0.0));
+    size_t triangles = meshes[1].triangle_count();
+
+    size_t before = heap_in_use();
+    scene_objects_list list;
+    for (size_t t = 0; t < triangles; ++t) {
+        const mesh_data& m = meshes[1];
+        const point3& a = m.positions[m.indices[3*t]];
+        const point3& b = m.positions[m.indices[3*t + 1]];
+        const point3& c = m.positions[m.indices[3*t + 2]];
+        list.add(make_shared<triangle>(a, b, c, unit_vector(cross(b - a, c - a)), diffuse));
+    }
+    auto separate = std::unique_ptr<bvh>(new bvh(list));
+    size_t separate_bytes = heap_in_use() - before;
+    list.clear();
+    std::vector<shared_ptr<scene_object>>().swap(list.objects);
+
+    before = heap_in_use();
+    auto mesh = std::unique_ptr<triangle_mesh>(new triangle_mesh(meshes[1], diffuse));
+    size_t mesh_bytes = heap_in_use() - before;
+
+    std::printf("separate triangles + bvh %8.1f MB %7.1f bytes/triangle\n", separate_bytes / 1e6,
+                double(separate_bytes) / triangles);
+    size_t node_bytes = mesh->node_bytes();
+    std::printf("triangle_mesh            %8.1f MB %7.1f bytes/triangle, %.1f of them bvh nodes\n", mesh_bytes / 1e6,
+                double(mesh_bytes) / triangles, double(node_bytes) / triangles);
+
+    // Both describe the same surface, so they should agree on what rays hit. triangle
+    // rejects rays within 0.01 of parallel to its plane, so a few grazing hits differ.
+    auto rays = make_random_rays(20000, 21);
+    long agree = 0;
+    for (auto& r : rays) {
+        r = ray(r.origin() / 40, unit_vector(r.direction()));
+        hit_record a, b;
+        bool hit_a = separate->hit(r, interval(0.001, infinity), a);
+        bool hit_b = mesh->hit(r, interval(0.001, infinity), b);
+        agree += hit_a == hit_b && (!hit_a || std::fabs(a.t - b.t) < 1e-6);
+    }
+    std::printf("rays with matching hits %ld / %zu\n", agree, rays.size());
+    return 0;
+}
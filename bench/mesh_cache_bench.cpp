@@ -0,0 +1,91 @@
+// Benchmark for the mesh cache in src/mesh_cache.h. Writes a 2M triangle torus as binary
+// PLY and OBJ and opens each with load_mesh_cached twice: the first time parses the file,
+// builds the BVH and writes the cache, the second only hashes the file and maps the
+// cache. The cached mesh must find exactly the hits of the freshly built one. Files go to
+// bench/ and are removed afterwards.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/mesh_cache.h"
+
+#include <chrono>
+#include <cstdio>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static void write_ply(const char* path, const mesh_data& mesh) {
+    FILE* out = std::fopen(path, "wb");
+    std::fprintf(out, "ply\nformat binary_little_endian 1.0\nelement vertex %zu\n"
+                      "property float x\nproperty float y\nproperty float z\n"
+                      "property float nx\nproperty float ny\nproperty float nz\n"
+                      "element face %zu\nproperty list uchar int vertex_indices\nend_header\n",
+                 mesh.positions.size(), mesh.triangle_count());
+    for (size_t i = 0; i < mesh.positions.size(); ++i) {
+        float v[6] = { float(mesh.positions[i][0]), float(mesh.positions[i][1]), float(mesh.positions[i][2]),
+                       float(mesh.normals[i][0]), float(mesh.normals[i][1]), float(mesh.normals[i][2]) };
+        std::fwrite(v, sizeof(v), 1, out);
+    }
+    for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+        unsigned char count = 3;
+        int32_t face[3] = { int32_t(mesh.indices[t]), int32_t(mesh.indices[t + 1]), int32_t(mesh.indices[t + 2]) };
+        std::fwrite(&count, 1, 1, out);
+        std::fwrite(face, sizeof(face), 1, out);
+    }
+    std::fclose(out);
+}
+
+static void write_obj(const char* path, const mesh_data& mesh) {
+    FILE* out = std::fopen(path, "w");
+    for (const auto& p : mesh.positions)
+        std::fprintf(out, "v %.7g %.7g %.7g\n", p[0], p[1], p[2]);
+    for (size_t t = 0; t < mesh.indices.size(); t += 3)
+        std::fprintf(out, "f %u %u %u\n", mesh.indices[t] + 1, mesh.indices[t + 1] + 1, mesh.indices[t + 2] + 1);
+    std::fclose(out);
+}
+
+int main() {
+    const char* cache_dir = "bench/mesh_cache/";
+    const char* paths[] = { "bench/mesh_cache_bench.ply", "bench/mesh_cache_bench.obj" };
+    {
+        mesh_data torus;
+        build_torus_mesh(1000, 1000, torus);
+        write_ply(paths[0], torus);
+        write_obj(paths[1], torus);
+    }
+
+    material_table materials;
+    auto diffuse = materials.add(make_shared<lambertian1>(color(0.5, 0.5, 0.5), 0.0));
+    auto rays = make_random_rays(100000, 37);
+    for (auto& r : rays)
+        r = ray(r.origin() / 40, r.direction()); // aim at the torus
+
+    for (const char* path : paths) {
+        shared_ptr<triangle_mesh> meshes[2];
+        for (int run = 0; run < 2; ++run) {
+            auto start = bench_clock::now();
+            meshes[run] = load_mesh_cached(path, cache_dir, diffuse);
+            double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+            std::printf("%-28s %-22s %8.3f s  %zu triangles, %.1f MB on the heap\n", path,
+                        run == 0 ? "parse, build, write" : "hash and map cache", seconds,
+                        meshes[run]->triangle_count(), meshes[run]->memory_bytes() / 1e6);
+        }
+
+        long same = 0;
+        for (const auto& r : rays) {
+            hit_record a, b;
+            bool hit_a = meshes[0]->hit(r, interval(0.001, infinity), a);
+            bool hit_b = meshes[1]->hit(r, interval(0.001, infinity), b);
+            same += hit_a == hit_b && (!hit_a || (a.t == b.t && a.normal[0] == b.normal[0]));
+        }
+        mapped_file source(path);
+        uint64_t key = mesh_cache_key(content_hash(source.data(), source.size()), bvh_build_method::sah);
+        std::printf("cache file %.1f MB, identical hits %ld / %zu\n\n",
+                    mapped_file(mesh_cache_path(cache_dir, key)).size() / 1e6, same, rays.size());
+        std::remove(mesh_cache_path(cache_dir, key).c_str());
+        std::remove(path);
+    }
+    rmdir(cache_dir);
+    return 0;
+}
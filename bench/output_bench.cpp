@@ -0,0 +1,88 @@
+// Benchmark for the image output stage in src/image_io.h.
+// Fills a 4K framebuffer with random radiance and times each output path, including the
+// original per-pixel write_color P3 writer. Files are written next to this binary and
+// removed afterwards.
+//
+// Build and run with `make bench`.
+
+#include "../src/common.h"
+
+#include "../src/color.h"
+#include "../src/framebuffer.h"
+#include "../src/image_io.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double time_ms(const std::function<void()>& body) {
+    auto start = bench_clock::now();
+    body();
+    auto end = bench_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static long file_size(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+    return in ? static_cast<long>(in.tellg()) : -1;
+}
+
+static void report(const char* name, double ms, const std::string& path) {
+    if (path.empty())
+        std::printf("%-28s %9.1f ms\n", name, ms);
+    else
+        std::printf("%-28s %9.1f ms %10.1f MB\n", name, ms, file_size(path) / 1e6);
+}
+
+int main() {
+    const int width = 3840, height = 2160, samples = 64;
+    const std::string base = "bench/output_bench";
+
+    framebuffer fb(width, height);
+    for (auto& pixel : fb.pixels) {
+        pixel.add(samples * color::random());
+        pixel.count = samples;
+    }
+
+    std::printf("Output of a %dx%d frame\n", width, height);
+
+    double ms = time_ms([&] {
+        std::ofstream out((base + "_legacy.ppm").c_str());
+        out << "P3\n" << width << ' ' << height << "\n255\n";
+        uint8_t rgb[3];
+        for (const auto& pixel : fb.pixels)
+            write_color(out, pixel.total(), pixel.count, rgb);
+    });
+    report("P3 via write_color", ms, base + "_legacy.ppm");
+
+    std::vector<uint8_t> rgb;
+    ms = time_ms([&] { resolve_rgb8(fb, rgb); });
+    report("resolve to 8-bit", ms, "");
+
+    thread_pool pool;
+    ms = time_ms([&] { resolve_rgb8(fb, rgb, &pool); });
+    std::string threaded = "resolve to 8-bit, " + std::to_string(pool.size()) + " thread(s)";
+    report(threaded.c_str(), ms, "");
+
+    ms = time_ms([&] { write_ppm_text(base + "_p3.ppm", width, height, rgb); });
+    report("P3 bulk write", ms, base + "_p3.ppm");
+
+    ms = time_ms([&] { write_ppm_binary(base + "_p6.ppm", width, height, rgb); });
+    report("P6 bulk write", ms, base + "_p6.ppm");
+
+    ms = time_ms([&] { write_pfm(base + ".pfm", fb); });
+    report("PFM bulk write", ms, base + ".pfm");
+
+    ms = time_ms([&] { write_jpg(base + ".jpg", width, height, rgb); });
+    report("JPEG (stb, quality 100)", ms, base + ".jpg");
+
+    const char* suffixes[] = { "_legacy.ppm", "_p3.ppm", "_p6.ppm", ".pfm", ".jpg" };
+    for (const char* suffix : suffixes)
+        std::remove((base + suffix).c_str());
+    return 0;
+}
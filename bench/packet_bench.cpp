@@ -0,0 +1,150 @@
+// Benchmark for packet tracing of camera rays (src/ray_packet.h). First the camera rays of
+// a 1920x1080 pinhole view are traced on their own through a bvh, one at a time with
+// bvh::hit and in 8x8 packets with bvh::hit_packet for every SIMD level and a few
+// divergence thresholds (packet_min_rays); all must find the same hits. Then low-depth
+// preview renders of the main scene and 100k spheres are timed with camera::packets off
+// and on. Both draw the same random numbers, so the images must be identical; the PFMs are
+// compared byte for byte and removed afterwards.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/bvh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static std::vector<ray> camera_rays(point3 from, point3 at, double v_fov, int width, int height) {
+    // Pixel center rays, ordered so each run of 64 rays covers an 8x8 block of pixels
+    vec3 w = unit_vector(from - at);
+    vec3 u = unit_vector(cross(vec3(0, 1, 0), w));
+    vec3 v = cross(w, u);
+    double half_height = tan(degrees_to_radians(v_fov) / 2);
+    double half_width = half_height * width / height;
+    std::vector<ray> rays;
+    for (int by = 0; by < height; by += 8)
+        for (int bx = 0; bx < width; bx += 8)
+            for (int j = by; j < std::min(by + 8, height); ++j)
+                for (int i = bx; i < std::min(bx + 8, width); ++i) {
+                    double x = (2 * (i + 0.5) / width - 1) * half_width;
+                    double y = (1 - 2 * (j + 0.5) / height) * half_height;
+                    rays.push_back(ray(from, x*u + y*v - w));
+                }
+    return rays;
+}
+
+static void trace_rays(const char* name, bvh& world, const std::vector<ray>& rays) {
+    std::vector<real> t_single(rays.size(), -1), t_packet(rays.size());
+    hit_record rec;
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < rays.size(); ++i)
+        if (world.hit(rays[i], interval(0.001, infinity), rec))
+            t_single[i] = rec.t;
+    double single_seconds = seconds_since(start);
+    std::printf("%-14s single rays             %8.2f Mrays/s\n", name, rays.size() / single_seconds / 1e6);
+
+    ray_packet packet;
+    hit_record records[ray_packet::max_size];
+    const simd_level levels[] = { simd_level::scalar, simd_level::sse4, simd_level::avx2, simd_level::avx512 };
+    const int thresholds[] = { 1, 4, 16 };
+    for (simd_level level : levels) {
+        if (!simd_level_supported(level))
+            continue;
+        packet.level = level;
+        for (int threshold : thresholds) {
+            world.packet_min_rays = threshold;
+            t_packet.assign(rays.size(), -1);
+            start = bench_clock::now();
+            for (size_t first = 0; first < rays.size(); first += ray_packet::max_size) {
+                packet.clear();
+                for (size_t i = first; i < std::min(first + ray_packet::max_size, rays.size()); ++i)
+                    packet.add(rays[i], infinity);
+                packet.finish();
+                world.hit_packet(packet, 0.001, packet.all(), records);
+                for (int k = 0; k < packet.size; ++k)
+                    if ((packet.hits >> k) & 1)
+                        t_packet[first + k] = records[k].t;
+            }
+            double seconds = seconds_since(start);
+            long same = 0;
+            for (size_t i = 0; i < rays.size(); ++i)
+                same += t_single[i] == t_packet[i];
+            std::printf("%-14s packets %-6s min %-3d %8.2f Mrays/s  %.2fx  same hits %ld/%zu\n", name,
+                        simd_level_name(level), threshold, rays.size() / seconds / 1e6, single_seconds / seconds,
+                        same, rays.size());
+        }
+    }
+    world.packet_min_rays = 4;
+    std::printf("\n");
+}
+
+static void render(const char* name, const scene_object& world, const material_table& materials, camera& cam) {
+    cam.output_dir = "bench/";
+    cam.thread_count = 0;
+    cam.ppm = ppm_format::none;
+    cam.write_jpg = false;
+    cam.write_pfm = true;
+
+    std::string images[2];
+    double seconds[2];
+    for (int packets = 0; packets < 2; ++packets) {
+        cam.packets = packets != 0;
+        std::string filename = std::string("packet_") + name + (packets ? "_packets" : "_single");
+        cam.render(world, materials, filename);
+        seconds[packets] = cam.last_render_seconds;
+        std::printf("%-14s %-8s %8.3f s %8.2f Mrays/s %12lld rays\n", name, packets ? "packets" : "single",
+                    cam.last_render_seconds, cam.last_stats.segments / cam.last_render_seconds / 1e6,
+                    cam.last_stats.segments);
+        images[packets] = read_file("bench/" + filename + ".pfm");
+        std::remove(("bench/" + filename + ".pfm").c_str());
+    }
+    std::printf("%-14s speedup %.2fx, images identical: %s\n\n", name, seconds[0] / seconds[1],
+                !images[0].empty() && images[0] == images[1] ? "yes" : "NO");
+}
+
+int main() {
+    {
+        scene_objects_list list;
+        material_table materials;
+        build_main_scene(list, materials);
+        bvh world(list);
+        trace_rays("main", world, camera_rays(point3(-2, 2, 1), point3(0, 0, -1), 90, 1920, 1080));
+
+        camera cam;
+        setup_main_camera(cam);
+        cam.image_width = 1920;
+        cam.sample_size = 2;
+        cam.max_depth = 2;
+        render("main", world, materials, cam);
+    }
+    {
+        scene_objects_list list;
+        material_table materials;
+        build_random_spheres(list, materials, 100000, 7);
+        bvh world(list);
+        trace_rays("spheres_100k", world, camera_rays(point3(0, 6, 30), point3(0, 0, 0), 40, 1920, 1080));
+
+        camera cam;
+        setup_random_spheres_camera(cam);
+        cam.image_width = 1920;
+        cam.sample_size = 2;
+        cam.max_depth = 2;
+        render("spheres_100k", world, materials, cam);
+    }
+    return 0;
+}
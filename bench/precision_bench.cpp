@@ -0,0 +1,56 @@
+// Render benchmark used to compare the float and double builds of the math core.
+// The makefile builds this file twice, once with -DRAY_BANDIT_FLOAT. Each binary renders
+// the same two scenes, reports Mrays/s and saves linear PFM images, which
+// bench/image_diff then compares.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/bvh.h"
+
+#include <cstdio>
+#include <string>
+
+static void run(const char* name, const scene_object& world, const material_table& materials, camera& cam) {
+    cam.output_dir = "bench/";
+    cam.thread_count = 0;
+    cam.sampler = sampler_type::sobol;
+    cam.ppm = ppm_format::none;
+    cam.write_jpg = false;
+    cam.write_pfm = true;
+
+    std::string filename = std::string("precision_") + name + (sizeof(real) == sizeof(float) ? "_float" : "_double");
+    cam.render(world, materials, filename);
+
+    double mrays = cam.last_stats.segments / cam.last_render_seconds / 1e6;
+    std::printf("%-8s %-16s %8.3f s %8.2f Mrays/s  -> bench/%s.pfm\n",
+                sizeof(real) == sizeof(float) ? "float" : "double", name,
+                cam.last_render_seconds, mrays, filename.c_str());
+}
+
+int main() {
+    {
+        scene_objects_list list;
+        material_table materials;
+        build_main_scene(list, materials);
+        bvh world(list);
+        camera cam;
+        setup_main_camera(cam);
+        cam.image_width = 400;
+        cam.sample_size = 32;
+        run("main", world, materials, cam);
+    }
+    {
+        scene_objects_list list;
+        material_table materials;
+        build_random_spheres(list, materials, 100000, 7);
+        bvh world(list);
+        camera cam;
+        setup_random_spheres_camera(cam);
+        cam.image_width = 400;
+        cam.sample_size = 16;
+        run("spheres_100k", world, materials, cam);
+    }
+    return 0;
+}
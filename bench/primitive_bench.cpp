@@ -0,0 +1,64 @@
+// Benchmark for the primitive containers: the virtual scene_objects_list against the
+// type-segregated typed_scene_list in src/typed_scene_list.h. Both are linear scans, so
+// this times the per-primitive cost of the intersection loop itself (no BVH) at 1k,
+// 100k and 1M primitives, half spheres and half triangles.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/typed_scene_list.h"
+
+#include <chrono>
+#include <cstdio>
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct trace_result {
+    double seconds = 0;
+    long hits = 0;
+    double t_sum = 0; // checks that both containers found the same hits
+};
+
+static trace_result trace(const scene_object& world, const std::vector<ray>& rays) {
+    trace_result result;
+    hit_record rec;
+    auto start = bench_clock::now();
+    for (const auto& r : rays) {
+        if (world.hit(r, interval(0.001, infinity), rec)) {
+            ++result.hits;
+            result.t_sum += rec.t;
+        }
+    }
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return result;
+}
+
+static void report(const char* name, int primitives, int ray_count, const trace_result& result) {
+    double tests = static_cast<double>(primitives) * ray_count;
+    std::printf("%-20s %8d prims %7d rays %8.3f s %7.2f ns/test  %6ld hits  t sum %.6g\n",
+                name, primitives, ray_count, result.seconds, 1e9 * result.seconds / tests,
+                result.hits, result.t_sum);
+}
+
+int main() {
+    const int sizes[] = { 1000, 100000, 1000000 };
+    const double tests_per_size = 2e8; // ray-primitive tests per size, keeps each run short
+
+    for (int primitives : sizes) {
+        scene_objects_list list;
+        material_table materials;
+        build_random_primitives(list, materials, primitives, 11);
+        typed_scene_list typed(list);
+
+        int ray_count = static_cast<int>(tests_per_size / primitives);
+        auto rays = make_random_rays(ray_count, 12);
+
+        auto virtual_result = trace(list, rays);
+        auto typed_result = trace(typed, rays);
+        report("scene_objects_list", primitives, ray_count, virtual_result);
+        report("typed_scene_list", primitives, ray_count, typed_result);
+        std::printf("%-20s %.2fx\n\n", "speedup", virtual_result.seconds / typed_result.seconds);
+    }
+    return 0;
+}
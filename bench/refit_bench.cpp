@@ -0,0 +1,105 @@
+// Benchmark for animating instances (src/instance.h) under a top level bvh. 10,000
+// instances of a 20k triangle torus move and spin every frame; the frame set up is timed
+// for a full rebuild (mesh BVH and top level, as when the renderer restarts per frame),
+// a top level rebuild, a refit that never rebuilds and bvh::update (refit, rebuilding once
+// the SAH cost has grown by a fifth). Trace speed shows what the refit trees lose. All
+// trees hold the same instances, so they must find the same hits.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/bvh.h"
+#include "../src/instance.h"
+
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static double trace(const scene_object& world, const std::vector<ray>& rays, std::vector<real>& t) {
+    t.assign(rays.size(), -1);
+    hit_record rec;
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < rays.size(); ++i)
+        if (world.hit(rays[i], interval(0.001, infinity), rec))
+            t[i] = rec.t;
+    return seconds_since(start);
+}
+
+int main() {
+    const int count = 10000, frames = 8;
+    material_table materials;
+    auto diffuse = materials.add(make_shared<lambertian1>(color(0.5, 0.5, 0.5), 0.0));
+    mesh_data torus;
+    build_torus_mesh(100, 100, torus);
+
+    auto start = bench_clock::now();
+    auto mesh = make_shared<triangle_mesh>(std::move(torus), diffuse);
+    double mesh_seconds = seconds_since(start);
+
+    rng_engine rng;
+    rng.seed(5, 4);
+    auto next = [&rng](double min, double max) { return min + (max - min) * rng.next_double(); };
+    std::vector<affine_transform> placements, motions;
+    scene_objects_list list;
+    std::vector<shared_ptr<instance>> instances;
+    for (int i = 0; i < count; ++i) {
+        double s = next(0.5, 1.5);
+        placements.push_back(affine_transform::translate(vec3(next(-45, 45), next(-45, 45), next(-45, 45)))
+                             * affine_transform::scale(vec3(s, s, s)));
+        motions.push_back(affine_transform::translate(vec3(next(-1, 1), next(-1, 1), next(-1, 1)))
+                          * affine_transform::rotate(vec3(next(-1, 1), next(-1, 1), next(-1, 1)), next(5, 20)));
+        instances.push_back(make_shared<instance>(mesh, placements.back()));
+        list.add(instances.back());
+    }
+
+    bvh rebuilt(list), refit_only(list), updated(list);
+    refit_only.rebuild_ratio = std::numeric_limits<double>::infinity();
+    auto rays = make_random_rays(100000, 43);
+    std::printf("%d instances, mesh BVH build %.3f s, top level build %.4f s\n\n", count, mesh_seconds,
+                rebuilt.build_seconds());
+    std::printf("frame  move ms  rebuild ms  refit ms  update ms   SAH: rebuilt  refit  update"
+                "   Mrays/s: rebuilt  refit  update  same hits\n");
+
+    std::vector<real> t_rebuilt, t_refit, t_updated;
+    for (int frame = 1; frame <= frames; ++frame) {
+        start = bench_clock::now();
+        for (int i = 0; i < count; ++i) {
+            placements[i] = placements[i] * motions[i];
+            instances[i]->set_transform(placements[i]);
+        }
+        double move_seconds = seconds_since(start);
+
+        start = bench_clock::now();
+        rebuilt.rebuild();
+        double rebuild_seconds = seconds_since(start);
+        start = bench_clock::now();
+        refit_only.update();
+        double refit_seconds = seconds_since(start);
+        start = bench_clock::now();
+        bool was_rebuilt = updated.update();
+        double update_seconds = seconds_since(start);
+
+        double speed[3];
+        speed[0] = rays.size() / trace(rebuilt, rays, t_rebuilt) / 1e6;
+        speed[1] = rays.size() / trace(refit_only, rays, t_refit) / 1e6;
+        speed[2] = rays.size() / trace(updated, rays, t_updated) / 1e6;
+        long same = 0;
+        for (size_t i = 0; i < rays.size(); ++i)
+            same += t_rebuilt[i] == t_refit[i] && t_rebuilt[i] == t_updated[i];
+
+        std::printf("%5d %8.2f %11.2f %9.2f %8.2f%s %10.2f %6.2f %7.2f %16.3f %6.3f %7.3f %7ld/%zu\n", frame,
+                    move_seconds * 1e3, rebuild_seconds * 1e3, refit_seconds * 1e3, update_seconds * 1e3,
+                    was_rebuilt ? "*" : " ", rebuilt.metrics().sah_cost, refit_only.metrics().sah_cost,
+                    updated.metrics().sah_cost, speed[0], speed[1], speed[2], same, rays.size());
+    }
+    std::printf("\n* update rebuilt the top level this frame. A full rebuild per frame costs %.3f s + the "
+                "top level.\n", mesh_seconds);
+    return 0;
+}
@@ -0,0 +1,151 @@
+// Benchmark for secondary ray reordering in the wavefront integrator (camera::reorder_rays,
+// see wavefront.h). Renders 100k and 1M random spheres with the wavefront integrator, with
+// and without sorting each bounce's rays, in batches of 32k paths. Reports the render time,
+// the time spent sorting and, where the kernel exposes hardware counters, the cache misses
+// and L1 data cache read misses of the render. Reordering only changes the order rays are
+// traced in, so the images must be identical; the PFMs are compared byte for byte and
+// removed afterwards.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/bvh.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class miss_counter {
+    // Hardware cache event of this process and the threads it starts while counting.
+    // Virtual machines and containers often hide the counters; available() is false then.
+    public:
+    miss_counter(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd < 0)
+            error = std::strerror(errno);
+    }
+
+    ~miss_counter() {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool available() const { return fd >= 0; }
+    const std::string& why_unavailable() const { return error; }
+
+    void start() {
+        if (fd < 0)
+            return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    long long stop() {
+        // Events counted since start(), -1 without counters
+        if (fd < 0)
+            return -1;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long count = 0;
+        if (read(fd, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count)))
+            return -1;
+        return count;
+    }
+
+    private:
+    int fd = -1;
+    std::string error;
+};
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void print_count(const char* label, long long count, long long baseline) {
+    if (count < 0)
+        std::printf("  %s n/a", label);
+    else if (baseline > 0)
+        std::printf("  %s %.3e (%+.1f%%)", label, static_cast<double>(count), 100.0 * (count - baseline) / baseline);
+    else
+        std::printf("  %s %.3e", label, static_cast<double>(count));
+}
+
+static void run(const char* name, const scene_object& world, const material_table& materials, camera& cam) {
+    cam.output_dir = "bench/";
+    cam.thread_count = 0;
+    cam.ppm = ppm_format::none;
+    cam.write_jpg = false;
+    cam.write_pfm = true;
+    cam.wavefront = true;
+
+    miss_counter cache_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    miss_counter l1_misses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                               | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+    std::string images[2];
+    double seconds[2];
+    long long misses[2], l1[2];
+    for (int reorder = 0; reorder < 2; ++reorder) {
+        cam.reorder_rays = reorder != 0;
+        std::string filename = std::string("reorder_") + name + (reorder ? "_sorted" : "_unsorted");
+        cache_misses.start();
+        l1_misses.start();
+        cam.render(world, materials, filename);
+        misses[reorder] = cache_misses.stop();
+        l1[reorder] = l1_misses.stop();
+        seconds[reorder] = cam.last_render_seconds;
+
+        std::printf("%-14s %-9s %7.3f s %6.2f Mrays/s  sorting %6.3f s (%4.1f%%)", name,
+                    reorder ? "sorted" : "unsorted", cam.last_render_seconds,
+                    cam.last_stats.segments / cam.last_render_seconds / 1e6, cam.last_stats.reorder_seconds,
+                    100.0 * cam.last_stats.reorder_seconds / cam.last_render_seconds);
+        print_count("cache misses", misses[reorder], reorder ? misses[0] : 0);
+        print_count("L1d read misses", l1[reorder], reorder ? l1[0] : 0);
+        std::printf("\n");
+        images[reorder] = read_file("bench/" + filename + ".pfm");
+        std::remove(("bench/" + filename + ".pfm").c_str());
+    }
+    if (!cache_misses.available())
+        std::printf("%-14s hardware cache counters unavailable: %s\n", name, cache_misses.why_unavailable().c_str());
+    std::printf("%-14s speedup %.2fx, images identical: %s\n\n", name, seconds[0] / seconds[1],
+                !images[0].empty() && images[0] == images[1] ? "yes" : "NO");
+}
+
+int main() {
+    const int counts[] = { 100000, 1000000 };
+    for (int count : counts) {
+        scene_objects_list list;
+        material_table materials;
+        build_random_spheres(list, materials, count, 7);
+        bvh world(list);
+        size_t bytes = world.node_count() * sizeof(bvh_node) + list.objects.size() * (sizeof(sphere) + sizeof(void*));
+        std::printf("%d spheres, about %.0f MB of BVH nodes and spheres\n", count, bytes / 1e6);
+
+        camera cam;
+        setup_random_spheres_camera(cam);
+        cam.image_width = 320;
+        cam.sample_size = 8;
+        cam.max_depth = 8;
+        cam.tile_size = 64; // 64 x 64 pixels x 8 samples: 32k paths per batch
+        run(count < 1000000 ? "spheres_100k" : "spheres_1m", world, materials, cam);
+    }
+    return 0;
+}
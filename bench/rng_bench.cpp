@@ -0,0 +1,73 @@
+// Microbenchmark for the random number layer in src/rng.h.
+// Reports the cost of a single draw for each engine (and libc rand() for reference),
+// plus the cost of the random numbers consumed by one typical camera sample.
+//
+// Build and run with `make bench`.
+
+#include "../src/common.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ns(bench_clock::time_point start, bench_clock::time_point end) {
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+static volatile double sink; // keeps the optimizer from dropping the loops
+
+template <typename Engine>
+static double ns_per_draw(long iterations) {
+    Engine engine;
+    engine.seed(42, 54);
+    double sum = 0;
+    auto start = bench_clock::now();
+    for (long i = 0; i < iterations; ++i)
+        sum += engine.next_double();
+    auto end = bench_clock::now();
+    sink = sum;
+    return elapsed_ns(start, end) / iterations;
+}
+
+static double ns_per_rand(long iterations) {
+    double sum = 0;
+    auto start = bench_clock::now();
+    for (long i = 0; i < iterations; ++i)
+        sum += rand() / (RAND_MAX + 1.0);
+    auto end = bench_clock::now();
+    sink = sum;
+    return elapsed_ns(start, end) / iterations;
+}
+
+static double ns_per_camera_sample(long iterations, int bounces) {
+    // Mimics the draws of one camera sample: pixel jitter and lens sample on bounce 0,
+    // then a reseed and a random unit vector for each bounce
+    double sum = 0;
+    auto start = bench_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        rng_begin_sample(0, static_cast<uint64_t>(i >> 7), static_cast<uint32_t>(i & 127));
+        sum += random_double() + random_double();
+        sum += random_in_unit_disk().x();
+        for (int b = 1; b <= bounces; ++b) {
+            rng_begin_bounce(b);
+            sum += random_unit_vector().x();
+        }
+    }
+    auto end = bench_clock::now();
+    sink = sum;
+    return elapsed_ns(start, end) / iterations;
+}
+
+int main() {
+    const long draws = 50000000;
+    const long samples = 5000000;
+
+    std::printf("%-34s %8.2f ns\n", "rand() per draw", ns_per_rand(draws));
+    std::printf("%-34s %8.2f ns\n", "pcg32 per draw", ns_per_draw<pcg32>(draws));
+    std::printf("%-34s %8.2f ns\n", "philox4x32 per draw", ns_per_draw<philox4x32>(draws));
+    std::printf("%-34s %8.2f ns\n", "camera sample, 4 bounces", ns_per_camera_sample(samples, 4));
+    std::printf("%-34s %8.2f ns\n", "camera sample, 16 bounces", ns_per_camera_sample(samples, 16));
+    return 0;
+}
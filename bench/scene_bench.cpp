@@ -0,0 +1,75 @@
+// Benchmark for the scene files in src/scene_file.h. Writes a scene with 1M random spheres
+// in the text and the binary form, then times load_scene on each and build_scene on the
+// result. Both forms must describe exactly the same scene. Files go to bench/ and are
+// removed afterwards.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/scene_file.h"
+
+#include <chrono>
+#include <cstdio>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static bool same_scene(const scene_description& a, const scene_description& b) {
+    return a.spheres.size() == b.spheres.size() && a.materials.size() == b.materials.size()
+        && std::memcmp(a.spheres.data(), b.spheres.data(), a.spheres.size() * sizeof(scene_sphere)) == 0
+        && std::memcmp(a.materials.data(), b.materials.data(), a.materials.size() * sizeof(scene_material)) == 0
+        && std::memcmp(&a.camera, &b.camera, sizeof(scene_camera)) == 0
+        && a.material_names == b.material_names;
+}
+
+int main() {
+    const int count = 1000000;
+    const char* paths[] = { "bench/scene_bench.scene", "bench/scene_bench.rbscene" };
+    {
+        scene_description scene;
+        const char* names[] = { "matte", "shiny", "glass" };
+        for (int m = 0; m < 3; ++m) {
+            scene_material material = {};
+            material.kind = m == 0 ? scene_material_kind::lambertian1
+                          : m == 1 ? scene_material_kind::metal : scene_material_kind::dielectric;
+            if (m != 2) // a dielectric has no albedo
+                material.albedo[0] = material.albedo[1] = material.albedo[2] = 0.5;
+            material.parameter = m == 2 ? 1.5 : 0.1;
+            scene.materials.push_back(material);
+            scene.material_names.push_back(names[m]);
+        }
+        rng_engine rng;
+        rng.seed(11, 0);
+        for (int i = 0; i < count; ++i) {
+            scene_sphere s = {};
+            for (int a = 0; a < 3; ++a)
+                s.center[a] = rng.next_double() * 200 - 100;
+            s.radius = 0.05 + 0.2 * rng.next_double();
+            s.material = static_cast<uint32_t>(i % 3);
+            scene.spheres.push_back(s);
+        }
+        save_scene_text(paths[0], scene);
+        save_scene_binary(paths[1], scene);
+    }
+
+    scene_description loaded[2];
+    for (int form = 0; form < 2; ++form) {
+        auto start = bench_clock::now();
+        bool ok = load_scene(paths[form], loaded[form]);
+        double parse_seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+        scene_objects_list world;
+        material_table materials;
+        camera cam;
+        start = bench_clock::now();
+        ok = ok && build_scene(loaded[form], world, materials, cam);
+        double build_seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+        std::printf("%-28s %6.1f MB  load %8.3f s  build objects %6.3f s  %zu objects%s\n", paths[form],
+                    mapped_file(paths[form]).size() / 1e6, parse_seconds, build_seconds, world.objects.size(),
+                    ok ? "" : "  FAILED");
+        std::remove(paths[form]);
+    }
+    std::printf("text and binary scenes identical: %s\n", same_scene(loaded[0], loaded[1]) ? "yes" : "NO");
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Benchmark for the SIMD sphere kernels in src/sphere_batch.h.
+// Times a linear scan over 1k, 100k and 1M spheres with the scalar sphere_shape::hit loop
+// and with sphere_batch at every instruction set this CPU supports, and checks that all of
+// them report the same closest hits.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/sphere_batch.h"
+
+#include <chrono>
+#include <cstdio>
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct trace_result {
+    double seconds = 0;
+    long hits = 0;
+    double t_sum = 0;
+};
+
+template <typename Hit>
+static trace_result trace(const std::vector<ray>& rays, Hit hit) {
+    trace_result result;
+    hit_record rec;
+    auto start = bench_clock::now();
+    for (const auto& r : rays) {
+        if (hit(r, rec)) {
+            ++result.hits;
+            result.t_sum += rec.t;
+        }
+    }
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return result;
+}
+
+int main() {
+    const int sizes[] = { 1000, 100000, 1000000 };
+    const double tests_per_size = 2e8;
+
+    std::printf("precision %s, best instruction set %s\n\n", sizeof(real) == sizeof(float) ? "float" : "double",
+                simd_level_name(best_simd_level()));
+
+    for (int spheres : sizes) {
+        scene_objects_list list;
+        material_table materials;
+        build_random_primitives(list, materials, 2 * spheres, 13);
+        std::vector<sphere_shape> shapes;
+        sphere_batch batch;
+        for (const auto& object : list.objects) {
+            if (auto s = std::dynamic_pointer_cast<sphere>(object)) {
+                shapes.push_back(s->data());
+                batch.add(s->data());
+            }
+        }
+
+        int ray_count = static_cast<int>(tests_per_size / spheres);
+        auto rays = make_random_rays(ray_count, 14);
+        double tests = static_cast<double>(spheres) * ray_count;
+
+        auto scalar = trace(rays, [&](const ray& r, hit_record& rec) {
+            bool hit_anything = false;
+            real closest = infinity;
+            for (const auto& s : shapes) {
+                if (s.hit(r, interval(0.001, closest), rec)) {
+                    hit_anything = true;
+                    closest = rec.t;
+                }
+            }
+            return hit_anything;
+        });
+        std::printf("%-14s %8d spheres %7d rays %7.3f s %6.2f ns/test %6ld hits  t sum %.9g\n", "sphere_shape",
+                    spheres, ray_count, scalar.seconds, 1e9 * scalar.seconds / tests, scalar.hits, scalar.t_sum);
+
+        const simd_level levels[] = { simd_level::scalar, simd_level::sse4, simd_level::avx2, simd_level::avx512 };
+        for (simd_level level : levels) {
+            if (!simd_level_supported(level))
+                continue;
+            batch.level = level;
+            auto result = trace(rays, [&](const ray& r, hit_record& rec) {
+                return batch.hit(r, interval(0.001, infinity), rec);
+            });
+            bool same = result.hits == scalar.hits && result.t_sum == scalar.t_sum;
+            std::printf("batch %-8s %8d spheres %7d rays %7.3f s %6.2f ns/test %6ld hits  %.2fx%s\n",
+                        simd_level_name(level), spheres, ray_count, result.seconds, 1e9 * result.seconds / tests,
+                        result.hits, scalar.seconds / result.seconds, same ? "" : "  MISMATCH");
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,251 @@
+// Benchmark suite for tracking performance over time. Microbenchmarks time the hot
+// functions on fixed inputs: sphere::hit, triangle::hit, scene_objects_list::hit over 64
+// primitives, random_unit_vector, refract and write_color. Each runs several times and the
+// fastest run counts. End-to-end renders of the main.cpp scene and of 100k random spheres
+// report Mrays/s and ns per ray at 1, 2, 4, ... threads up to the hardware's, with the
+// speedup and parallel efficiency over one thread.
+//
+// Results are written as JSON, by default to bench/results.json, or to stdout when the
+// output is `-`, so they can be piped straight into a JSON parser:
+//   suite_bench [output.json | - [revision]]
+// The readable table goes to stderr, and the renders run with the camera's own progress
+// and statistics output turned off. `make bench` and `make bench_suite` pass the git
+// revision, so result files from different commits can be told apart.
+
+#include "bench_scenes.h"
+
+#include "../src/bvh.h"
+#include "../src/simd.h"
+#include "../src/thread_pool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static volatile double sink; // keeps the optimizer from dropping the loops
+
+struct micro_result {
+    std::string name;
+    long iterations;
+    double ns_per_op;   // fastest of the runs
+};
+
+struct render_result {
+    std::string scene;
+    int width, height, samples, max_depth, threads;
+    double seconds;
+    long long rays;
+    double mrays_per_second, ns_per_ray, speedup, efficiency;
+};
+
+template <typename body_function>
+static micro_result measure(const char* name, long iterations, const body_function& body) {
+    // body(iterations) runs the operation that many times and returns a value depending on
+    // every result
+    const int runs = 5;
+    double best = 0;
+    for (int run = 0; run < runs; ++run) {
+        auto start = bench_clock::now();
+        sink = body(iterations);
+        double ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / iterations;
+        if (run == 0 || ns < best)
+            best = ns;
+    }
+    std::fprintf(stderr, "%-26s %9.2f ns %10.2f Mops/s\n", name, best, 1e3 / best);
+    return micro_result{ name, iterations, best };
+}
+
+static std::vector<micro_result> run_micro() {
+    // Inputs cycle through 4096 entries, small enough to stay in cache
+    const int input_count = 4096;
+    auto rays = make_random_rays(input_count, 17);
+    material_table materials;
+    auto diffuse = materials.add(make_shared<lambertian1>(color(0.5, 0.5, 0.5), 0.0));
+    sphere ball(point3(0, 0, 0), 20, diffuse);
+    triangle plane(point3(-40, -40, 0), point3(40, -40, 0), point3(0, 40, 0), vec3(0, 0, 1), diffuse);
+    scene_objects_list list;
+    build_random_primitives(list, materials, 64, 3);
+
+    rng_begin_sample(0, 0, 0);
+    std::vector<vec3> directions(input_count), normals(input_count);
+    std::vector<color> colors(input_count);
+    for (int i = 0; i < input_count; ++i) {
+        directions[i] = random_unit_vector();
+        normals[i] = random_unit_vector();
+        if (dot(directions[i], normals[i]) > 0)
+            normals[i] = -normals[i];
+        colors[i] = color(random_double(), random_double(), random_double()) * 1.2;
+    }
+
+    std::vector<micro_result> results;
+    results.push_back(measure("sphere::hit", 20000000, [&](long n) {
+        hit_record rec;
+        double sum = 0;
+        for (long i = 0; i < n; ++i)
+            if (ball.hit(rays[i & (input_count - 1)], interval(0.001, infinity), rec))
+                sum += rec.t;
+        return sum;
+    }));
+    results.push_back(measure("triangle::hit", 20000000, [&](long n) {
+        hit_record rec;
+        double sum = 0;
+        for (long i = 0; i < n; ++i)
+            if (plane.hit(rays[i & (input_count - 1)], interval(0.001, infinity), rec))
+                sum += rec.t;
+        return sum;
+    }));
+    results.push_back(measure("scene_objects_list::hit", 500000, [&](long n) {
+        // 64 primitives, half spheres and half triangles, behind the virtual interface
+        hit_record rec;
+        double sum = 0;
+        for (long i = 0; i < n; ++i)
+            if (list.hit(rays[i & (input_count - 1)], interval(0.001, infinity), rec))
+                sum += rec.t;
+        return sum;
+    }));
+    results.push_back(measure("random_unit_vector", 20000000, [&](long n) {
+        rng_begin_sample(0, 1, 0);
+        double sum = 0;
+        for (long i = 0; i < n; ++i)
+            sum += random_unit_vector().x();
+        return sum;
+    }));
+    results.push_back(measure("refract", 20000000, [&](long n) {
+        rng_begin_sample(0, 2, 0);
+        double sum = 0;
+        for (long i = 0; i < n; ++i) {
+            int k = static_cast<int>(i & (input_count - 1));
+            sum += refract(directions[k], normals[k], 1/1.5).x();
+        }
+        return sum;
+    }));
+    results.push_back(measure("write_color", 5000000, [&](long n) {
+        // Text PPM pixels into memory, so the disk stays out of it
+        std::ostringstream out;
+        uint8_t rgb[3];
+        double sum = 0;
+        for (long i = 0; i < n; ++i) {
+            write_color(out, colors[i & (input_count - 1)], 1, rgb);
+            sum += rgb[0];
+        }
+        return sum + out.tellp();
+    }));
+    return results;
+}
+
+static void run_render(const char* name, const scene_object& world, const material_table& materials, camera& cam,
+                       std::vector<render_result>& results) {
+    cam.ppm = ppm_format::none;
+    cam.write_jpg = false;
+    cam.write_pfm = false;
+    cam.verbose = false;
+
+    int hardware = default_thread_count();
+    std::vector<int> thread_counts;
+    for (int t = 1; t < hardware; t *= 2)
+        thread_counts.push_back(t);
+    thread_counts.push_back(hardware);
+
+    double one_thread_seconds = 0;
+    for (int threads : thread_counts) {
+        cam.thread_count = threads;
+        cam.render(world, materials, "suite");
+        render_result r;
+        r.scene = name;
+        r.width = cam.image_width;
+        r.height = static_cast<int>(cam.image_width / cam.aspect_ratio);
+        r.samples = cam.sample_size;
+        r.max_depth = cam.max_depth;
+        r.threads = threads;
+        r.seconds = cam.last_render_seconds;
+        r.rays = cam.last_stats.segments;
+        r.mrays_per_second = r.rays / r.seconds / 1e6;
+        r.ns_per_ray = r.seconds * 1e9 / r.rays;
+        if (threads == 1)
+            one_thread_seconds = r.seconds;
+        r.speedup = one_thread_seconds / r.seconds;
+        r.efficiency = r.speedup / threads;
+        std::fprintf(stderr, "%-14s %3d threads %8.3f s %8.2f Mrays/s %8.1f ns/ray  speedup %5.2fx  efficiency %3.0f%%\n",
+                    name, threads, r.seconds, r.mrays_per_second, r.ns_per_ray, r.speedup, 100 * r.efficiency);
+        results.push_back(r);
+    }
+}
+
+static bool write_json(const std::string& path, const std::string& revision, const std::vector<micro_result>& micro,
+                       const std::vector<render_result>& renders) {
+    bool to_stdout = path == "-";
+    FILE* out = to_stdout ? stdout : std::fopen(path.c_str(), "w");
+    if (!out)
+        return false;
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    std::fprintf(out, "{\n  \"schema\": 1,\n  \"date\": \"%s\",\n  \"revision\": \"%s\",\n", date, revision.c_str());
+    std::fprintf(out, "  \"compiler\": \"%s\",\n  \"real\": \"%s\",\n  \"simd\": \"%s\",\n  \"hardware_threads\": %d,\n",
+                 __VERSION__, sizeof(real) == sizeof(float) ? "float" : "double",
+                 simd_level_name(best_simd_level()), default_thread_count());
+
+    std::fprintf(out, "  \"micro\": [\n");
+    for (size_t i = 0; i < micro.size(); ++i) {
+        const micro_result& m = micro[i];
+        std::fprintf(out, "    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.4f}%s\n", m.name.c_str(),
+                     m.iterations, m.ns_per_op, i + 1 < micro.size() ? "," : "");
+    }
+    std::fprintf(out, "  ],\n  \"renders\": [\n");
+    for (size_t i = 0; i < renders.size(); ++i) {
+        const render_result& r = renders[i];
+        std::fprintf(out, "    {\"scene\": \"%s\", \"width\": %d, \"height\": %d, \"samples\": %d, \"max_depth\": %d, "
+                          "\"threads\": %d, \"seconds\": %.4f, \"rays\": %lld, \"mrays_per_second\": %.4f, "
+                          "\"ns_per_ray\": %.3f, \"speedup\": %.4f, \"efficiency\": %.4f}%s\n",
+                     r.scene.c_str(), r.width, r.height, r.samples, r.max_depth, r.threads, r.seconds, r.rays,
+                     r.mrays_per_second, r.ns_per_ray, r.speedup, r.efficiency, i + 1 < renders.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    return to_stdout ? std::fflush(out) == 0 && !std::ferror(out) : std::fclose(out) == 0;
+}
+
+int main(int argc, char** argv) {
+    std::string path = argc > 1 ? argv[1] : "bench/results.json";
+    std::string revision = argc > 2 ? argv[2] : "";
+
+    auto micro = run_micro();
+    std::fprintf(stderr, "\n");
+
+    std::vector<render_result> renders;
+    {
+        scene_objects_list list;
+        material_table materials;
+        build_main_scene(list, materials);
+        bvh world(list);
+        camera cam;
+        setup_main_camera(cam);
+        cam.image_width = 400;
+        cam.sample_size = 16;
+        run_render("main", world, materials, cam, renders);
+    }
+    {
+        scene_objects_list list;
+        material_table materials;
+        build_random_spheres(list, materials, 100000, 7);
+        bvh world(list);
+        camera cam;
+        setup_random_spheres_camera(cam);
+        cam.image_width = 400;
+        cam.sample_size = 8;
+        run_render("spheres_100k", world, materials, cam, renders);
+    }
+
+    if (!write_json(path, revision, micro, renders)) {
+        std::fprintf(stderr, "\nCould not write %s\n", path.c_str());
+        return 1;
+    }
+    if (path != "-")
+        std::fprintf(stderr, "\nResults written to %s\n", path.c_str());
+    return 0;
+}
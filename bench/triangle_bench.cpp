@@ -0,0 +1,169 @@
+// Benchmark for the triangle kernels: the blocked SIMD watertight kernel used by
+// triangle_mesh (src/triangle_block.h) at each instruction set, against separate triangle
+// objects in a bvh.
+//
+// Throughput is measured with random rays through a 2M triangle torus. Watertightness is
+// checked on a coarse torus by shooting rays from inside the tube straight at its vertices
+// and edge midpoints, where neighbouring triangles meet: every one of them must hit. The
+// same rays are also given to the Moller-Trumbore test and to the triangle test this
+// renderer used before, which rejected rays within 0.01 of parallel to the plane.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/bvh.h"
+#include "../src/triangle_mesh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static bool moller_trumbore(const ray& r, const point3& a, const point3& b, const point3& c, interval ray_t) {
+    vec3 edge_1 = b - a, edge_2 = c - a;
+    vec3 p = cross(r.direction(), edge_2);
+    auto det = dot(edge_1, p);
+    if (det == 0)
+        return false;
+    auto inv_det = 1 / det;
+    vec3 s = r.origin() - a;
+    auto u = dot(s, p) * inv_det;
+    if (u < 0 || u > 1)
+        return false;
+    vec3 q = cross(s, edge_1);
+    auto v = dot(r.direction(), q) * inv_det;
+    if (v < 0 || u + v > 1)
+        return false;
+    return ray_t.surrounds(dot(edge_2, q) * inv_det);
+}
+
+static bool previous_triangle_test(const ray& r, const point3& a, const point3& b, const point3& c, interval ray_t) {
+    // The test triangle::hit used to do
+    vec3 normal = cross(b - a, c - a);
+    auto denom = dot(r.direction(), normal);
+    auto numer = dot((a - r.origin()), normal);
+    if (denom <= 0.01 && denom >= -0.01)
+        return false;
+    auto t = numer / denom;
+    if (!ray_t.surrounds(t))
+        return false;
+    vec3 p = r.at(t);
+    return dot(cross(b - a, p - a), normal) >= 0 && dot(cross(c - b, p - b), normal) >= 0
+        && dot(cross(a - c, p - c), normal) >= 0;
+}
+
+template <typename Test>
+static long count_misses(const mesh_data& mesh, const std::vector<ray>& rays, Test test) {
+    // Brute force over all triangles, so no acceleration structure can hide a crack
+    long misses = 0;
+    for (const auto& r : rays) {
+        bool hit = false;
+        for (size_t t = 0; t < mesh.triangle_count() && !hit; ++t)
+            hit = test(r, mesh.positions[mesh.indices[3*t]], mesh.positions[mesh.indices[3*t + 1]],
+                       mesh.positions[mesh.indices[3*t + 2]], interval(0.001, infinity));
+        misses += !hit;
+    }
+    return misses;
+}
+
+static const simd_level levels[] = { simd_level::scalar, simd_level::sse4, simd_level::avx2, simd_level::avx512 };
+
+static bool runnable(simd_level level) {
+    // Levels the block kernel really runs at; in the float build avx512 falls back to avx2
+    return simd_level_supported(level) && triangle_block_level(level) == level;
+}
+
+int main() {
+    std::printf("precision %s, best instruction set %s\n\n", sizeof(real) == sizeof(float) ? "float" : "double",
+                simd_level_name(best_simd_level()));
+
+    material_table materials;
+    auto diffuse = materials.add(make_shared<lambertian1>(color(0.5, 0.5, 0.5), 0.0));
+
+    // Throughput
+    {
+        mesh_data torus;
+        build_torus_mesh(1000, 1000, torus);
+        auto rays = make_random_rays(1000000, 31);
+        for (auto& r : rays)
+            r = ray(r.origin() / 40, r.direction()); // aim at the torus
+
+        scene_objects_list list;
+        for (size_t t = 0; t < torus.triangle_count(); ++t) {
+            const point3& a = torus.positions[torus.indices[3*t]];
+            const point3& b = torus.positions[torus.indices[3*t + 1]];
+            const point3& c = torus.positions[torus.indices[3*t + 2]];
+            list.add(make_shared<triangle>(a, b, c, cross(b - a, c - a), diffuse));
+        }
+        bvh separate(list);
+        triangle_mesh mesh(torus, diffuse);
+
+        auto trace = [&](const scene_object& world, const char* name) {
+            hit_record rec;
+            long hits = 0;
+            auto start = bench_clock::now();
+            for (const auto& r : rays)
+                hits += world.hit(r, interval(0.001, infinity), rec);
+            double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+            std::printf("%-28s %7.3f s %7.2f Mrays/s %8ld hits\n", name, seconds, rays.size() / seconds / 1e6, hits);
+        };
+        std::printf("%zu triangles: %d bvh nodes over separate triangles, %d nodes and %d blocks in the mesh\n",
+                    torus.triangle_count(), separate.node_count(), mesh.node_count(), mesh.block_count());
+        trace(separate, "triangle objects + bvh");
+        for (simd_level level : levels) {
+            if (!runnable(level))
+                continue;
+            mesh.level = level;
+            std::string name = std::string("triangle_mesh ") + simd_level_name(level);
+            trace(mesh, name.c_str());
+        }
+        std::printf("\n");
+    }
+
+    // Watertightness
+    {
+        mesh_data torus;
+        build_torus_mesh(48, 32, torus);
+        triangle_mesh mesh(torus, diffuse);
+
+        // From a point on the tube's core circle to every vertex and every edge midpoint
+        std::vector<ray> rays;
+        for (size_t t = 0; t < torus.triangle_count(); ++t) {
+            for (int k = 0; k < 3; ++k) {
+                const point3& a = torus.positions[torus.indices[3*t + k]];
+                const point3& b = torus.positions[torus.indices[3*t + (k + 1) % 3]];
+                const point3 targets[2] = { a, (a + b) / 2 };
+                for (const point3& target : targets) {
+                    for (double offset : { -0.03, 0.0, 0.05 }) {
+                        double angle = std::atan2(target[2], target[0]) + offset;
+                        point3 core(std::cos(angle), 0.02, std::sin(angle));
+                        rays.push_back(ray(core, target - core));
+                    }
+                }
+            }
+        }
+
+        std::printf("%zu rays through vertices and edges of a closed %zu triangle mesh\n", rays.size(),
+                    torus.triangle_count());
+        for (simd_level level : levels) {
+            if (!runnable(level))
+                continue;
+            mesh.level = level;
+            long misses = 0;
+            hit_record rec;
+            for (const auto& r : rays)
+                misses += !mesh.hit(r, interval(0.001, infinity), rec);
+            std::printf("%-28s %6ld misses\n", (std::string("triangle_mesh ") + simd_level_name(level)).c_str(), misses);
+        }
+        std::printf("%-28s %6ld misses\n", "watertight_intersect", count_misses(torus, rays,
+            [](const ray& r, const point3& a, const point3& b, const point3& c, interval ray_t) {
+                real t, weights[3];
+                return watertight_intersect<real>(watertight_ray(r), a, b, c, ray_t, t, weights);
+            }));
+        std::printf("%-28s %6ld misses\n", "moller-trumbore", count_misses(torus, rays, moller_trumbore));
+        std::printf("%-28s %6ld misses\n", "previous triangle test", count_misses(torus, rays, previous_triangle_test));
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Benchmark for the wavefront integrator in src/wavefront.h against camera::ray_color on
+// the main.cpp scene and on 100k spheres, plus the main scene with adaptive sampling and
+// Russian roulette. Both integrators draw the same random numbers, so their images must
+// be identical; the PFMs are compared byte for byte and removed afterwards.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/bvh.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void run(const char* name, const scene_object& world, const material_table& materials, camera& cam) {
+    cam.output_dir = "bench/";
+    cam.thread_count = 0;
+    cam.ppm = ppm_format::none;
+    cam.write_jpg = false;
+    cam.write_pfm = true;
+
+    std::string images[2];
+    double mrays[2];
+    for (int wavefront = 0; wavefront < 2; ++wavefront) {
+        cam.wavefront = wavefront != 0;
+        std::string filename = std::string("wavefront_") + name + (wavefront ? "_wavefront" : "_path");
+        cam.render(world, materials, filename);
+        mrays[wavefront] = cam.last_stats.segments / cam.last_render_seconds / 1e6;
+        std::printf("%-22s %-10s %8.3f s %8.3f Mrays/s %12lld rays\n", name, wavefront ? "wavefront" : "path",
+                    cam.last_render_seconds, mrays[wavefront], cam.last_stats.segments);
+        images[wavefront] = read_file("bench/" + filename + ".pfm");
+        std::remove(("bench/" + filename + ".pfm").c_str());
+    }
+    std::printf("%-22s speedup %.2fx, images identical: %s\n\n", name, mrays[1] / mrays[0],
+                !images[0].empty() && images[0] == images[1] ? "yes" : "NO");
+}
+
+int main() {
+    {
+        scene_objects_list list;
+        material_table materials;
+        build_main_scene(list, materials);
+        bvh world(list);
+        camera cam;
+        setup_main_camera(cam);
+        cam.image_width = 400;
+        cam.sample_size = 32;
+        cam.sampler = sampler_type::sobol;
+        run("main", world, materials, cam);
+
+        cam.adaptive_sampling = true;
+        cam.russian_roulette = true;
+        cam.sample_size = 64;
+        run("main_adaptive_rr", world, materials, cam);
+    }
+    {
+        scene_objects_list list;
+        material_table materials;
+        build_random_spheres(list, materials, 100000, 7);
+        bvh world(list);
+        camera cam;
+        setup_random_spheres_camera(cam);
+        cam.image_width = 400;
+        cam.sample_size = 16;
+        run("spheres_100k", world, materials, cam);
+    }
+    return 0;
+}
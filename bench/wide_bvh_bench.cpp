@@ -0,0 +1,77 @@
+// Benchmark for the wide BVH in src/wide_bvh.h: the binary bvh against wide_bvh<4> and
+// wide_bvh<8> (quantized child boxes, SIMD child tests) over the same scene objects.
+// Reports the node memory and the trace speed of every layout and child test kernel; all
+// of them must find the same hits.
+//
+// Build and run with `make bench`.
+
+#include "bench_scenes.h"
+
+#include "../src/bvh.h"
+#include "../src/wide_bvh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct trace_result {
+    double seconds = 0;
+    long hits = 0;
+    double t_sum = 0; // checks that the layouts found the same hits
+};
+
+static trace_result trace(const scene_object& world, const std::vector<ray>& rays) {
+    trace_result result;
+    hit_record rec;
+    auto start = bench_clock::now();
+    for (const auto& r : rays) {
+        if (world.hit(r, interval(0.001, infinity), rec)) {
+            ++result.hits;
+            result.t_sum += rec.t;
+        }
+    }
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return result;
+}
+
+static void report(const std::string& name, int nodes, size_t bytes, const trace_result& result, size_t ray_count) {
+    std::printf("%-22s %8d nodes %8.1f MB %7.2f Mrays/s %7ld hits  t sum %.9g\n", name.c_str(), nodes, bytes / 1e6,
+                ray_count / result.seconds / 1e6, result.hits, result.t_sum);
+}
+
+template <int width>
+static void trace_wide(wide_bvh<width>& tree, const std::vector<ray>& rays) {
+    const simd_level levels[] = { simd_level::scalar, simd_level::sse4, simd_level::avx2, simd_level::avx512 };
+    for (simd_level level : levels) {
+        if (!simd_level_supported(level) || wide_bvh_level(level, width) != level)
+            continue;
+        tree.set_level(level);
+        report("wide_bvh<" + std::to_string(width) + "> " + simd_level_name(level), tree.node_count(),
+               tree.node_bytes(), trace(tree, rays), rays.size());
+    }
+}
+
+int main() {
+    std::printf("precision %s, best instruction set %s\n\n", sizeof(real) == sizeof(float) ? "float" : "double",
+                simd_level_name(best_simd_level()));
+
+    const int counts[] = { 10000, 1000000 };
+    for (int count : counts) {
+        scene_objects_list world;
+        material_table materials;
+        build_random_primitives(world, materials, count, 17);
+        auto rays = make_random_rays(count < 100000 ? 1000000 : 200000, 23);
+        std::printf("%d spheres and triangles, %zu rays\n", count, rays.size());
+
+        bvh binary(world);
+        report("bvh", binary.node_count(), binary.node_count() * sizeof(bvh_node), trace(binary, rays), rays.size());
+        wide_bvh<4> wide4(world);
+        trace_wide(wide4, rays);
+        wide_bvh<8> wide8(world);
+        trace_wide(wide8, rays);
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "common.h"
+
+class aabb {
+    // Axis-aligned bounding box, stored as one interval per axis.
+    // The default box is empty, so it can be used as the starting point of a union.
+    public:
+    interval x, y, z;
+
+    aabb() {}
+
+    aabb(const interval& ix, const interval& iy, const interval& iz) : x(ix), y(iy), z(iz) {}
+
+    aabb(const point3& a, const point3& b) {
+        // Treat the two points as opposite corners of the box, in any order
+        x = interval(fmin(a[0], b[0]), fmax(a[0], b[0]));
+        y = interval(fmin(a[1], b[1]), fmax(a[1], b[1]));
+        z = interval(fmin(a[2], b[2]), fmax(a[2], b[2]));
+    }
+
+    aabb(const aabb& a, const aabb& b) : x(a.x, b.x), y(a.y, b.y), z(a.z, b.z) {} // union of two boxes
+
+    const interval& axis(int n) const {
+        if (n == 1) return y;
+        if (n == 2) return z;
+        return x;
+    }
+
+    bool empty() const {
+        return x.min > x.max || y.min > y.max || z.min > z.max;
+    }
+
+    point3 centroid() const {
+        return point3((x.min + x.max)/2, (y.min + y.max)/2, (z.min + z.max)/2);
+    }
+
+    int longest_axis() const {
+        if (x.size() > y.size())
+            return x.size() > z.size() ? 0 : 2;
+        return y.size() > z.size() ? 1 : 2;
+    }
+
+    real surface_area() const {
+        if (empty())
+            return 0;
+        auto dx = x.size(), dy = y.size(), dz = z.size();
+        return 2*(dx*dy + dy*dz + dz*dx);
+    }
+
+    aabb pad() const {
+        // Give every axis a minimum width so flat primitives (e.g. an axis aligned
+        // triangle) don't end up with a zero-volume box that rays slip past
+        const real delta = 0.0001;
+        return aabb(x.size() >= delta ? x : x.expand(delta),
+                    y.size() >= delta ? y : y.expand(delta),
+                    z.size() >= delta ? z : z.expand(delta));
+    }
+
+    static real slab_far_scale() {
+        // The far distance of a slab test is pushed out by this factor to cover the
+        // rounding of the subtraction and multiplication, otherwise a ray through a vertex
+        // or edge that lies on the box can be rejected although the triangle test would hit it.
+        const real unit_roundoff = std::numeric_limits<real>::epsilon() / 2;
+        return 1 + 2 * (3*unit_roundoff / (1 - 3*unit_roundoff));
+    }
+
+    bool hit(const ray& r, interval ray_t) const {
+        auto origin = r.origin();
+        auto direction = r.direction();
+        vec3 inv_direction(1/direction[0], 1/direction[1], 1/direction[2]);
+        return hit(origin, inv_direction, ray_t);
+    }
+
+    bool hit(const point3& origin, const vec3& inv_direction, interval ray_t) const {
+        // Slab test. Callers testing one ray against many boxes should precompute
+        // the reciprocal of the ray direction once and use this overload.
+        const real far_scale = slab_far_scale();
+        for (int a = 0; a < 3; ++a) {
+            const interval& slab = axis(a);
+            auto t0 = (slab.min - origin[a]) * inv_direction[a];
+            auto t1 = (slab.max - origin[a]) * inv_direction[a];
+            if (inv_direction[a] < 0) {
+                auto swap = t0;
+                t0 = t1;
+                t1 = swap;
+            }
+            t1 *= far_scale;
+            if (t0 > ray_t.min) ray_t.min = t0;
+            if (t1 < ray_t.max) ray_t.max = t1;
+            if (ray_t.max <= ray_t.min)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
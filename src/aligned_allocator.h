@@ -0,0 +1,37 @@
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+template <typename T, size_t alignment = 64>
+struct aligned_allocator {
+    // Allocator for std::vector that aligns the buffer to `alignment` bytes (a cache line by
+    // default). Before C++17 the standard allocator ignores alignas beyond 16 bytes.
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind { typedef aligned_allocator<U, alignment> other; };
+
+    aligned_allocator() {}
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U, alignment>&) {}
+
+    T* allocate(size_t n) {
+        void* p = nullptr;
+        if (posix_memalign(&p, alignment, n * sizeof(T)) != 0)
+            throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t) { std::free(p); }
+};
+
+template <typename T, typename U, size_t alignment>
+bool operator==(const aligned_allocator<T, alignment>&, const aligned_allocator<U, alignment>&) { return true; }
+
+template <typename T, typename U, size_t alignment>
+bool operator!=(const aligned_allocator<T, alignment>&, const aligned_allocator<U, alignment>&) { return false; }
+
+#endif
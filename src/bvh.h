@@ -0,0 +1,707 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "common.h"
+
+#include "aabb.h"
+#include "morton.h"
+#include "scene_objects.h"
+#include "scene_objects_list.h"
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+struct bvh_node {
+    // Node of a flattened bounding volume hierarchy. Nodes are stored depth first, so the
+    // left child of an interior node always directly follows it and only the right child
+    // needs an index.
+    aabb bbox;
+    int offset; // leaves: index of the first primitive, interior nodes: index of the right child
+    int count;  // number of primitives in a leaf, 0 for interior nodes
+    int axis;   // split axis of interior nodes, used to visit the nearer child first
+};
+
+enum class bvh_build_method {
+    sah,  // binned surface area heuristic: slower to build, faster to trace
+    lbvh  // linear BVH: sorts the primitives by Morton code and splits where the codes change
+};
+
+struct bvh_metrics {
+    // Shape of a built tree, to weigh build time against trace speed
+    int node_count = 0;
+    int leaf_count = 0;
+    int max_depth = 0;
+    double average_leaf_depth = 0;
+    double sah_cost = 0;           // expected cost of a ray through the root box, see bvh_tree::sah_cost
+    std::vector<int> leaf_sizes;   // leaf_sizes[n] is the number of leaves with n primitives
+};
+
+class bvh_tree {
+    // Bounding volume hierarchy over a set of boxes. The tree only knows the primitives'
+    // boxes: build() returns the order the owner must store its primitives in so every
+    // leaf covers a contiguous range, and hit() calls back into the owner for the
+    // primitives of the leaves a ray reaches. A ray only visits the nodes whose boxes it
+    // passes through, so the cost of a hit query grows with log(N) rather than N.
+    //
+    // Two builders are offered, see bvh_build_method. Both run on a thread pool: the top
+    // of the tree is split with all threads working on each node, and once there are
+    // enough independent subtrees they are built in parallel and spliced together. The
+    // SAH builder gives the same tree at any thread count.
+    public:
+    static const int max_depth = 64;     // deepest tree the traversal stack can handle
+    static const int bin_count = 16;     // SAH candidate splits per axis are bin_count - 1
+
+    // Leaves hold at most max_leaf_size primitives (except at max_depth). Owners that test
+    // primitives in SIMD groups set leaf_group to the group size, so the SAH counts the
+    // cost of a leaf in whole groups: a leaf of up to leaf_group primitives costs one test.
+    int max_leaf_size = 4;
+    int leaf_group = 1;
+
+    bvh_build_method method = bvh_build_method::sah;
+    int thread_count = 0;       // build threads, 0 uses every hardware thread
+    double build_seconds = 0;   // time the last build() took
+    double refit_seconds = 0;   // time the last refit() took
+
+    std::vector<bvh_node> nodes;
+
+    std::vector<int> build(const std::vector<aabb>& boxes) {
+        // Returns the new order of the primitives: position i of the reordered primitives
+        // holds primitive order[i]
+        auto start = std::chrono::steady_clock::now();
+        int count = static_cast<int>(boxes.size());
+        // Small trees aren't worth starting threads for
+        thread_pool pool(count < 4 * parallel_chunk ? 1 : thread_count);
+        thread_pool* workers = pool.size() > 1 ? &pool : nullptr;
+
+        std::vector<build_item> items(count);
+        for_each_chunk(workers, 0, count, [&](int begin, int end, int) {
+            for (int i = begin; i < end; ++i) {
+                items[i].bbox = boxes[i];
+                items[i].centroid = boxes[i].centroid();
+                items[i].index = i;
+                items[i].morton = 0;
+            }
+        });
+
+        nodes.clear();
+        if (count > 0) {
+            if (method == bvh_build_method::lbvh)
+                sort_by_morton_code(items, workers);
+            nodes.reserve(2 * items.size());
+            if (workers) {
+                // Subtrees of at most task_size primitives become tasks; several per
+                // thread so the pool can balance them
+                build_context upper = { workers, std::max(4 * parallel_chunk, count / (8 * pool.size())), {} };
+                std::vector<bvh_node> upper_nodes;
+                build(items, 0, count, 1, upper_nodes, upper);
+                pool.parallel_for(static_cast<int>(upper.tasks.size()), [&](int k, int) {
+                    subtree_task& task = upper.tasks[k];
+                    build_context serial = { nullptr, 0, {} };
+                    build(items, task.begin, task.end, task.depth, task.nodes, serial);
+                });
+                splice(upper_nodes, 0, upper.tasks);
+            }
+            else {
+                build_context serial = { nullptr, 0, {} };
+                build(items, 0, count, 1, nodes, serial);
+            }
+            nodes.shrink_to_fit(); // the reserve above is an upper bound
+        }
+
+        std::vector<int> order(items.size());
+        for (size_t i = 0; i < items.size(); ++i)
+            order[i] = items[i].index;
+        build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return order;
+    }
+
+    void refit(const std::vector<aabb>& boxes) {
+        // Recomputes every node box from the primitives' current boxes (in the order build()
+        // returned) and keeps the tree's shape. Children are stored after their parent, so
+        // one backward pass reaches both children of a node before the node itself.
+        auto start = std::chrono::steady_clock::now();
+        for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; --i) {
+            bvh_node& node = nodes[i];
+            if (node.count > 0) {
+                aabb bbox;
+                for (int k = node.offset; k < node.offset + node.count; ++k)
+                    bbox = aabb(bbox, boxes[k]);
+                node.bbox = bbox;
+            }
+            else {
+                node.bbox = aabb(nodes[i + 1].bbox, nodes[node.offset].bbox);
+            }
+        }
+        refit_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    template <typename hit_function>
+    bool hit(const ray& r, interval ray_t, hit_record& rec, const hit_function& hit_primitive, int root = 0) const {
+        // hit_primitive(i, ray_t, rec) tests the ray against reordered primitive i and must
+        // only write rec when it reports a hit
+        return hit_leaves(r, ray_t, rec, [&](const bvh_node& leaf, interval leaf_t, hit_record& closest) {
+            bool hit_anything = false;
+            for (int i = leaf.offset; i < leaf.offset + leaf.count; ++i) {
+                if (hit_primitive(i, leaf_t, closest)) {
+                    hit_anything = true;
+                    leaf_t.max = closest.t;
+                }
+            }
+            return hit_anything;
+        }, root);
+    }
+
+    template <typename leaf_function>
+    bool hit_leaves(const ray& r, interval ray_t, hit_record& rec, const leaf_function& hit_leaf, int root = 0) const {
+        // hit_leaf(node, ray_t, rec) tests the ray against all primitives of a leaf and
+        // must only write rec when it reports a hit, which has to be the closest in the leaf.
+        // root limits the search to the subtree below that node.
+        if (nodes.empty())
+            return false;
+
+        auto origin = r.origin();
+        auto direction = r.direction();
+        vec3 inv_direction(1/direction[0], 1/direction[1], 1/direction[2]);
+        bool direction_negative[3] = { direction[0] < 0, direction[1] < 0, direction[2] < 0 };
+
+        bool hit_anything = false;
+        auto closest_so_far = ray_t.max;
+
+        int stack[max_depth];
+        int stack_size = 0;
+        int current = root;
+        while (true) {
+            const bvh_node& node = nodes[current];
+            if (node.bbox.hit(origin, inv_direction, interval(ray_t.min, closest_so_far))) {
+                if (node.count > 0) {
+                    if (hit_leaf(node, interval(ray_t.min, closest_so_far), rec)) {
+                        hit_anything = true;
+                        closest_so_far = rec.t;
+                    }
+                }
+                else {
+                    // Visit the child on the near side of the split first so the far
+                    // child is more likely to be culled by closest_so_far
+                    if (direction_negative[node.axis]) {
+                        stack[stack_size++] = current + 1;
+                        current = node.offset;
+                    }
+                    else {
+                        stack[stack_size++] = node.offset;
+                        current = current + 1;
+                    }
+                    continue;
+                }
+            }
+            if (stack_size == 0)
+                break;
+            current = stack[--stack_size];
+        }
+
+        return hit_anything;
+    }
+
+    template <typename leaf_function, typename single_function>
+    void hit_packet(ray_packet& packet, real t_min, uint64_t rays, int min_rays, const leaf_function& hit_leaf,
+                    const single_function& hit_single) const {
+        // Packet version of hit_leaves for the rays in the mask rays (see ray_packet.h).
+        // Each node is first tested against the packet's frustum, which rejects boxes no
+        // ray reaches in one test, and then against every ray still active. The rays that
+        // pass go on together: hit_leaf(node, rays) tests them against the primitives of a
+        // leaf. Once fewer than min_rays rays reach a node, or if the packet has no
+        // frustum at all, the packet has diverged and hit_single(k, node_index) traces the
+        // remaining rays one at a time through the subtree.
+        if (nodes.empty() || rays == 0)
+            return;
+        if (!packet.coherent()) {
+            for_each_ray(rays, [&](int k) { hit_single(k, 0); });
+            return;
+        }
+
+        int node_stack[max_depth];
+        uint64_t ray_stack[max_depth];
+        int stack_size = 0;
+        int current = 0;
+        while (true) {
+            const bvh_node& node = nodes[current];
+            uint64_t node_rays = 0;
+            if (packet.frustum_may_hit(node.bbox, t_min))
+                node_rays = packet_box_hits(packet, node.bbox, t_min, rays);
+            if (node_rays != 0) {
+                if (__builtin_popcountll(node_rays) < min_rays) {
+                    for_each_ray(node_rays, [&](int k) { hit_single(k, current); });
+                }
+                else if (node.count > 0) {
+                    hit_leaf(node, node_rays);
+                }
+                else {
+                    // Near child first, by the direction of the packet's first ray
+                    node_stack[stack_size] = packet.direction_negative[node.axis] ? current + 1 : node.offset;
+                    ray_stack[stack_size++] = node_rays;
+                    current = packet.direction_negative[node.axis] ? node.offset : current + 1;
+                    rays = node_rays;
+                    continue;
+                }
+            }
+            if (stack_size == 0)
+                break;
+            --stack_size;
+            current = node_stack[stack_size];
+            rays = ray_stack[stack_size];
+        }
+    }
+
+    template <typename ray_function>
+    static void for_each_ray(uint64_t rays, const ray_function& body) {
+        // Calls body(k) for every bit k set in rays, in increasing order
+        while (rays != 0) {
+            body(__builtin_ctzll(rays));
+            rays &= rays - 1;
+        }
+    }
+
+    aabb bounding_box() const {
+        return nodes.empty() ? aabb() : nodes[0].bbox;
+    }
+
+    static double traversal_cost() {
+        // Cost of visiting a node, relative to intersecting one primitive (or group)
+        return 0.125;
+    }
+
+    bvh_metrics metrics() const {
+        // The SAH cost sums the cost of every node weighted by the probability that a ray
+        // through the root box passes through the node's box, the ratio of their areas
+        bvh_metrics m;
+        m.node_count = static_cast<int>(nodes.size());
+        if (nodes.empty())
+            return m;
+        double inv_root_area = 1 / nodes[0].bbox.surface_area();
+        long long depth_sum = 0;
+
+        int stack[max_depth + 1][2]; // node, depth
+        int stack_size = 0;
+        stack[stack_size][0] = 0;
+        stack[stack_size++][1] = 1;
+        while (stack_size > 0) {
+            --stack_size;
+            int current = stack[stack_size][0], depth = stack[stack_size][1];
+            const bvh_node& node = nodes[current];
+            double probability = node.bbox.surface_area() * inv_root_area;
+            if (node.count > 0) {
+                m.sah_cost += probability * leaf_cost(node.count);
+                ++m.leaf_count;
+                depth_sum += depth;
+                m.max_depth = std::max(m.max_depth, depth);
+                if (node.count >= static_cast<int>(m.leaf_sizes.size()))
+                    m.leaf_sizes.resize(node.count + 1, 0);
+                ++m.leaf_sizes[node.count];
+                continue;
+            }
+            m.sah_cost += probability * traversal_cost();
+            stack[stack_size][0] = current + 1;
+            stack[stack_size++][1] = depth + 1;
+            stack[stack_size][0] = node.offset;
+            stack[stack_size++][1] = depth + 1;
+        }
+        m.average_leaf_depth = static_cast<double>(depth_sum) / m.leaf_count;
+        return m;
+    }
+
+    private:
+    static const int parallel_chunk = 16384; // primitives per job when a range is split among threads
+
+    struct build_item {
+        aabb bbox;
+        point3 centroid;
+        int index;        // position in the source list
+        uint32_t morton;  // Morton code of the centroid, only used by the LBVH builder
+    };
+
+    struct subtree_task {
+        int begin, end, depth;
+        std::vector<bvh_node> nodes; // offsets of interior nodes are relative to the subtree
+    };
+
+    struct build_context {
+        thread_pool* pool;  // when set, large ranges are bounded and binned on the pool
+        int task_size;      // with a pool: ranges up to this size are left to subtree tasks
+        std::vector<subtree_task> tasks;
+    };
+
+    struct split_bins {
+        aabb bounds[3][bin_count];
+        int counts[3][bin_count];
+    };
+
+    template <typename chunk_function>
+    static void for_each_chunk(thread_pool* pool, int begin, int end, const chunk_function& body) {
+        // Calls body(chunk_begin, chunk_end, chunk) for consecutive chunks covering [begin, end),
+        // on the pool if there is one and the range is large enough to be worth it
+        int chunks = chunk_count(pool, end - begin);
+        if (chunks == 1) {
+            body(begin, end, 0);
+            return;
+        }
+        pool->parallel_for(chunks, [&](int k, int) {
+            body(begin + static_cast<int>(static_cast<long long>(end - begin) * k / chunks),
+                 begin + static_cast<int>(static_cast<long long>(end - begin) * (k + 1) / chunks), k);
+        });
+    }
+
+    static int chunk_count(thread_pool* pool, int count) {
+        return pool && count >= 2 * parallel_chunk ? count / parallel_chunk : 1;
+    }
+
+    int build(std::vector<build_item>& items, int begin, int end, int depth, std::vector<bvh_node>& out,
+              build_context& context) {
+        // Builds the subtree over items[begin, end) into out and returns the index of its
+        // root. Ranges handed to a subtree task get a placeholder node with count -1 whose
+        // offset is the task's index.
+        int count = end - begin;
+        int node_index = static_cast<int>(out.size());
+        out.push_back(bvh_node());
+        if (context.pool && count <= context.task_size) {
+            out[node_index].offset = static_cast<int>(context.tasks.size());
+            out[node_index].count = -1;
+            subtree_task task = { begin, end, depth, std::vector<bvh_node>() };
+            context.tasks.push_back(std::move(task));
+            return node_index;
+        }
+
+        // The LBVH split doesn't need the node's box, so away from the pool the box is
+        // computed bottom up from the children, which saves a pass over the range per level
+        bool bounds_from_children = method == bvh_build_method::lbvh && !context.pool;
+        aabb bbox, centroid_bounds;
+        if (!bounds_from_children || count <= max_leaf_size || depth >= max_depth)
+            range_bounds(items, begin, end, context.pool, bbox, centroid_bounds);
+        out[node_index].bbox = bbox;
+
+        int split_axis = -1;
+        int mid = begin;
+        if (count > 1 && depth < max_depth) {
+            if (method == bvh_build_method::sah) {
+                int split_bin;
+                if (find_split(items, begin, end, bbox, centroid_bounds, context.pool, split_axis, split_bin)) {
+                    const interval& extent = centroid_bounds.axis(split_axis);
+                    auto first_right = std::partition(items.begin() + begin, items.begin() + end,
+                        [&](const build_item& item) {
+                            return bin_of(item.centroid[split_axis], extent) <= split_bin;
+                        });
+                    mid = static_cast<int>(first_right - items.begin());
+                }
+            }
+            else if (count > max_leaf_size) {
+                morton_split(items, begin, end, split_axis, mid);
+            }
+        }
+
+        if (split_axis < 0 && (count <= max_leaf_size || depth >= max_depth)) {
+            make_leaf(out[node_index], begin, count);
+            return node_index;
+        }
+
+        if (split_axis < 0) {
+            // Too many primitives for a leaf but no split SAH could use (e.g. all centroids
+            // coincide), so halve the range along the longest axis instead
+            if (bounds_from_children)
+                range_bounds(items, begin, end, nullptr, bbox, centroid_bounds);
+            split_axis = centroid_bounds.longest_axis();
+            mid = begin + count/2;
+            std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+                [&](const build_item& a, const build_item& b) {
+                    return a.centroid[split_axis] < b.centroid[split_axis];
+                });
+        }
+
+        int left = build(items, begin, mid, depth + 1, out, context);
+        int right = build(items, mid, end, depth + 1, out, context);
+        out[node_index].offset = right;
+        out[node_index].count = 0;
+        out[node_index].axis = split_axis;
+        if (bounds_from_children)
+            out[node_index].bbox = aabb(out[left].bbox, out[right].bbox);
+        return node_index;
+    }
+
+    void splice(const std::vector<bvh_node>& upper, int index, std::vector<subtree_task>& tasks) {
+        // Appends the subtree rooted at upper[index] to nodes in depth first order, with
+        // the placeholders replaced by the subtrees their tasks built
+        const bvh_node& node = upper[index];
+        if (node.count < 0) {
+            std::vector<bvh_node>& subtree = tasks[node.offset].nodes;
+            int base = static_cast<int>(nodes.size());
+            for (bvh_node n : subtree) {
+                if (n.count == 0)
+                    n.offset += base;
+                nodes.push_back(n);
+            }
+            std::vector<bvh_node>().swap(subtree);
+            return;
+        }
+        int node_index = static_cast<int>(nodes.size());
+        nodes.push_back(node);
+        if (node.count > 0)
+            return;
+        splice(upper, index + 1, tasks);
+        nodes[node_index].offset = static_cast<int>(nodes.size());
+        splice(upper, node.offset, tasks);
+    }
+
+    static void make_leaf(bvh_node& node, int begin, int count) {
+        node.offset = begin;
+        node.count = count;
+        node.axis = 0;
+    }
+
+    int leaf_cost(int count) const {
+        return (count + leaf_group - 1) / leaf_group;
+    }
+
+    static int bin_of(real centroid, const interval& extent) {
+        int bin = static_cast<int>(bin_count * (centroid - extent.min) / extent.size());
+        return bin < bin_count ? bin : bin_count - 1;
+    }
+
+    static void range_bounds(const std::vector<build_item>& items, int begin, int end, thread_pool* pool,
+                             aabb& bbox, aabb& centroid_bounds) {
+        // Box of the primitives in items[begin, end) and box of their centroids
+        std::vector<aabb> chunk_bounds(2 * chunk_count(pool, end - begin));
+        for_each_chunk(pool, begin, end, [&](int chunk_begin, int chunk_end, int k) {
+            aabb b, c;
+            for (int i = chunk_begin; i < chunk_end; ++i) {
+                b = aabb(b, items[i].bbox);
+                c = aabb(c, aabb(items[i].centroid, items[i].centroid));
+            }
+            chunk_bounds[2*k] = b;
+            chunk_bounds[2*k + 1] = c;
+        });
+        bbox = centroid_bounds = aabb();
+        for (size_t k = 0; k < chunk_bounds.size(); k += 2) {
+            bbox = aabb(bbox, chunk_bounds[k]);
+            centroid_bounds = aabb(centroid_bounds, chunk_bounds[k + 1]);
+        }
+    }
+
+    bool find_split(const std::vector<build_item>& items, int begin, int end, const aabb& bbox,
+                    const aabb& centroid_bounds, thread_pool* pool, int& best_axis, int& best_bin) const {
+        // Bins the centroids along each axis and evaluates the SAH cost of splitting
+        // after every bin. Costs are relative to intersecting a single primitive (or group,
+        // see leaf_group); leaves up to max_leaf_size primitives are kept when no split is
+        // cheaper. Returns false if no split was chosen.
+        bool binned[3];
+        for (int axis = 0; axis < 3; ++axis)
+            binned[axis] = centroid_bounds.axis(axis).size() > 0;
+
+        // Each chunk fills its own bins, which are merged in chunk order, so the result
+        // doesn't depend on the number of threads
+        std::vector<split_bins> chunk_bins(chunk_count(pool, end - begin));
+        for_each_chunk(pool, begin, end, [&](int chunk_begin, int chunk_end, int k) {
+            split_bins& bins = chunk_bins[k];
+            for (int axis = 0; axis < 3; ++axis) {
+                if (!binned[axis])
+                    continue;
+                const interval& extent = centroid_bounds.axis(axis);
+                for (int b = 0; b < bin_count; ++b) {
+                    bins.bounds[axis][b] = aabb();
+                    bins.counts[axis][b] = 0;
+                }
+                for (int i = chunk_begin; i < chunk_end; ++i) {
+                    int b = bin_of(items[i].centroid[axis], extent);
+                    ++bins.counts[axis][b];
+                    bins.bounds[axis][b] = aabb(bins.bounds[axis][b], items[i].bbox);
+                }
+            }
+        });
+
+        double best_cost = (end - begin <= max_leaf_size) ? leaf_cost(end - begin) : infinity;
+        double inv_area = 1 / bbox.surface_area();
+        best_axis = -1;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            if (!binned[axis])
+                continue;
+
+            aabb bin_bounds[bin_count];
+            int bin_counts[bin_count] = {0};
+            for (const split_bins& bins : chunk_bins) {
+                for (int b = 0; b < bin_count; ++b) {
+                    bin_bounds[b] = aabb(bin_bounds[b], bins.bounds[axis][b]);
+                    bin_counts[b] += bins.counts[axis][b];
+                }
+            }
+
+            // Sweep from the right to get the area and count on the right of each split
+            double right_area[bin_count];
+            int right_count[bin_count];
+            aabb accumulated;
+            int accumulated_count = 0;
+            for (int b = bin_count - 1; b > 0; --b) {
+                accumulated = aabb(accumulated, bin_bounds[b]);
+                accumulated_count += bin_counts[b];
+                right_area[b] = accumulated.surface_area();
+                right_count[b] = accumulated_count;
+            }
+
+            accumulated = aabb();
+            accumulated_count = 0;
+            for (int b = 0; b < bin_count - 1; ++b) {
+                accumulated = aabb(accumulated, bin_bounds[b]);
+                accumulated_count += bin_counts[b];
+                if (accumulated_count == 0 || right_count[b + 1] == 0)
+                    continue;
+                double cost = traversal_cost() + inv_area * (accumulated.surface_area() * leaf_cost(accumulated_count)
+                                                             + right_area[b + 1] * leaf_cost(right_count[b + 1]));
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = b;
+                }
+            }
+        }
+        return best_axis >= 0;
+    }
+
+    static void sort_by_morton_code(std::vector<build_item>& items, thread_pool* pool) {
+        // Gives every item the 30 bit Morton code of its centroid within the centroids' box
+        // and sorts the items by it (see morton.h). Items with equal codes keep their order.
+        int count = static_cast<int>(items.size());
+        aabb bbox, centroid_bounds;
+        range_bounds(items, 0, count, pool, bbox, centroid_bounds);
+
+        std::vector<uint64_t> keys(count), sorted_keys(count);
+        for_each_chunk(pool, 0, count, [&](int begin, int end, int) {
+            for (int i = begin; i < end; ++i) {
+                uint32_t code = morton_code(items[i].centroid, centroid_bounds, 10);
+                keys[i] = (static_cast<uint64_t>(code) << 32) | static_cast<uint32_t>(i);
+            }
+        });
+        sort_morton_keys(keys, sorted_keys, pool, chunk_count(pool, count));
+
+        std::vector<build_item> sorted(count);
+        for_each_chunk(pool, 0, count, [&](int begin, int end, int) {
+            for (int i = begin; i < end; ++i) {
+                sorted[i] = items[static_cast<uint32_t>(keys[i])];
+                sorted[i].morton = static_cast<uint32_t>(keys[i] >> 32);
+            }
+        });
+        items.swap(sorted);
+    }
+
+    static void morton_split(const std::vector<build_item>& items, int begin, int end, int& axis, int& mid) {
+        // Splits a range of Morton sorted items where the highest bit in which their codes
+        // differ changes from 0 to 1. Leaves axis at -1 if all codes are equal.
+        uint32_t first = items[begin].morton, last = items[end - 1].morton;
+        if (first == last)
+            return;
+        int bit = 31;
+        while (!(((first ^ last) >> bit) & 1u))
+            --bit;
+        uint32_t mask = 1u << bit;
+        auto first_set = std::partition_point(items.begin() + begin, items.begin() + end,
+            [mask](const build_item& item) { return (item.morton & mask) == 0; });
+        mid = static_cast<int>(first_set - items.begin());
+        axis = 2 - bit % 3;
+    }
+};
+
+
+class bvh : public scene_object {
+    // BVH over a list of scene objects, see bvh_tree.
+    // A bvh is itself a scene_object, so it can be passed to camera::render as the world.
+    public:
+    bvh(const scene_objects_list& list, bvh_build_method method = bvh_build_method::sah, int thread_count = 0)
+        : bvh(list.objects, method, thread_count) {}
+
+    bvh(const std::vector<shared_ptr<scene_object>>& src_objects,
+        bvh_build_method method = bvh_build_method::sah, int thread_count = 0) : objects(src_objects) {
+        tree.method = method;
+        tree.thread_count = thread_count;
+        rebuild();
+    }
+
+    // Used as the top level over instances (see instance.h), only this tree has to change
+    // when instances move: each instance's geometry keeps its own acceleration structure.
+    // update() refits the tree to the objects' new boxes, which keeps its shape, so boxes
+    // grow and overlap as objects drift apart. Once the SAH cost has grown past
+    // rebuild_ratio times its value after the last build, update() rebuilds instead.
+    double rebuild_ratio = 1.2;
+
+    bool update() {
+        // Call after objects have moved. Returns true if the tree was rebuilt.
+        std::vector<aabb> boxes(objects.size());
+        for (size_t i = 0; i < objects.size(); ++i)
+            boxes[i] = objects[i]->bounding_box();
+        tree.refit(boxes);
+        if (tree.metrics().sah_cost <= rebuild_ratio * built_sah_cost)
+            return false;
+        rebuild();
+        return true;
+    }
+
+    void rebuild() {
+        std::vector<aabb> boxes(objects.size());
+        for (size_t i = 0; i < objects.size(); ++i)
+            boxes[i] = objects[i]->bounding_box();
+
+        // Reorder the objects so every leaf refers to a contiguous range
+        auto order = tree.build(boxes);
+        std::vector<shared_ptr<scene_object>> reordered;
+        reordered.reserve(order.size());
+        for (int index : order)
+            reordered.push_back(objects[index]);
+        objects.swap(reordered);
+        built_sah_cost = tree.metrics().sah_cost;
+    }
+
+    // Packet traversal (hit_packet) hands the rays that are left over to single ray
+    // traversal once fewer than this many of them reach a node
+    int packet_min_rays = 4;
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return hit_subtree(r, ray_t, rec, 0);
+    }
+
+    void hit_packet(ray_packet& packet, real t_min, uint64_t rays, hit_record* records) const override {
+        tree.hit_packet(packet, t_min, rays, packet_min_rays,
+            [&](const bvh_node& leaf, uint64_t leaf_rays) {
+                for (int i = leaf.offset; i < leaf.offset + leaf.count; ++i)
+                    objects[i]->hit_packet(packet, t_min, leaf_rays, records);
+            },
+            [&](int k, int root) {
+                if (hit_subtree(packet.rays[k], interval(t_min, packet.t_max[k]), records[k], root)) {
+                    packet.t_max[k] = records[k].t;
+                    packet.hits |= uint64_t(1) << k;
+                }
+            });
+    }
+
+    aabb bounding_box() const override { return tree.bounding_box(); }
+
+    int node_count() const { return static_cast<int>(tree.nodes.size()); }
+    bvh_metrics metrics() const { return tree.metrics(); }
+    double build_seconds() const { return tree.build_seconds; }
+    double refit_seconds() const { return tree.refit_seconds; }
+
+    private:
+    bvh_tree tree;
+    std::vector<shared_ptr<scene_object>> objects;
+
+    bool hit_subtree(const ray& r, interval ray_t, hit_record& rec, int root) const {
+        hit_record temp_rec;
+        return tree.hit(r, ray_t, rec, [&](int i, interval object_t, hit_record& closest) {
+            // Objects may write to the record even when they miss
+            if (!objects[i]->hit(r, object_t, temp_rec))
+                return false;
+            closest = temp_rec;
+            return true;
+        }, root);
+    }
+    double built_sah_cost = 0;
+};
+
+#endif
@@ -3,20 +3,23 @@
 
 #include "common.h"
 
+#include "checkpoint.h"
 #include "color.h"
+#include "framebuffer.h"
+#include "image_io.h"
 #include "scene_objects.h"
-#include "material.h"
-
-#ifdef __clang__
-#define STBIWDEF static inline
-#endif
-#define STB_IMAGE_WRITE_STATIC
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+#include "material_table.h"
+#include "output_pipeline.h"
+#include "thread_pool.h"
+#include "wavefront.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
 //#include <cstdint>
 
 class camera {
@@ -33,37 +36,164 @@ class camera {
     double defocus_angle = 0;               // angle of the cone with apex at viewport center and
                                             // base at the camera center (known as the defocus disk)
     double focus_dist = 10;                 // distance from look_from to the plane of perfect focus    
+    int  thread_count = 0;                  // number of render threads, 0 uses every hardware thread
+    int     tile_size = 16;                 // width and height in pixels of the tiles handed out to threads
+    unsigned long seed = 0;                 // render seed, the same seed always gives the same image
+    sampler_type sampler = sampler_type::independent; // sequence used for pixel jitter, lens and bounce samples
+
+    // Adaptive sampling: a pixel stops taking samples once the standard error of its mean
+    // luminance, measured after gamma encoding, falls below adaptive_threshold (in [0, 1]
+    // display units, 0.004 is about one 8-bit level). sample_size is the most samples any
+    // pixel gets and min_samples the fewest.
+    bool adaptive_sampling = false;
+    int        min_samples = 16;
+    double adaptive_threshold = 0.004;
+    bool write_sample_heatmap = false;      // also save <filename>_spp with the samples used per pixel
+
+    // Russian roulette: from bounce rr_min_depth on, a path survives each bounce with a
+    // probability equal to its largest throughput channel and is reweighted by the inverse
+    // of that probability, so dim paths end early without biasing the image
+    bool russian_roulette = false;
+    int      rr_min_depth = 3;
+
+    // Wavefront integrator: each tile's samples are traced in batches of up to
+    // wavefront_batch paths that advance one bounce at a time, with the scattering done
+    // per material over all paths that hit it (see wavefront.h). Gives the same image.
+    bool wavefront = false;
+    int  wavefront_batch = 65536;
+    // With the wavefront integrator, sort the rays of every bounce after the first by
+    // origin cell and direction octant before intersecting them (see wavefront.h). Worth
+    // it for scenes whose geometry doesn't fit in cache. Gives the same image.
+    bool reorder_rays = false;
+
+    // Packet tracing: the camera rays of each 8x8 block of pixels are traced together as
+    // one packet (see ray_packet.h). It pays off for previews with few bounces of scenes
+    // with many objects, where camera rays are a large share of all rays; with only a
+    // handful of objects the packet bookkeeping costs more than it saves. The rest of
+    // each path is traced as usual. Gives the same image; the wavefront integrator does
+    // not use packets.
+    bool packets = false;
+    
+    // Progressive rendering: samples are added in passes of samples_per_pass per pixel until
+    // every pixel has sample_size (or has converged). Every checkpoint_every passes the
+    // accumulation buffer is saved to <filename>.ckpt along with preview images.
+    // With resume set, a matching checkpoint is loaded first and the render carries on from
+    // it; raising sample_size adds samples to the pixels it holds. A checkpoint only matches
+    // the same resolution, seed, sampler and adaptive setting, and a sample_size at least
+    // as large (giving the same grid of strata with the stratified sampler). If the
+    // checkpoint exists but doesn't match, render() leaves it alone and fails.
+    bool   progressive = false;
+    int    samples_per_pass = 8;
+    int    checkpoint_every = 4;
+    bool   resume = false;
+
+    // Output files, all saved as <output_dir><filename>.<extension>
+    std::string output_dir = "images/";
+    ppm_format ppm = ppm_format::binary;    // .ppm as binary P6, or text P3 for debugging
+    bool write_jpg = true;                  // .jpg
+    bool write_pfm = false;                 // .pfm with the linear float radiance (HDR)
+    // When set, finished images are handed to this pipeline and encoded on its threads, so
+    // render() returns as soon as the pixels are done and the next frame can start.
+    // Call output->wait_idle() or output->finish() before relying on the files.
+    output_pipeline* output = nullptr;
+    // Progress lines, render statistics and the camera basis on std::clog. Benchmarks that
+    // print their own results turn this off; errors are reported either way.
+    bool verbose = true;
     
-    void render(const scene_object& world, const std::string& filename) {
+    struct path_stats {
+        long long paths = 0;
+        long long segments = 0;       // rays traced, i.e. calls to world.hit
+        long long roulette_kills = 0; // paths ended by Russian roulette
+        double reorder_seconds = 0;   // thread time spent sorting rays, see reorder_rays
+    };
+
+    // Totals of the last call to render(), for benchmarks and reports
+    path_stats last_stats;
+    double last_render_seconds = 0;       // wall time spent tracing, excluding image output
+
+    bool render(const scene_object& world, const material_table& materials, const std::string& filename) {
+        // Returns false without rendering anything if resume is set and the checkpoint
+        // can't be continued
         initialize();
-        std::ofstream img_file;
-        img_file.open(("images/" + filename + ".ppm").c_str());
-        img_file << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-        uint8_t* img_rgb = new uint8_t[image_width*image_height*3];
-
-        int count = 0;
-        for (int j = 0; j < image_height; ++j) {
-            std::clog << "\rCurrent Scanline: " << j << '/' << image_height - 1 << std::flush;
-            for (int i = 0; i < image_width; ++i) {
-                color pixel_color(0, 0, 0);
-                for (int sample = 0; sample < sample_size; ++sample) {
-                    ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, world);
-                }
-                uint8_t rgb[3]; 
-                write_color(img_file, pixel_color, sample_size, rgb);
+        auto start_time = std::chrono::steady_clock::now();
 
-                img_rgb[count++] = rgb[0];
-                img_rgb[count++] = rgb[1];
-                img_rgb[count++] = rgb[2];
+        framebuffer fb(image_width, image_height);
+        std::string checkpoint_path = output_dir + filename + ".ckpt";
+        if (resume) {
+            checkpoint_load loaded = load_checkpoint(checkpoint_path, fb, sampler, seed, sample_size,
+                                                     adaptive_sampling);
+            if (loaded == checkpoint_load::mismatch) {
+                // Rendering anyway would overwrite the checkpoint and lose its samples
+                std::clog << "Checkpoint " << checkpoint_path << " is damaged or doesn't match the render "
+                          << "settings (resolution, seed, sampler, adaptive sampling, sample_size); "
+                          << "not rendering so it is kept" << std::endl;
+                return false;
+            }
+            if (verbose && loaded == checkpoint_load::loaded)
+                std::clog << "Resuming from " << checkpoint_path << " with "
+                          << static_cast<double>(fb.total_samples()) / fb.size() << " samples per pixel" << std::endl;
+            else if (verbose)
+                std::clog << "No checkpoint at " << checkpoint_path << ", starting from scratch" << std::endl;
+        }
 
+        thread_pool pool(thread_count);
+        std::vector<path_stats> worker_stats(pool.size()); // one per worker so no atomics are needed
+        if (verbose)
+            std::clog << "Rendering on " << pool.size() << " thread(s)" << std::endl;
+
+        int pass_samples = progressive ? std::max(samples_per_pass, 1) : sample_size;
+        int pass = 0;
+        while (needs_samples(fb)) {
+            render_pass(world, materials, fb, pass_samples, pool, worker_stats);
+            ++pass;
+            if (progressive) {
+                if (verbose)
+                    std::clog << "\rPass " << pass << ": "
+                              << static_cast<double>(fb.total_samples()) / fb.size() << " samples per pixel" << std::flush;
+                if (checkpoint_every > 0 && pass % checkpoint_every == 0 && needs_samples(fb)) {
+                    if (!save_checkpoint(checkpoint_path, fb, sampler, seed, sample_size, adaptive_sampling))
+                        std::clog << "\nCould not write checkpoint " << checkpoint_path << std::endl;
+                    save_images(fb, filename, pool);
+                }
             }
         }
+        if (progressive && !save_checkpoint(checkpoint_path, fb, sampler, seed, sample_size, adaptive_sampling))
+            std::clog << "\nCould not write checkpoint " << checkpoint_path << std::endl;
 
-        stbi_write_jpg(("images/" + filename + ".jpg").c_str(), image_width, image_height, 3, img_rgb, 100);
-        delete[] img_rgb;
-        img_file.close();
-        std::clog << "\rDone.                    \n";
+        last_render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        if (verbose)
+            std::clog << "\rDone.                                        \n";
+
+        path_stats totals;
+        for (const auto& stats : worker_stats) {
+            totals.paths += stats.paths;
+            totals.segments += stats.segments;
+            totals.roulette_kills += stats.roulette_kills;
+            totals.reorder_seconds += stats.reorder_seconds;
+        }
+        last_stats = totals;
+
+        if (verbose) {
+            if (totals.paths > 0) {
+                std::clog << "Average path length: " << static_cast<double>(totals.segments) / totals.paths << " rays";
+                if (russian_roulette)
+                    std::clog << " (" << 100.0 * totals.roulette_kills / totals.paths
+                              << "% of paths ended by Russian roulette)";
+                std::clog << '\n';
+            }
+            if (wavefront && reorder_rays)
+                std::clog << "Ray reordering: " << totals.reorder_seconds << " s of thread time\n";
+            if (adaptive_sampling)
+                std::clog << "Adaptive sampling: " << static_cast<double>(fb.total_samples()) / fb.size()
+                          << " samples per pixel on average (min " << min_samples << ", max " << sample_size << ")\n";
+        }
+        if (write_sample_heatmap)
+            save_sample_heatmap(fb, filename + "_spp");
+        if (output)
+            submit_images(std::make_shared<framebuffer>(std::move(fb)), filename); // no copy of the final frame
+        else
+            save_images(fb, filename, pool);
+        return true;
     }
 
     private:
@@ -104,9 +234,11 @@ class camera {
         u = unit_vector(cross(v_up, w));      // vector pointing to the camera's right
         v = cross(w, u);                      // vector pointing to the camera's up
 
-        std::cout << "w: " << w << std::endl;
-        std::cout << "u: " << u << std::endl;
-        std::cout << "v: " << v << std::endl;
+        if (verbose) {
+            std::clog << "w: " << w << std::endl;
+            std::clog << "u: " << u << std::endl;
+            std::clog << "v: " << v << std::endl;
+        }
 
         // Calculate the vectors across the horizontal and down the vertical viewport edges
         auto viewport_u = viewport_width * u;   // vector along the viewport's horizontal edge 
@@ -126,6 +258,272 @@ class camera {
         defocus_disk_v = v * defocus_radius;
     }
 
+    bool needs_samples(const pixel_accumulator& pixel) const {
+        return !pixel.converged && pixel.count < sample_size;
+    }
+
+    bool needs_samples(const framebuffer& fb) const {
+        for (const auto& pixel : fb.pixels) {
+            if (needs_samples(pixel))
+                return true;
+        }
+        return false;
+    }
+
+    void render_pass(const scene_object& world, const material_table& materials, framebuffer& fb,
+                     int pass_samples, thread_pool& pool, std::vector<path_stats>& worker_stats) const {
+        // Adds up to pass_samples samples to every pixel that still needs some.
+        // The image is cut into tile_size x tile_size tiles which are scheduled on a
+        // work-stealing pool. Tiles never overlap, so each worker writes its pixels
+        // straight into the shared framebuffer without any locking.
+        int tiles_x = (image_width + tile_size - 1) / tile_size;
+        int tiles_y = (image_height + tile_size - 1) / tile_size;
+        int tile_count = tiles_x * tiles_y;
+        std::atomic<int> tiles_done(0);
+        std::vector<wavefront_tracer> tracers(wavefront ? pool.size() : 0);
+        std::vector<std::vector<wavefront_path>> batches(tracers.size());
+
+        pool.parallel_for(tile_count, [&](int tile, int worker) {
+            int x0 = (tile % tiles_x) * tile_size;
+            int y0 = (tile / tiles_x) * tile_size;
+            int x1 = std::min(x0 + tile_size, image_width);
+            int y1 = std::min(y0 + tile_size, image_height);
+
+            if (wavefront) {
+                render_tile_wavefront(x0, y0, x1, y1, world, materials, fb, pass_samples, tracers[worker],
+                                      batches[worker], worker_stats[worker]);
+            }
+            else if (packets && max_depth > 0) {
+                render_tile_packets(x0, y0, x1, y1, world, materials, fb, pass_samples, worker_stats[worker]);
+            }
+            else {
+                for (int j = y0; j < y1; ++j) {
+                    for (int i = x0; i < x1; ++i) {
+                        pixel_accumulator& pixel = fb.at(i, j);
+                        if (needs_samples(pixel))
+                            render_pixel(i, j, world, materials, pixel,
+                                         std::min(pixel.count + pass_samples, sample_size), worker_stats[worker]);
+                    }
+                }
+            }
+
+            int done = ++tiles_done;
+            if (verbose && worker == 0 && !progressive) // only one thread reports so the progress lines don't interleave
+                std::clog << "\rTiles done: " << done << '/' << tile_count << std::flush;
+        });
+
+        for (size_t w = 0; w < tracers.size(); ++w) {
+            worker_stats[w].segments += tracers[w].segments;
+            worker_stats[w].roulette_kills += tracers[w].roulette_kills;
+            worker_stats[w].reorder_seconds += tracers[w].reorder_seconds;
+        }
+    }
+
+    void render_tile_wavefront(int x0, int y0, int x1, int y1, const scene_object& world,
+                               const material_table& materials, framebuffer& fb, int pass_samples,
+                               wavefront_tracer& tracer, std::vector<wavefront_path>& paths, path_stats& stats) const {
+        // The wavefront version of calling render_pixel on every pixel of the tile. Each
+        // round generates camera rays for the pixels that need samples, traces them all
+        // together and adds the results in sample order. With adaptive sampling a round ends
+        // each pixel's samples at the next convergence check, just as render_pixel checks.
+        int tile_width = x1 - x0;
+        std::vector<int> targets((y1 - y0) * tile_width);
+        for (int j = y0; j < y1; ++j)
+            for (int i = x0; i < x1; ++i)
+                targets[(j - y0) * tile_width + i - x0] = std::min(fb.at(i, j).count + pass_samples, sample_size);
+
+        wavefront_settings settings = { max_depth, russian_roulette, rr_min_depth, sampler, seed, image_width,
+                                        sample_size, reorder_rays };
+        int batch = std::max(wavefront_batch, 1);
+        while (true) {
+            paths.clear();
+            for (int j = y0; j < y1 && static_cast<int>(paths.size()) < batch; ++j) {
+                for (int i = x0; i < x1 && static_cast<int>(paths.size()) < batch; ++i) {
+                    const pixel_accumulator& pixel = fb.at(i, j);
+                    int target = targets[(j - y0) * tile_width + i - x0];
+                    if (pixel.converged || pixel.count >= target)
+                        continue;
+                    int samples = target - pixel.count;
+                    if (adaptive_sampling)
+                        samples = std::min(samples, check_interval - pixel.count % check_interval);
+                    samples = std::min(samples, batch - static_cast<int>(paths.size()));
+                    for (int s = 0; s < samples; ++s) {
+                        wavefront_path path;
+                        begin_camera_sample(sampler, seed, i, j, image_width, pixel.count + s, sample_size);
+                        path.r = get_ray(i, j);
+                        path.throughput = color(1.0, 1.0, 1.0);
+                        path.pixel_x = i;
+                        path.pixel_y = j;
+                        path.sample = pixel.count + s;
+                        paths.push_back(path);
+                    }
+                }
+            }
+            if (paths.empty())
+                break;
+
+            stats.paths += static_cast<long long>(paths.size());
+            tracer.trace(paths, world, materials, settings);
+            for (const auto& path : paths)
+                add_sample(fb.at(path.pixel_x, path.pixel_y), path.radiance);
+        }
+    }
+
+    void render_tile_packets(int x0, int y0, int x1, int y1, const scene_object& world,
+                             const material_table& materials, framebuffer& fb, int pass_samples,
+                             path_stats& stats) const {
+        // The packet version of calling render_pixel on every pixel of the tile. Each round
+        // gives every pixel that needs one its next sample: the camera rays of an 8x8 block
+        // go through world.hit_packet together, then each path carries on from its camera
+        // ray's hit in ray_color. Samples are still added to a pixel in order, so adaptive
+        // sampling stops at the same sample as render_pixel.
+        const int block = 8;
+        ray_packet packet;
+        hit_record records[ray_packet::max_size];
+        int pixel_x[ray_packet::max_size], pixel_y[ray_packet::max_size];
+
+        int tile_width = x1 - x0;
+        std::vector<int> targets((y1 - y0) * tile_width);
+        for (int j = y0; j < y1; ++j)
+            for (int i = x0; i < x1; ++i)
+                targets[(j - y0) * tile_width + i - x0] = std::min(fb.at(i, j).count + pass_samples, sample_size);
+
+        bool sampled = true;
+        while (sampled) {
+            sampled = false;
+            for (int by = y0; by < y1; by += block) {
+                for (int bx = x0; bx < x1; bx += block) {
+                    packet.clear();
+                    for (int j = by; j < std::min(by + block, y1); ++j) {
+                        for (int i = bx; i < std::min(bx + block, x1); ++i) {
+                            const pixel_accumulator& pixel = fb.at(i, j);
+                            if (pixel.converged || pixel.count >= targets[(j - y0) * tile_width + i - x0])
+                                continue;
+                            begin_camera_sample(sampler, seed, i, j, image_width, pixel.count, sample_size);
+                            int k = packet.add(get_ray(i, j), infinity);
+                            pixel_x[k] = i;
+                            pixel_y[k] = j;
+                        }
+                    }
+                    if (packet.size == 0)
+                        continue;
+                    sampled = true;
+
+                    packet.finish();
+                    world.hit_packet(packet, 0.001, packet.all(), records);
+                    for (int k = 0; k < packet.size; ++k) {
+                        pixel_accumulator& pixel = fb.at(pixel_x[k], pixel_y[k]);
+                        ray r = packet.rays[k];
+                        if ((packet.hits >> k) & 1) {
+                            resume_camera_sample(sampler, seed, pixel_x[k], pixel_y[k], image_width, pixel.count,
+                                                 sample_size, 0);
+                            add_sample(pixel, ray_color(r, max_depth, world, materials, stats, &records[k]));
+                        }
+                        else {
+                            ++stats.paths;
+                            ++stats.segments;
+                            add_sample(pixel, sky_color(r.direction()));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void render_pixel(int i, int j, const scene_object& world, const material_table& materials,
+                      pixel_accumulator& pixel, int target_count, path_stats& stats) const {
+        // Adds samples to pixel (i, j) until it has target_count of them or, with adaptive
+        // sampling, until it has converged.
+        while (pixel.count < target_count) {
+            begin_camera_sample(sampler, seed, i, j, image_width, pixel.count, sample_size);
+            ray r = get_ray(i, j);
+            add_sample(pixel, ray_color(r, max_depth, world, materials, stats));
+            if (pixel.converged)
+                return;
+        }
+    }
+
+    static const int check_interval = 8; // samples between adaptive sampling convergence checks
+
+    void add_sample(pixel_accumulator& pixel, const color& sample_color) const {
+        pixel.add(sample_color);
+        int n = ++pixel.count;
+
+        if (adaptive_sampling) {
+            // Welford's online update
+            double y = luminance(sample_color);
+            double delta = y - pixel.mean;
+            pixel.mean += delta / n;
+            pixel.m2 += delta * (y - pixel.mean);
+
+            if (n >= min_samples && n % check_interval == 0) {
+                // Convert the standard error of the mean into display units by scaling it
+                // with the slope of the gamma curve at the mean, so the threshold means
+                // the same visible noise level in shadows and highlights
+                double standard_error = sqrt(pixel.m2 / (n - 1) / n);
+                double slope = std::pow(fmax(pixel.mean, 0.001), 1.0/2.2 - 1.0) / 2.2;
+                if (standard_error * slope <= adaptive_threshold)
+                    pixel.converged = true;
+            }
+        }
+    }
+
+    output_settings output_files() const {
+        output_settings settings;
+        settings.ppm = ppm;
+        settings.write_jpg = write_jpg;
+        settings.write_pfm = write_pfm;
+        return settings;
+    }
+
+    void save_images(const framebuffer& fb, const std::string& filename, thread_pool& pool) const {
+        if (output) {
+            submit_images(std::make_shared<framebuffer>(fb), filename);
+            return;
+        }
+        std::string base = output_dir + filename;
+        if (!write_outputs(base, fb, output_files(), &pool))
+            std::clog << "\nCould not write all images for " << base << std::endl;
+    }
+
+    void submit_images(shared_ptr<framebuffer> frame, const std::string& filename) const {
+        // Queues the frame on the output pipeline. The job only holds copies of what it
+        // needs, so the camera is free to change or render again right away.
+        std::string base = output_dir + filename;
+        output_settings settings = output_files();
+        output->submit([frame, base, settings] {
+            if (!write_outputs(base, *frame, settings))
+                std::clog << "\nCould not write all images for " << base << std::endl;
+        });
+    }
+
+    void save_sample_heatmap(const framebuffer& fb, const std::string& name) const {
+        // Black for min_samples through red and yellow to white for sample_size
+        std::vector<uint8_t> heat(fb.size() * 3);
+        double span = sample_size > min_samples ? sample_size - min_samples : 1;
+        for (size_t k = 0; k < fb.size(); ++k) {
+            double level = interval(0, 1).clamp((fb.pixels[k].count - min_samples) / span) * 3;
+            heat[3*k + 0] = static_cast<uint8_t>(255 * interval(0, 1).clamp(level));
+            heat[3*k + 1] = static_cast<uint8_t>(255 * interval(0, 1).clamp(level - 1));
+            heat[3*k + 2] = static_cast<uint8_t>(255 * interval(0, 1).clamp(level - 2));
+        }
+
+        std::string base = output_dir + name;
+        output_settings settings = output_files();
+        int width = image_width, height = image_height;
+        auto write_heat = [base, settings, width, height](const std::vector<uint8_t>& rgb) {
+            if (!write_rgb8_outputs(base, width, height, rgb, settings))
+                std::clog << "\nCould not write all images for " << base << std::endl;
+        };
+        if (output) {
+            auto shared_heat = std::make_shared<std::vector<uint8_t>>(std::move(heat));
+            output->submit([write_heat, shared_heat] { write_heat(*shared_heat); });
+        }
+        else {
+            write_heat(heat);
+        }
+    }
+
     ray get_ray(int i, int j) const {
         // returns a random ray for the pixel at i, j
         // originating from the defocus disk around the camera origin
@@ -141,8 +539,10 @@ class camera {
 
     vec3 pixel_sample_square() const {
         
-        auto rand_x = random_double(-0.5, 0.5);
-        auto rand_y = random_double(-0.5, 0.5);
+        double rand_x, rand_y;
+        sample_2d(rand_x, rand_y);
+        rand_x -= 0.5;
+        rand_y -= 0.5;
 
         return (rand_x * pixel_delta_u) + (rand_y * pixel_delta_v); 
     }
@@ -154,7 +554,8 @@ class camera {
         return camera_center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
-    color ray_color(ray& r, int depth, const scene_object& world) const /*{
+    color ray_color(ray& r, int depth, const scene_object& world, const material_table& materials,
+                    path_stats& stats, const hit_record* camera_hit = nullptr) const /*{
         
         // if we've exceeded the depth limit, no more light is propagated
         if (depth <= 0) 
@@ -181,18 +582,42 @@ class camera {
         return (1.0 - a)*color(1.0, 1.0, 1.0) + a*color(0.5, 0.7, 1.0);
     }
 */    {
+        // camera_hit is r's hit when it has already been traced (see render_tile_packets)
         hit_record rec;
         color current_attenuation(1.0, 1.0, 1.0);
 
+        ++stats.paths;
+        int bounce = 0;
         while (depth > 0) {
             --depth;
 
-            if (world.hit(r, interval(0.001, infinity), rec)) {
+            ++stats.segments;
+            bool hit_anything;
+            if (camera_hit) {
+                rec = *camera_hit;
+                camera_hit = nullptr;
+                hit_anything = true;
+            }
+            else {
+                hit_anything = world.hit(r, interval(0.001, infinity), rec);
+            }
+            if (hit_anything) {
+                begin_bounce(++bounce);
                 ray scattered;
                 color attenuation;
-                if (rec.mat->scatter(r, rec, attenuation, scattered)) {
+                if (materials.scatter(r, rec, attenuation, scattered)) {
                     current_attenuation = current_attenuation * attenuation;
                     r = scattered;
+
+                    if (russian_roulette && bounce >= rr_min_depth) {
+                        auto survival = fmin(1.0, fmax(current_attenuation.x(),
+                                                       fmax(current_attenuation.y(), current_attenuation.z())));
+                        if (random_double() >= survival) {
+                            ++stats.roulette_kills;
+                            return color(0, 0, 0);
+                        }
+                        current_attenuation /= survival;
+                    }
                 }
                 else {
                     // ray absorbed by material
@@ -202,9 +627,7 @@ class camera {
 
             else {
                 // ray hits sky (our light source)
-                vec3 unit_direction = unit_vector(r.direction());
-                auto a = 0.5*(unit_direction.y() + 1.0);
-                return current_attenuation*((1.0 - a)*color(1.0, 1.0, 1.0) + a*color(0.5, 0.7, 1.0));
+                return current_attenuation*sky_color(r.direction());
             }
         }
         // we've exceeded the depth limit, so no more light is propagated
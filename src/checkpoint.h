@@ -0,0 +1,182 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "framebuffer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// Binary checkpoints of a progressive render.
+//
+// A checkpoint holds the accumulated radiance and sample count of every pixel, plus the
+// adaptive sampling statistics when they are in use. The random streams are keyed by
+// (seed, pixel, sample number), so a pixel's sample count is also its position in its
+// random stream: a resumed render continues every pixel exactly where it stopped and ends
+// up bit-identical to one that was never interrupted. Raising sample_size tops the pixels
+// up with further samples. The stratified sampler lays its strata out by the sample
+// budget, though, so for it the budget has to give the same grid of strata.
+//
+// Layout (native byte order): the checkpoint_header, then the per-pixel arrays one after
+// another: sums (3 doubles), counts (uint32), converged flags (uint8), and if the
+// adaptive flag is set, luminance means and m2s (doubles).
+
+struct checkpoint_header {
+    char magic[8];     // "RBCKPT\0\0"
+    uint32_t version;
+    int32_t width, height;
+    int32_t sampler;   // sampler_type the samples were drawn with
+    uint64_t seed;
+    uint32_t adaptive; // 1 if the adaptive statistics follow the converged flags
+    int32_t sample_size; // samples per pixel the render was aiming for
+};
+
+static const uint32_t checkpoint_version = 2;
+
+enum class checkpoint_load {
+    loaded,   // fb holds the checkpoint
+    missing,  // there is no checkpoint file
+    mismatch  // there is one, but it is damaged or from a render that can't be continued
+};
+
+inline bool checkpoint_sample_size_matches(sampler_type sampler, int saved, int requested) {
+    // Samples already taken can't be taken back, so the budget may only grow. Only the
+    // stratified sampler depends on it, through its grid of strata.
+    if (requested < saved)
+        return false;
+    if (sampler != sampler_type::stratified)
+        return true;
+    uint32_t saved_columns, saved_rows, columns, rows;
+    stratified_grid(saved, saved_columns, saved_rows);
+    stratified_grid(requested, columns, rows);
+    return saved_columns == columns && saved_rows == rows;
+}
+
+inline checkpoint_header make_checkpoint_header(const framebuffer& fb, sampler_type sampler,
+                                                uint64_t seed, int sample_size, bool adaptive) {
+    checkpoint_header header = {};
+    const char magic[8] = { 'R', 'B', 'C', 'K', 'P', 'T', 0, 0 };
+    for (int i = 0; i < 8; ++i)
+        header.magic[i] = magic[i];
+    header.version = checkpoint_version;
+    header.width = fb.width;
+    header.height = fb.height;
+    header.sampler = static_cast<int32_t>(sampler);
+    header.seed = seed;
+    header.adaptive = adaptive ? 1 : 0;
+    header.sample_size = sample_size;
+    return header;
+}
+
+template <typename T>
+inline void write_array(std::ofstream& out, const std::vector<T>& values) {
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+inline bool read_array(std::ifstream& in, std::vector<T>& values) {
+    in.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T));
+    return static_cast<bool>(in);
+}
+
+inline bool save_checkpoint(const std::string& path, const framebuffer& fb, sampler_type sampler,
+                            uint64_t seed, int sample_size, bool adaptive) {
+    // Writes to a temporary file first and renames it over the old checkpoint, so a
+    // render killed in the middle of a save still leaves the previous checkpoint intact
+    size_t n = fb.size();
+    std::vector<double> sums(3 * n);
+    std::vector<uint32_t> counts(n);
+    std::vector<uint8_t> converged(n);
+    for (size_t k = 0; k < n; ++k) {
+        const pixel_accumulator& pixel = fb.pixels[k];
+        sums[3*k + 0] = pixel.sum[0];
+        sums[3*k + 1] = pixel.sum[1];
+        sums[3*k + 2] = pixel.sum[2];
+        counts[k] = static_cast<uint32_t>(pixel.count);
+        converged[k] = pixel.converged ? 1 : 0;
+    }
+
+    // The temporary name is unique to this process and save, so two renders sharing a
+    // checkpoint path never write into the same file
+    static std::atomic<unsigned> temp_counter(0);
+    std::string temp_path = path + "." + std::to_string(static_cast<long>(getpid())) + "."
+                            + std::to_string(temp_counter++) + ".tmp";
+    bool written_ok;
+    {
+        std::ofstream out(temp_path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        checkpoint_header header = make_checkpoint_header(fb, sampler, seed, sample_size, adaptive);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        write_array(out, sums);
+        write_array(out, counts);
+        write_array(out, converged);
+        if (adaptive) {
+            std::vector<double> stats(2 * n);
+            for (size_t k = 0; k < n; ++k) {
+                stats[2*k + 0] = fb.pixels[k].mean;
+                stats[2*k + 1] = fb.pixels[k].m2;
+            }
+            write_array(out, stats);
+        }
+        out.close();
+        written_ok = !out.fail();
+    }
+    // rename() replaces the old checkpoint atomically; removing it first would leave a
+    // moment with no checkpoint at all
+    if (!written_ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+inline checkpoint_load load_checkpoint(const std::string& path, framebuffer& fb, sampler_type sampler,
+                                       uint64_t seed, int sample_size, bool adaptive) {
+    // Fills fb from the checkpoint at path. Leaves fb untouched and returns mismatch if the
+    // checkpoint was made with a different resolution, seed, sampler or adaptive setting,
+    // or a sample size that doesn't match (see checkpoint_sample_size_matches), since its
+    // samples couldn't be continued consistently.
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in)
+        return checkpoint_load::missing;
+
+    checkpoint_header header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    checkpoint_header expected = make_checkpoint_header(fb, sampler, seed, sample_size, adaptive);
+    if (!in || std::string(header.magic, 6) != std::string(expected.magic, 6)
+            || header.version != expected.version || header.width != expected.width
+            || header.height != expected.height || header.sampler != expected.sampler
+            || header.seed != expected.seed || header.adaptive != expected.adaptive
+            || !checkpoint_sample_size_matches(sampler, header.sample_size, sample_size))
+        return checkpoint_load::mismatch;
+
+    size_t n = fb.size();
+    std::vector<double> sums(3 * n);
+    std::vector<uint32_t> counts(n);
+    std::vector<uint8_t> converged(n);
+    std::vector<double> stats(adaptive ? 2 * n : 0);
+    if (!read_array(in, sums) || !read_array(in, counts) || !read_array(in, converged)
+            || !read_array(in, stats))
+        return checkpoint_load::mismatch;
+
+    for (size_t k = 0; k < n; ++k) {
+        pixel_accumulator& pixel = fb.pixels[k];
+        for (int c = 0; c < 3; ++c)
+            pixel.sum[c] = sums[3*k + c];
+        pixel.count = static_cast<int>(counts[k]);
+        pixel.converged = converged[k] != 0;
+        if (adaptive) {
+            pixel.mean = stats[2*k + 0];
+            pixel.m2 = stats[2*k + 1];
+        }
+    }
+    return checkpoint_load::loaded;
+}
+
+#endif
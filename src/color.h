@@ -17,7 +17,21 @@ inline double linear_to_gamma(double linear_component) {
     // return sqrt(linear_component)
 }
 
-void write_color(std::ostream &out, color pixel_color, int samples_per_pixel, uint8_t* rgb) {
+inline double luminance(const color& c) {
+    // Relative luminance of a linear color (Rec. 709 weights)
+    return 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
+}
+
+inline color sky_color(const vec3& direction) {
+    // Radiance of the sky, our only light source, seen along direction: a vertical blend
+    // from white at the horizon to blue overhead
+    vec3 unit_direction = unit_vector(direction);
+    auto a = 0.5*(unit_direction.y() + 1.0);
+    return (1.0 - a)*color(1.0, 1.0, 1.0) + a*color(0.5, 0.7, 1.0);
+}
+
+inline void color_to_rgb8(color pixel_color, int samples_per_pixel, uint8_t* rgb) {
+    // Turns a sum of samples into a gamma encoded 8-bit color
     auto r = pixel_color.x();
     auto g = pixel_color.y();
     auto b = pixel_color.z();
@@ -39,6 +53,11 @@ void write_color(std::ostream &out, color pixel_color, int samples_per_pixel, ui
     rgb[0] = static_cast<uint8_t>(256 * intensity.clamp(r));
     rgb[1] = static_cast<uint8_t>(256 * intensity.clamp(g));
     rgb[2] = static_cast<uint8_t>(256 * intensity.clamp(b));
+}
+
+inline void write_color(std::ostream &out, color pixel_color, int samples_per_pixel, uint8_t* rgb) {
+    // Writes one pixel as a line of a text (P3) PPM, and leaves its 8-bit value in rgb
+    color_to_rgb8(pixel_color, samples_per_pixel, rgb);
 
     out << +rgb[0] << ' '
         << +rgb[1] << ' '
@@ -0,0 +1,51 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "common.h"
+
+#include "color.h"
+
+#include <vector>
+
+struct pixel_accumulator {
+    // Everything the renderer keeps about one pixel between samples. The radiance sum is
+    // kept in double in the float build too, so long renders don't lose the small late
+    // samples to rounding; it becomes a color only when the image is resolved.
+    double sum[3] = {0, 0, 0}; // linear radiance summed over all samples so far
+    int count = 0;          // samples taken so far
+    double mean = 0;        // running mean of the sample luminance (adaptive sampling)
+    double m2 = 0;          // running sum of squared luminance deviations (adaptive sampling)
+    bool converged = false; // adaptive sampling decided this pixel needs no more samples
+
+    void add(const color& sample_color) {
+        sum[0] += sample_color.x();
+        sum[1] += sample_color.y();
+        sum[2] += sample_color.z();
+    }
+
+    color total() const { return color(sum[0], sum[1], sum[2]); }
+};
+
+class framebuffer {
+    // Linear accumulation buffer for a whole image, stored row by row from the top left.
+    // Render workers write disjoint pixels, so no locking is needed.
+    public:
+    int width, height;
+    std::vector<pixel_accumulator> pixels;
+
+    framebuffer(int w, int h) : width(w), height(h), pixels(static_cast<size_t>(w) * h) {}
+
+    pixel_accumulator& at(int i, int j) { return pixels[static_cast<size_t>(j) * width + i]; }
+    const pixel_accumulator& at(int i, int j) const { return pixels[static_cast<size_t>(j) * width + i]; }
+
+    size_t size() const { return pixels.size(); }
+
+    long long total_samples() const {
+        long long total = 0;
+        for (const auto& pixel : pixels)
+            total += pixel.count;
+        return total;
+    }
+};
+
+#endif
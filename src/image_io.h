@@ -0,0 +1,148 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include "common.h"
+
+#include "color.h"
+#include "framebuffer.h"
+#include "thread_pool.h"
+
+#ifdef __clang__
+#define STBIWDEF static inline
+#endif
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Framebuffer-level image output.
+//
+// The whole image is converted in one go and then written out in one bulk fwrite,
+// instead of streaming it pixel by pixel through formatted iostream calls.
+//   ppm_format::binary - P6 PPM, 3 bytes per pixel (the default)
+//   ppm_format::text   - P3 PPM, the original ~12 bytes of text per pixel, for debugging
+//   PFM                - linear 32-bit float radiance, for HDR post-processing
+// JPEG output goes through stb_image_write.
+
+enum class ppm_format {
+    none,   // don't write a PPM
+    binary, // P6
+    text    // P3
+};
+
+inline void resolve_rgb8(const framebuffer& fb, std::vector<uint8_t>& rgb, thread_pool* pool = nullptr) {
+    // Averages and gamma encodes every pixel into 8-bit RGB, a row per work item
+    rgb.resize(fb.size() * 3);
+    auto resolve_row = [&](int j, int) {
+        for (int i = 0; i < fb.width; ++i) {
+            size_t k = static_cast<size_t>(j) * fb.width + i;
+            color_to_rgb8(fb.pixels[k].total(), fb.pixels[k].count, &rgb[3*k]);
+        }
+    };
+    if (pool)
+        pool->parallel_for(fb.height, resolve_row);
+    else
+        for (int j = 0; j < fb.height; ++j)
+            resolve_row(j, 0);
+}
+
+inline bool write_whole_file(const std::string& path, const std::string& header, const void* data, size_t size) {
+    // The pixel data goes out in one fwrite straight from the caller's buffer
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+    ok = ok && std::fwrite(data, 1, size, file) == size;
+    return std::fclose(file) == 0 && ok;
+}
+
+inline bool write_ppm_binary(const std::string& path, int width, int height, const std::vector<uint8_t>& rgb) {
+    std::string header = "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+    return write_whole_file(path, header, rgb.data(), rgb.size());
+}
+
+inline bool write_ppm_text(const std::string& path, int width, int height, const std::vector<uint8_t>& rgb) {
+    // Same text layout as write_color, one pixel per line. The table is built once by the
+    // thread-safe initialization of a local static, as the output pipeline may call this
+    // from several threads at once.
+    static const std::vector<std::string> digits = [] {
+        std::vector<std::string> table;
+        for (int v = 0; v < 256; ++v)
+            table.push_back(std::to_string(v));
+        return table;
+    }();
+
+    std::string header = "P3\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+    std::string text;
+    text.reserve(rgb.size() * 4);
+    for (size_t k = 0; k < rgb.size(); k += 3) {
+        text += digits[rgb[k]];
+        text += ' ';
+        text += digits[rgb[k + 1]];
+        text += ' ';
+        text += digits[rgb[k + 2]];
+        text += '\n';
+    }
+    return write_whole_file(path, header, text.data(), text.size());
+}
+
+inline bool write_pfm(const std::string& path, const framebuffer& fb) {
+    // Portable float map: linear averaged radiance as 32-bit floats. Rows are stored bottom
+    // to top, and the negative scale in the header marks the data as little endian.
+    std::vector<float> data(fb.size() * 3);
+    size_t out = 0;
+    for (int j = fb.height - 1; j >= 0; --j) {
+        for (int i = 0; i < fb.width; ++i) {
+            const pixel_accumulator& pixel = fb.at(i, j);
+            double scale = pixel.count > 0 ? 1.0 / pixel.count : 0.0;
+            data[out++] = static_cast<float>(pixel.sum[0] * scale);
+            data[out++] = static_cast<float>(pixel.sum[1] * scale);
+            data[out++] = static_cast<float>(pixel.sum[2] * scale);
+        }
+    }
+
+    const uint16_t probe = 1;
+    bool little_endian = *reinterpret_cast<const uint8_t*>(&probe) == 1;
+    std::string header = "PF\n" + std::to_string(fb.width) + ' ' + std::to_string(fb.height)
+                       + (little_endian ? "\n-1.0\n" : "\n1.0\n");
+    return write_whole_file(path, header, data.data(), data.size() * sizeof(float));
+}
+
+inline bool write_jpg(const std::string& path, int width, int height, const std::vector<uint8_t>& rgb) {
+    return stbi_write_jpg(path.c_str(), width, height, 3, rgb.data(), 100) != 0;
+}
+
+struct output_settings {
+    // Which files to save for an image, all as <base>.<extension>
+    ppm_format ppm = ppm_format::binary;
+    bool write_jpg = true;
+    bool write_pfm = false; // only possible from a framebuffer, not from 8-bit data
+};
+
+inline bool write_rgb8_outputs(const std::string& base, int width, int height, const std::vector<uint8_t>& rgb,
+                               const output_settings& settings) {
+    bool ok = true;
+    if (settings.ppm == ppm_format::binary)
+        ok = write_ppm_binary(base + ".ppm", width, height, rgb) && ok;
+    else if (settings.ppm == ppm_format::text)
+        ok = write_ppm_text(base + ".ppm", width, height, rgb) && ok;
+    if (settings.write_jpg)
+        ok = write_jpg(base + ".jpg", width, height, rgb) && ok;
+    return ok;
+}
+
+inline bool write_outputs(const std::string& base, const framebuffer& fb, const output_settings& settings,
+                          thread_pool* pool = nullptr) {
+    std::vector<uint8_t> rgb;
+    resolve_rgb8(fb, rgb, pool);
+    bool ok = write_rgb8_outputs(base, fb.width, fb.height, rgb, settings);
+    if (settings.write_pfm)
+        ok = write_pfm(base + ".pfm", fb) && ok;
+    return ok;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "common.h"
+
+#include "scene_objects.h"
+#include "transform.h"
+
+class instance : public scene_object {
+    // A placed copy of shared geometry, e.g. a triangle_mesh or a bvh over a group of
+    // objects. Only the pointer, the transform and its inverse are stored per instance, so
+    // thousands of copies cost no more geometry or acceleration structure memory than one.
+    //
+    // Rays are moved into object space rather than the geometry into world space. The
+    // direction is transformed but not normalized, so t means the same in both spaces and
+    // ray_t and the hit distance pass through unchanged.
+    public:
+    instance(shared_ptr<const scene_object> object, const affine_transform& object_to_world)
+        : geometry(std::move(object)), to_world(object_to_world), to_object(object_to_world.inverse()) {
+        bbox = to_world.box(geometry->bounding_box());
+    }
+
+    instance(shared_ptr<const scene_object> object, const affine_transform& object_to_world, material_id material)
+        : instance(std::move(object), object_to_world) {
+        override_material = true;
+        mat = material;
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        ray local(to_object.point(r.origin()), to_object.vector(r.direction()));
+        if (!geometry->hit(local, ray_t, rec))
+            return false;
+        // The object space normal already faces against the local ray. dot(d, n) keeps its
+        // sign under the inverse transpose, so it still faces against r and
+        // ray_facing_inwards stays valid.
+        rec.p = r.at(rec.t);
+        rec.normal = unit_vector(to_object.transposed_vector(rec.normal));
+        if (override_material)
+            rec.mat = mat;
+        return true;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    const affine_transform& transform() const { return to_world; }
+
+    void set_transform(const affine_transform& object_to_world) {
+        // Moves the instance; an enclosing acceleration structure has to be refit or rebuilt
+        to_world = object_to_world;
+        to_object = object_to_world.inverse();
+        bbox = to_world.box(geometry->bounding_box());
+    }
+
+    const shared_ptr<const scene_object>& object() const { return geometry; }
+
+    private:
+    shared_ptr<const scene_object> geometry;
+    affine_transform to_world, to_object;
+    aabb bbox;
+    bool override_material = false;
+    material_id mat = 0;
+};
+
+#endif
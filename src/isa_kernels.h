@@ -0,0 +1,67 @@
+// Compiles a SIMD kernel file once per instruction set, and dispatches calls to it.
+//
+// A kernel file is written against the `lanes` type of simd.h and has no include guard.
+// To build it for every instruction set, name it in RAY_BANDIT_KERNEL_FILE and include
+// this file:
+//
+//   #define RAY_BANDIT_KERNEL_FILE "sphere_batch_kernel.h"
+//   #include "isa_kernels.h"
+//
+// which puts one copy in each of the namespaces simd_scalar, simd_sse4, simd_avx2 and
+// simd_avx512, the last three compiled for their instruction set. Contraction into fused
+// multiply-adds stays off, so every copy rounds exactly like the scalar code. This file is
+// meant to be included once per kernel, so only the dispatch macro below is guarded.
+
+#ifndef ISA_KERNELS_H
+#define ISA_KERNELS_H
+
+#include "simd.h"
+
+// The copy of a kernel function for level, as an expression: e.g.
+// RAY_BANDIT_SIMD_DISPATCH(level, box_hits(packet, box, t_min, rays)). level must be a
+// supported level (see simd_level_supported) and is evaluated more than once.
+#if RAY_BANDIT_X86_SIMD
+#define RAY_BANDIT_SIMD_DISPATCH(level, call) \
+    ((level) == simd_level::avx512 ? simd_avx512::call \
+     : (level) == simd_level::avx2 ? simd_avx2::call \
+     : (level) == simd_level::sse4 ? simd_sse4::call \
+     : simd_scalar::call)
+#else
+#define RAY_BANDIT_SIMD_DISPATCH(level, call) (simd_scalar::call)
+#endif
+
+#endif
+
+#ifdef RAY_BANDIT_KERNEL_FILE
+namespace simd_scalar {
+#include RAY_BANDIT_KERNEL_FILE
+}
+
+#if RAY_BANDIT_X86_SIMD
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#pragma GCC optimize("fp-contract=off")
+namespace simd_sse4 {
+#include RAY_BANDIT_KERNEL_FILE
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#pragma GCC optimize("fp-contract=off")
+namespace simd_avx2 {
+#include RAY_BANDIT_KERNEL_FILE
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#pragma GCC optimize("fp-contract=off")
+namespace simd_avx512 {
+#include RAY_BANDIT_KERNEL_FILE
+}
+#pragma GCC pop_options
+#endif
+
+#undef RAY_BANDIT_KERNEL_FILE
+#endif
@@ -1,11 +1,11 @@
 #include "common.h"
 
+#include "bvh.h"
 #include "camera.h"
 #include "color.h"
 #include "scene_objects_list.h"
-#include "material.h"
-#include "sphere.h"
-#include "triangle.h"
+#include "material_table.h"
+#include "scene_file.h"
 
 #include <string>
 #include <chrono>
@@ -13,10 +13,31 @@
 #include <sstream>
 
 int main(int argc, char *argv[]) {
-    
+    // Usage: raytracer [scene file] [image name]
+    //        raytracer --convert <input scene> <output scene>   (.scene is text, .rbscene binary)
+    if (argc == 4 && std::string(argv[1]) == "--convert") {
+        scene_description description;
+        if (!load_scene(argv[2], description))
+            return 1;
+        std::string output = argv[3];
+        bool binary = output.size() >= 8 && output.compare(output.size() - 8, 8, ".rbscene") == 0;
+        if (!(binary ? save_scene_binary(output, description) : save_scene_text(output, description))) {
+            std::clog << "Could not write " << output << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    std::string scene_path = argc > 1 ? argv[1] : "scenes/main.scene";
     std::string filename;
-    std::cout << "Enter filename (without extension) to save render as:" << std::endl;
-    std::getline(std::cin, filename);
+    if (argc > 2) {
+        filename = argv[2];
+    }
+    else {
+        std::cout << "Enter filename (without extension) to save render as:" << std::endl;
+        std::getline(std::cin, filename);
+    }
+    auto start_time = std::chrono::steady_clock::now();
     auto current_time = std::chrono::system_clock::now();
     auto current_time_formated = std::chrono::system_clock::to_time_t(current_time);
 
@@ -28,40 +49,57 @@ int main(int argc, char *argv[]) {
     }
 
     scene_objects_list world;
-
-    auto material_ground = make_shared<lambertian1>(color(0.8, 0.8, 0.0), 0.0);
-    auto material_center = make_shared<lambertian1>(color(0.1, 0.2, 0.5), 0.0);
-    auto material_left   = make_shared<dielectric>(1.5);
-    auto material_right  = make_shared<metal>(color(0.8, 0.6, 0.2), 0.0);
-
-    world.add(make_shared<sphere>(point3( 0.0, -100.5, -1.0), 100.0, material_ground));
-    world.add(make_shared<sphere>(point3( 0.0,    0.0, -1.0),   0.5, material_center));
-    world.add(make_shared<triangle>(point3(-1.0, 0.0, 0.0), point3(0.0, 0.0, 2.0), point3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0), material_center));
-    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),   0.5, material_left));
-    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),  -0.4, material_left));
-    world.add(make_shared<sphere>(point3( 1.0,    0.0, -1.0),   0.5, material_right));
-
+    material_table materials;
     camera cam;
 
-    cam.aspect_ratio = 16.0 / 9.0;
-    cam.image_width  = 400;
-    cam.sample_size  = 100; // Number of samples to take for each pixel 
-    cam.max_depth    = 50;  // Max number of times a ray can reflect
-                            
-    cam.v_fov     = 90;
-    cam.look_from = point3(-2, 2, 1);
-    cam.look_at    = point3(0, 0, -1);
-    cam.v_up       = vec3(0, 1, 0);
+    // Meshes are cached under cache/ so later renders of the same scene skip the BVH build
+    scene_description description;
+    std::vector<shared_ptr<instance>> instances;
+    if (!load_scene(scene_path, description)
+            || !build_scene(description, world, materials, cam, "cache/", &instances))
+        return 1;
 
-    cam.defocus_angle = 10.0;
-    cam.focus_dist    = 3.4;
+    // Wrap the objects in a BVH so each ray only tests the objects near its path
+    bvh scene(world);
+    auto scene_metrics = scene.metrics();
+    std::clog << "Built BVH over " << world.objects.size() << " objects in " << scene.build_seconds() << " s: "
+              << scene_metrics.node_count << " nodes, depth " << scene_metrics.max_depth
+              << ", SAH cost " << scene_metrics.sah_cost << std::endl;
 
-    cam.render(world, filename);
+    int frames = description.camera.frames;
+    if (frames <= 1) {
+        if (!cam.render(scene, materials, filename))
+            return 1;
+    }
+    else {
+        // Animation: the meshes and their BVHs stay as they are, only the top level BVH
+        // over the objects is refit to the moved instances. Images are written while the
+        // next frame renders.
+        output_pipeline output;
+        cam.output = &output;
+        for (int frame = 0; frame < frames; ++frame) {
+            auto setup_start = std::chrono::steady_clock::now();
+            bool rebuilt = set_scene_frame(description, instances, frame, cam) > 0 && scene.update();
+            double setup_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - setup_start).count();
+            std::clog << "Frame " << frame + 1 << "/" << frames << ": set up in " << setup_seconds * 1000 << " ms"
+                      << (rebuilt ? " (rebuilt the top level BVH)" : "") << std::endl;
 
-    auto finished_time = std::chrono::system_clock::now();
-    auto finished_time_formated = std::chrono::system_clock::to_time_t(finished_time);
+            std::stringstream frame_name;
+            frame_name << filename << '_' << std::setw(4) << std::setfill('0') << frame;
+            if (!cam.render(scene, materials, frame_name.str())) {
+                output.finish();
+                return 1;
+            }
+        }
+        output.finish();
+    }
 
-    std::cout << "Render completed in " << std::difftime(finished_time_formated, current_time_formated) << " seconds." << std::endl; 
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    std::cout << "Render completed in " << seconds << " seconds";
+    if (frames <= 1 && cam.last_render_seconds > 0 && cam.last_stats.segments > 0) // 0 when resuming a finished render
+        std::cout << " (" << cam.last_stats.segments / cam.last_render_seconds / 1e6 << " Mrays/s, "
+                  << cam.last_render_seconds * 1e9 / cam.last_stats.segments << " ns per ray)";
+    std::cout << '.' << std::endl;
     return 0;
 /*
     // Debug info
@@ -0,0 +1,67 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class mapped_file {
+    // Read-only memory mapping of a whole file. Large inputs (meshes, caches) are parsed
+    // straight from the page cache without copying them into a buffer first, and several
+    // threads can work on different parts of the file at once.
+    public:
+    mapped_file() {}
+    explicit mapped_file(const std::string& path) { open(path); }
+    ~mapped_file() { close(); }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            bytes = static_cast<const char*>(mapping);
+        }
+        ::close(fd); // the mapping stays valid without the descriptor
+        opened = true;
+        return true;
+    }
+
+    void close() {
+        if (bytes)
+            munmap(const_cast<char*>(bytes), length);
+        bytes = nullptr;
+        length = 0;
+        opened = false;
+    }
+
+    bool is_open() const { return opened; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+    private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
+
+#endif
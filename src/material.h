@@ -3,9 +3,13 @@
 
 #include "common.h"
 
+#include "color.h"
+
 class hit_record;
 
 class material {
+	// The built-in materials below are final: the wavefront integrator calls their scatter
+	// directly, without the virtual call, once it has matched a material's exact type.
 	public:
 	virtual ~material() = default;
     // Properties of a material:
@@ -19,7 +23,7 @@ class material {
 };
 
 // Lambertian material which always scatters. The scattered rays are attenuated by the reflectance R.
-class lambertian1: public material {
+class lambertian1 final : public material {
     public:
         lambertian1(const color& a, const double R) : albedo(a * (1 - R)) {}
 
@@ -41,7 +45,7 @@ class lambertian1: public material {
 }; 
 
 // Lambertian material which sometimes scatters (with probability 1 - R). The rays are not attenuated
-class lambertian2 : public material {
+class lambertian2 final : public material {
     public:
         lambertian2(const color& a, const double R) : albedo(a), reflectance(R) {}
 
@@ -66,12 +70,12 @@ class lambertian2 : public material {
 
     private:
         color albedo;
-        double reflectance;
+        real reflectance;
 }; 
 
 // Mixture of lambertian1 and lambertian2. The incident rays are scattered with probability p and
 // have an attenuation of albedo / p
-class lambertian3 : public material {
+class lambertian3 final : public material {
     public:
         lambertian3(const color& a, const double R) : albedo(a / (1 - R)), reflectance(R) {}
 
@@ -94,9 +98,9 @@ class lambertian3 : public material {
 
     private:
         color albedo;
-        double reflectance;
+        real reflectance;
 }; 
-class metal : public material {
+class metal final : public material {
     // Class for metals, which are inherently relfective
     // The fuzz factor scales the random unit vector added to the end of the reflected ray.
     // I.e. a fuzz factor of 1 will add a whole unit vector to the reflected ray, causing
@@ -114,17 +118,17 @@ class metal : public material {
 
     private:
         color albedo;
-        double fuzz;
+        real fuzz;
 };
 
-class dielectric : public material {
+class dielectric final : public material {
     public:
         dielectric(double refractive_index_ratio) : rir(refractive_index_ratio) {}
 
         bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
             attenuation = color(1.0, 1.0, 1.0);
             // 
-            double refraction_ratio = rec.ray_facing_inwards ? (1.0/rir) : rir;
+            real refraction_ratio = rec.ray_facing_inwards ? (1/rir) : rir;
 
             vec3 unit_direction = unit_vector(r_in.direction());
             vec3 refracted = refract(unit_direction, rec.normal, refraction_ratio);
@@ -133,7 +137,7 @@ class dielectric : public material {
             return true;
         }
     private:
-        double rir; // Ratio of refractive indices n1 / n2 where n1 is the index for air and n2 the index
+        real rir; // Ratio of refractive indices n1 / n2 where n1 is the index for air and n2 the index
                     // for this particular dielectric material.
 };
 
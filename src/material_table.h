@@ -0,0 +1,34 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include "common.h"
+
+#include "material.h"
+
+#include <vector>
+
+class material_table {
+    // Flat list of the materials of a scene. Primitives and hit records refer to a material
+    // by its index (a material_id) instead of holding a shared_ptr, so recording a hit
+    // copies a 4 byte integer and never touches a reference count. The table owns the
+    // materials and must outlive every render that uses it.
+    public:
+    material_id add(shared_ptr<material> m) {
+        materials.push_back(m);
+        return static_cast<material_id>(materials.size() - 1);
+    }
+
+    const material& operator[](material_id id) const { return *materials[id]; }
+
+    size_t size() const { return materials.size(); }
+
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const {
+        // Scatters r_in off the material of the surface it hit
+        return materials[rec.mat]->scatter(r_in, rec, attenuation, scattered);
+    }
+
+    private:
+    std::vector<shared_ptr<material>> materials;
+};
+
+#endif
@@ -0,0 +1,334 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "common.h"
+
+#include "mapped_file.h"
+#include "mesh_io.h"
+#include "triangle_mesh.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+// On-disk cache of built triangle meshes.
+//
+// A cache file holds the arrays of a built triangle_mesh (see triangle_mesh_arrays):
+// vertices, normals, indices in BVH order, the wide BVH nodes and the triangle blocks.
+// They only refer to each other by index, so the file is used exactly as it lies on disk:
+// opening a cached mesh maps the file and points the mesh at it, with no parsing, no
+// copying and no pointer fixups. Opening checks every index in the file once (see
+// mesh_cache_arrays_valid), so a damaged or foreign file is ignored instead of sending
+// rays outside the mapping.
+//
+// Files are named after a content hash of the mesh's input (the bytes of the mesh file,
+// or the mesh_data) combined with the build settings, so a changed asset simply misses
+// the cache. The header also records the format version and the sizes of `real` and of
+// the node and block records, and files that don't match this build are ignored.
+//
+// Layout (native byte order): the mesh_cache_header, then the arrays in the order of
+// mesh_cache_section, each starting on a 64 byte boundary.
+
+enum mesh_cache_section {
+    cache_positions, cache_normals, cache_indices, cache_normal_indices, cache_nodes, cache_blocks,
+    cache_section_count
+};
+
+struct mesh_cache_header {
+    char magic[8];          // "RBMESH\0\0"
+    uint32_t version;
+    uint32_t real_bytes;    // sizeof(real) of the build that wrote the file
+    uint32_t node_bytes;    // sizeof(wide_bvh_node<8>)
+    uint32_t block_bytes;   // sizeof(triangle_block)
+    uint64_t key;           // see mesh_cache_key
+    uint64_t triangle_count;
+    double bbox[6];         // min and max of x, y and z
+    uint64_t offset[cache_section_count]; // from the start of the file, 0 for absent arrays
+    uint64_t count[cache_section_count];  // elements in each array
+};
+
+static const uint32_t mesh_cache_version = 1;
+
+inline uint64_t content_hash(const void* data, size_t size, uint64_t seed = 0) {
+    // 64 bit hash of a byte range, fast enough to run over a whole mesh file before
+    // deciding whether to parse it. Four independent lanes of 8 byte words (after xxHash64).
+    const uint64_t prime_1 = 0x9E3779B185EBCA87ull, prime_2 = 0xC2B2AE3D27D4EB4Full,
+                   prime_3 = 0x165667B19E3779F9ull;
+    auto rotate = [](uint64_t x, int bits) { return (x << bits) | (x >> (64 - bits)); };
+    auto round = [&](uint64_t lane, uint64_t word) { return rotate(lane + word * prime_2, 31) * prime_1; };
+
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    uint64_t lanes[4] = { seed + prime_1 + prime_2, seed + prime_2, seed, seed - prime_1 };
+    for (; p + 32 <= end; p += 32) {
+        for (int k = 0; k < 4; ++k) {
+            uint64_t word;
+            std::memcpy(&word, p + 8*k, 8);
+            lanes[k] = round(lanes[k], word);
+        }
+    }
+    uint64_t h = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18);
+    for (int k = 0; k < 4; ++k)
+        h = (h ^ round(0, lanes[k])) * prime_1 + prime_3;
+    h += size;
+    for (; p < end; ++p)
+        h = rotate(h ^ (*p * prime_3), 11) * prime_1;
+    h ^= h >> 33;
+    h *= prime_2;
+    h ^= h >> 29;
+    h *= prime_3;
+    return h ^ (h >> 32);
+}
+
+inline uint64_t mesh_cache_key(uint64_t input_hash, bvh_build_method method) {
+    // Combines the hash of a mesh's input with everything else that shapes the built mesh
+    uint64_t settings[3] = { input_hash, static_cast<uint64_t>(method), mesh_cache_version };
+    return content_hash(settings, sizeof(settings));
+}
+
+inline uint64_t mesh_cache_key(const mesh_data& mesh, bvh_build_method method) {
+    uint64_t h = content_hash(mesh.positions.data(), mesh.positions.size() * sizeof(point3));
+    h = content_hash(mesh.normals.data(), mesh.normals.size() * sizeof(vec3), h);
+    h = content_hash(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t), h);
+    h = content_hash(mesh.normal_indices.data(), mesh.normal_indices.size() * sizeof(uint32_t), h);
+    return mesh_cache_key(h, method);
+}
+
+inline std::string mesh_cache_path(const std::string& cache_dir, uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.rbmesh", static_cast<unsigned long long>(key));
+    return cache_dir + name;
+}
+
+inline mesh_cache_header make_mesh_cache_header(uint64_t key) {
+    mesh_cache_header header = {};
+    const char magic[8] = { 'R', 'B', 'M', 'E', 'S', 'H', 0, 0 };
+    for (int i = 0; i < 8; ++i)
+        header.magic[i] = magic[i];
+    header.version = mesh_cache_version;
+    header.real_bytes = sizeof(real);
+    header.node_bytes = sizeof(wide_bvh_node<8>);
+    header.block_bytes = sizeof(triangle_block);
+    header.key = key;
+    return header;
+}
+
+inline bool write_mesh_cache(const std::string& path, const triangle_mesh& mesh, uint64_t key) {
+    // Writes to a temporary file first and renames it into place, so a reader never maps
+    // a half written cache
+    const triangle_mesh_arrays& arrays = mesh.arrays();
+    mesh_cache_header header = make_mesh_cache_header(key);
+    header.triangle_count = arrays.triangle_count;
+    for (int a = 0; a < 3; ++a) {
+        header.bbox[a] = arrays.bbox.axis(a).min;
+        header.bbox[3 + a] = arrays.bbox.axis(a).max;
+    }
+
+    const void* data[cache_section_count] = { arrays.positions, arrays.normals, arrays.indices,
+                                              arrays.normal_indices, arrays.nodes, arrays.blocks };
+    const size_t element_bytes[cache_section_count] = { sizeof(point3), sizeof(vec3), sizeof(uint32_t),
+                                                        sizeof(uint32_t), sizeof(wide_bvh_node<8>),
+                                                        sizeof(triangle_block) };
+    header.count[cache_positions] = arrays.position_count;
+    header.count[cache_normals] = arrays.normals ? arrays.normal_count : 0;
+    header.count[cache_indices] = 3 * arrays.triangle_count;
+    header.count[cache_normal_indices] = arrays.normal_indices ? 3 * arrays.triangle_count : 0;
+    header.count[cache_nodes] = arrays.node_count;
+    header.count[cache_blocks] = arrays.block_count;
+    uint64_t position = sizeof(header);
+    for (int s = 0; s < cache_section_count; ++s) {
+        if (header.count[s] == 0)
+            continue;
+        position = (position + 63) / 64 * 64;
+        header.offset[s] = position;
+        position += header.count[s] * element_bytes[s];
+    }
+
+    // Named after the process and a counter, so concurrent writers of the same mesh never
+    // share a temporary file; rename() then atomically replaces whatever cache is in place
+    static std::atomic<unsigned> temp_counter(0);
+    std::string temp_path = path + "." + std::to_string(static_cast<long>(getpid())) + "."
+                            + std::to_string(temp_counter++) + ".tmp";
+    bool written_ok;
+    {
+        std::ofstream out(temp_path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        const char padding[64] = {};
+        uint64_t written = sizeof(header);
+        for (int s = 0; s < cache_section_count; ++s) {
+            if (header.count[s] == 0)
+                continue;
+            out.write(padding, static_cast<std::streamsize>(header.offset[s] - written));
+            out.write(static_cast<const char*>(data[s]), static_cast<std::streamsize>(header.count[s] * element_bytes[s]));
+            written = header.offset[s] + header.count[s] * element_bytes[s];
+        }
+        out.close();
+        written_ok = !out.fail();
+    }
+    if (!written_ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+inline bool mesh_cache_arrays_valid(const triangle_mesh_arrays& arrays) {
+    // Checks every index that tracing follows: vertex and normal indices, the blocks' triangle
+    // ids and slot counts, and the nodes' children. Collapsing numbers the nodes depth first,
+    // so a child always comes after its parent; requiring that rules out cycles and lets the
+    // depth be bounded in one pass, which keeps traversal within its fixed size stack.
+    for (size_t i = 0; i < 3 * arrays.triangle_count; ++i) {
+        if (arrays.indices[i] >= arrays.position_count)
+            return false;
+        if (arrays.normals) {
+            uint32_t n = arrays.normal_indices ? arrays.normal_indices[i] : arrays.indices[i];
+            if (n >= arrays.normal_count)
+                return false;
+        }
+    }
+    if (arrays.normal_indices && !arrays.normals)
+        return false;
+
+    for (size_t b = 0; b < arrays.block_count; ++b) {
+        const triangle_block& block = arrays.blocks[b];
+        if (block.count < 0 || block.count > triangle_block::width)
+            return false;
+        for (int k = 0; k < block.count; ++k)
+            if (block.id[k] >= arrays.triangle_count)
+                return false;
+    }
+
+    const int width = 8;
+    std::vector<int> depth(arrays.node_count, 0);
+    if (arrays.node_count > 0)
+        depth[0] = 1;
+    for (size_t i = 0; i < arrays.node_count; ++i) {
+        const wide_bvh_node<width>& n = arrays.nodes[i];
+        if (n.child_count > width || depth[i] == 0 || depth[i] > bvh_tree::max_depth)
+            return false; // unreachable nodes can only come from a damaged file
+        for (int k = 0; k < n.child_count; ++k) {
+            int64_t child = n.child[k];
+            if (n.count[k] > 0) {
+                int64_t blocks = (n.count[k] + triangle_block::width - 1) / triangle_block::width;
+                if (child < 0 || child + blocks > static_cast<int64_t>(arrays.block_count))
+                    return false;
+            }
+            else {
+                if (child <= static_cast<int64_t>(i) || child >= static_cast<int64_t>(arrays.node_count))
+                    return false;
+                depth[child] = std::max(depth[child], depth[i] + 1);
+            }
+        }
+    }
+    return true;
+}
+
+inline shared_ptr<triangle_mesh> open_mesh_cache(const std::string& path, uint64_t key, material_id mat) {
+    // Maps the cache file at path and returns a mesh that traces straight from it, or null
+    // if there is no such file or it wasn't written for this key and this build
+    auto file = make_shared<mapped_file>();
+    if (!file->open(path) || file->size() < sizeof(mesh_cache_header))
+        return nullptr;
+
+    mesh_cache_header header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    mesh_cache_header expected = make_mesh_cache_header(key);
+    if (std::memcmp(header.magic, expected.magic, 8) != 0 || header.version != expected.version
+            || header.real_bytes != expected.real_bytes || header.node_bytes != expected.node_bytes
+            || header.block_bytes != expected.block_bytes || header.key != expected.key)
+        return nullptr;
+
+    const size_t element_bytes[cache_section_count] = { sizeof(point3), sizeof(vec3), sizeof(uint32_t),
+                                                        sizeof(uint32_t), sizeof(wide_bvh_node<8>),
+                                                        sizeof(triangle_block) };
+    const char* section[cache_section_count] = {};
+    for (int s = 0; s < cache_section_count; ++s) {
+        if (header.count[s] == 0)
+            continue;
+        // Every array must lie inside the file and keep the alignment of the mapping
+        if (header.offset[s] % 64 != 0 || header.offset[s] > file->size()
+                || header.count[s] > (file->size() - header.offset[s]) / element_bytes[s])
+            return nullptr;
+        section[s] = file->data() + header.offset[s];
+    }
+    if (header.count[cache_indices] % 3 != 0 || header.count[cache_indices] / 3 != header.triangle_count
+            || (section[cache_normal_indices] && header.count[cache_normal_indices] != header.count[cache_indices]))
+        return nullptr;
+
+    triangle_mesh_arrays arrays;
+    arrays.positions = reinterpret_cast<const point3*>(section[cache_positions]);
+    arrays.position_count = header.count[cache_positions];
+    arrays.normals = reinterpret_cast<const vec3*>(section[cache_normals]);
+    arrays.normal_count = header.count[cache_normals];
+    arrays.indices = reinterpret_cast<const uint32_t*>(section[cache_indices]);
+    arrays.normal_indices = reinterpret_cast<const uint32_t*>(section[cache_normal_indices]);
+    arrays.triangle_count = header.triangle_count;
+    arrays.nodes = reinterpret_cast<const wide_bvh_node<8>*>(section[cache_nodes]);
+    arrays.node_count = header.count[cache_nodes];
+    arrays.blocks = reinterpret_cast<const triangle_block*>(section[cache_blocks]);
+    arrays.block_count = header.count[cache_blocks];
+    arrays.bbox = aabb(point3(header.bbox[0], header.bbox[1], header.bbox[2]),
+                       point3(header.bbox[3], header.bbox[4], header.bbox[5]));
+    if (!mesh_cache_arrays_valid(arrays))
+        return nullptr;
+    return make_shared<triangle_mesh>(arrays, file, mat);
+}
+
+inline shared_ptr<triangle_mesh> build_mesh_cached(mesh_data data, const std::string& cache_dir, material_id mat,
+                                                   bvh_build_method method = bvh_build_method::sah,
+                                                   int thread_count = 0) {
+    // Returns the mesh from the cache in cache_dir if it was built before, otherwise builds
+    // it and adds it to the cache
+    uint64_t key = mesh_cache_key(data, method);
+    std::string path = mesh_cache_path(cache_dir, key);
+    auto mesh = open_mesh_cache(path, key, mat);
+    if (mesh)
+        return mesh;
+    mesh = make_shared<triangle_mesh>(std::move(data), mat, method, thread_count);
+    mkdir(cache_dir.c_str(), 0755); // fails harmlessly if it exists
+    if (!write_mesh_cache(path, *mesh, key))
+        std::clog << "Could not write mesh cache " << path << std::endl;
+    return mesh;
+}
+
+inline shared_ptr<triangle_mesh> load_mesh_cached(const std::string& mesh_path, const std::string& cache_dir,
+                                                  material_id mat, bvh_build_method method = bvh_build_method::sah,
+                                                  int thread_count = 0) {
+    // Like load_mesh followed by building a triangle_mesh, but keyed by a hash of the file's
+    // bytes: when the cache has the mesh, the file is only hashed, never parsed. Returns null
+    // if the file can't be loaded.
+    uint64_t key;
+    {
+        mapped_file source;
+        if (!source.open(mesh_path)) {
+            std::clog << "Could not open " << mesh_path << std::endl;
+            return nullptr;
+        }
+        key = mesh_cache_key(content_hash(source.data(), source.size()), method);
+    }
+    std::string path = mesh_cache_path(cache_dir, key);
+    auto mesh = open_mesh_cache(path, key, mat);
+    if (mesh)
+        return mesh;
+
+    mesh_data data;
+    if (!load_mesh(mesh_path, data, thread_count))
+        return nullptr;
+    mesh = make_shared<triangle_mesh>(std::move(data), mat, method, thread_count);
+    mkdir(cache_dir.c_str(), 0755); // fails harmlessly if it exists
+    if (!write_mesh_cache(path, *mesh, key))
+        std::clog << "Could not write mesh cache " << path << std::endl;
+    return mesh;
+}
+
+#endif
@@ -0,0 +1,706 @@
+#ifndef MESH_IO_H
+#define MESH_IO_H
+
+#include "common.h"
+
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Loaders for Wavefront OBJ and binary PLY meshes, both filling a mesh_data for
+// triangle_mesh. Files are memory mapped and parsed by several threads: an OBJ file is
+// cut into chunks at line boundaries which are parsed independently and stitched back
+// together, and the fixed-size records of a binary PLY file are decoded in ranges.
+// Polygons are split into triangle fans. On failure the loaders return false and say why
+// on std::clog.
+
+// Number parsing
+
+inline void skip_blanks(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+}
+
+inline const char* next_line(const char* p, const char* end) {
+    const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return newline ? newline + 1 : end;
+}
+
+inline bool parse_real(const char*& p, const char* end, double& out) {
+    // Decimal number with optional sign, fraction and exponent. Numbers with at most 15
+    // significant digits and a small exponent (nearly all mesh data) are converted
+    // exactly without strtod; anything else goes through strtod.
+    static const double powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    skip_blanks(p, end);
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0;   // significant digits in mantissa
+    int exponent = 0;
+    bool any_digit = false;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        any_digit = true;
+        if (digits < 19) {
+            mantissa = 10*mantissa + (*p - '0');
+            if (mantissa != 0) ++digits;
+        }
+        else {
+            ++exponent;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+            any_digit = true;
+            if (digits < 19) {
+                mantissa = 10*mantissa + (*p - '0');
+                if (mantissa != 0) ++digits;
+                --exponent;
+            }
+        }
+    }
+    if (!any_digit) {
+        p = start;
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negative_exponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            negative_exponent = *e++ == '-';
+        if (e < end && *e >= '0' && *e <= '9') {
+            int value = 0;
+            for (; e < end && *e >= '0' && *e <= '9'; ++e)
+                if (value < 10000) value = 10*value + (*e - '0');
+            exponent += negative_exponent ? -value : value;
+            p = e;
+        }
+    }
+
+    if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / powers_of_ten[-exponent] : value * powers_of_ten[exponent];
+        out = negative ? -value : value;
+        return true;
+    }
+
+    char buffer[128];
+    size_t length = static_cast<size_t>(p - start);
+    if (length >= sizeof(buffer))
+        return false;
+    std::memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    out = std::strtod(buffer, nullptr);
+    return true;
+}
+
+inline bool parse_integer(const char*& p, const char* end, long long& out) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    long long value = 0;
+    const char* digits_start = p;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p)
+        value = 10*value + (*p - '0');
+    if (p == digits_start) {
+        p = start;
+        return false;
+    }
+    out = negative ? -value : value;
+    return true;
+}
+
+// OBJ
+
+// Marks a face corner written without a normal. Any negative value could be a relative
+// index still waiting for its chunk's offset, or one pointing before the first normal.
+static const long long obj_no_normal = std::numeric_limits<long long>::min();
+
+struct obj_chunk {
+    // What one thread parsed from its part of an OBJ file. Face corners refer to vertices
+    // by 0-based index; those written with negative (relative) indices are relative to the
+    // chunk's first vertex until the chunks are stitched together, and are listed in
+    // relative_corners / relative_normal_corners so they can be fixed up.
+    std::vector<point3> positions;
+    std::vector<vec3> normals;
+    std::vector<long long> corners;         // 3 per triangle
+    std::vector<long long> normal_corners;  // 3 per triangle, obj_no_normal where a corner has none
+    std::vector<size_t> relative_corners;
+    std::vector<size_t> relative_normal_corners;
+    bool bad_line = false;
+};
+
+inline void parse_obj_chunk(const char* p, const char* end, obj_chunk& chunk) {
+    std::vector<long long> face, face_normals;
+    std::vector<bool> face_relative, face_normal_relative;
+
+    for (; p < end; p = next_line(p, end)) {
+        skip_blanks(p, end);
+        if (p + 1 >= end)
+            continue;
+
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            p += 2;
+            double x, y, z;
+            if (!parse_real(p, end, x) || !parse_real(p, end, y) || !parse_real(p, end, z)) {
+                chunk.bad_line = true;
+                return;
+            }
+            chunk.positions.push_back(point3(x, y, z));
+        }
+        else if (p[0] == 'v' && p[1] == 'n' && p + 2 < end && (p[2] == ' ' || p[2] == '\t')) {
+            p += 3;
+            double x, y, z;
+            if (!parse_real(p, end, x) || !parse_real(p, end, y) || !parse_real(p, end, z)) {
+                chunk.bad_line = true;
+                return;
+            }
+            chunk.normals.push_back(vec3(x, y, z));
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            // Corners are v, v/vt, v//vn or v/vt/vn; texture coordinates are skipped
+            p += 2;
+            face.clear();
+            face_normals.clear();
+            face_relative.clear();
+            face_normal_relative.clear();
+            while (true) {
+                skip_blanks(p, end);
+                long long v, vt = 0, vn = 0;
+                if (!parse_integer(p, end, v))
+                    break;
+                if (p < end && *p == '/') {
+                    ++p;
+                    if (p < end && *p != '/')
+                        parse_integer(p, end, vt);
+                    if (p < end && *p == '/') {
+                        ++p;
+                        parse_integer(p, end, vn);
+                    }
+                }
+                if (v == 0) {
+                    chunk.bad_line = true;
+                    return;
+                }
+                // 1-based absolute indices, or negative ones counting back from the
+                // last vertex read so far
+                face.push_back(v > 0 ? v - 1 : static_cast<long long>(chunk.positions.size()) + v);
+                face_relative.push_back(v < 0);
+                face_normals.push_back(vn > 0 ? vn - 1
+                                              : vn < 0 ? static_cast<long long>(chunk.normals.size()) + vn : obj_no_normal);
+                face_normal_relative.push_back(vn < 0);
+            }
+            if (face.size() < 3) {
+                chunk.bad_line = true;
+                return;
+            }
+            for (size_t k = 1; k + 1 < face.size(); ++k) {
+                const size_t fan[3] = { 0, k, k + 1 };
+                for (size_t corner : fan) {
+                    if (face_relative[corner])
+                        chunk.relative_corners.push_back(chunk.corners.size());
+                    if (face_normal_relative[corner])
+                        chunk.relative_normal_corners.push_back(chunk.normal_corners.size());
+                    chunk.corners.push_back(face[corner]);
+                    chunk.normal_corners.push_back(face_normals[corner]);
+                }
+            }
+        }
+        // anything else (comments, texture coordinates, groups, materials) is ignored
+    }
+}
+
+inline bool load_obj(const std::string& path, mesh_data& mesh, int thread_count = 0) {
+    mapped_file file;
+    if (!file.open(path)) {
+        std::clog << "Could not open " << path << std::endl;
+        return false;
+    }
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    thread_pool pool(thread_count);
+
+    // Cut the file into chunks of at least 1 MB, each ending at a line break
+    const size_t min_chunk = 1 << 20;
+    size_t chunk_count = std::max<size_t>(1, std::min<size_t>(8 * pool.size(), file.size() / min_chunk));
+    std::vector<const char*> bounds(chunk_count + 1, end);
+    bounds[0] = begin;
+    for (size_t k = 1; k < chunk_count; ++k) {
+        const char* split = begin + file.size() * k / chunk_count;
+        bounds[k] = split > bounds[k - 1] ? next_line(split, end) : bounds[k - 1];
+    }
+
+    std::vector<obj_chunk> chunks(chunk_count);
+    pool.parallel_for(static_cast<int>(chunk_count), [&](int k, int) {
+        parse_obj_chunk(bounds[k], bounds[k + 1], chunks[k]);
+    });
+
+    // Each chunk's vertices follow those of the chunks before it
+    std::vector<size_t> position_base(chunk_count + 1, 0), normal_base(chunk_count + 1, 0),
+                        corner_base(chunk_count + 1, 0);
+    bool all_normals = true;
+    for (size_t k = 0; k < chunk_count; ++k) {
+        if (chunks[k].bad_line) {
+            std::clog << "Malformed line in " << path << std::endl;
+            return false;
+        }
+        position_base[k + 1] = position_base[k] + chunks[k].positions.size();
+        normal_base[k + 1] = normal_base[k] + chunks[k].normals.size();
+        corner_base[k + 1] = corner_base[k] + chunks[k].corners.size();
+    }
+    long long position_count = static_cast<long long>(position_base[chunk_count]);
+    long long normal_count = static_cast<long long>(normal_base[chunk_count]);
+
+    mesh = mesh_data();
+    mesh.positions.resize(position_base[chunk_count]);
+    mesh.normals.resize(normal_base[chunk_count]);
+    mesh.indices.resize(corner_base[chunk_count]);
+    mesh.normal_indices.resize(corner_base[chunk_count]);
+
+    std::vector<char> chunk_ok(chunk_count, 1), chunk_all_normals(chunk_count, 1),
+                      chunk_shared_normals(chunk_count, 1);
+    pool.parallel_for(static_cast<int>(chunk_count), [&](int k, int) {
+        obj_chunk& chunk = chunks[k];
+        for (size_t corner : chunk.relative_corners)
+            chunk.corners[corner] += position_base[k];
+        for (size_t corner : chunk.relative_normal_corners)
+            chunk.normal_corners[corner] += normal_base[k];
+
+        std::copy(chunk.positions.begin(), chunk.positions.end(), mesh.positions.begin() + position_base[k]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), mesh.normals.begin() + normal_base[k]);
+        for (size_t c = 0; c < chunk.corners.size(); ++c) {
+            long long index = chunk.corners[c];
+            long long normal_index = chunk.normal_corners[c];
+            if (index < 0 || index >= position_count)
+                chunk_ok[k] = 0;
+            if (normal_index == obj_no_normal)
+                chunk_all_normals[k] = 0;
+            else if (normal_index < 0 || normal_index >= normal_count)
+                chunk_ok[k] = 0;
+            if (normal_index != index)
+                chunk_shared_normals[k] = 0;
+            mesh.indices[corner_base[k] + c] = static_cast<uint32_t>(index);
+            mesh.normal_indices[corner_base[k] + c] = static_cast<uint32_t>(normal_index);
+        }
+        chunk = obj_chunk(); // free each chunk as soon as it is merged
+    });
+
+    bool shared_normals = true;
+    for (size_t k = 0; k < chunk_count; ++k) {
+        if (!chunk_ok[k]) {
+            std::clog << "Face refers to a missing vertex or normal in " << path << std::endl;
+            return false;
+        }
+        all_normals = all_normals && chunk_all_normals[k];
+        shared_normals = shared_normals && chunk_shared_normals[k];
+    }
+
+    if (!all_normals || mesh.normals.empty()) {
+        // Normals are all or nothing
+        std::vector<vec3>().swap(mesh.normals);
+        std::vector<uint32_t>().swap(mesh.normal_indices);
+    }
+    else if (shared_normals && mesh.normals.size() == mesh.positions.size()) {
+        std::vector<uint32_t>().swap(mesh.normal_indices); // normals share the position indices
+    }
+    return true;
+}
+
+// PLY
+
+enum class ply_type { none, int8, uint8, int16, uint16, int32, uint32, float32, float64 };
+
+inline ply_type ply_type_from_name(const std::string& name) {
+    if (name == "char" || name == "int8") return ply_type::int8;
+    if (name == "uchar" || name == "uint8") return ply_type::uint8;
+    if (name == "short" || name == "int16") return ply_type::int16;
+    if (name == "ushort" || name == "uint16") return ply_type::uint16;
+    if (name == "int" || name == "int32") return ply_type::int32;
+    if (name == "uint" || name == "uint32") return ply_type::uint32;
+    if (name == "float" || name == "float32") return ply_type::float32;
+    if (name == "double" || name == "float64") return ply_type::float64;
+    return ply_type::none;
+}
+
+inline size_t ply_type_size(ply_type type) {
+    switch (type) {
+        case ply_type::int8: case ply_type::uint8: return 1;
+        case ply_type::int16: case ply_type::uint16: return 2;
+        case ply_type::int32: case ply_type::uint32: case ply_type::float32: return 4;
+        case ply_type::float64: return 8;
+        default: return 0;
+    }
+}
+
+inline double ply_read(const char* p, ply_type type, bool swap_bytes) {
+    // Reads one value of the given type, swapping its bytes if the file's byte order
+    // differs from this machine's
+    char bytes[8];
+    size_t size = ply_type_size(type);
+    for (size_t i = 0; i < size; ++i)
+        bytes[i] = swap_bytes ? p[size - 1 - i] : p[i];
+    switch (type) {
+        case ply_type::int8:    { int8_t v;   std::memcpy(&v, bytes, 1); return v; }
+        case ply_type::uint8:   { uint8_t v;  std::memcpy(&v, bytes, 1); return v; }
+        case ply_type::int16:   { int16_t v;  std::memcpy(&v, bytes, 2); return v; }
+        case ply_type::uint16:  { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case ply_type::int32:   { int32_t v;  std::memcpy(&v, bytes, 4); return v; }
+        case ply_type::uint32:  { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case ply_type::float32: { float v;    std::memcpy(&v, bytes, 4); return v; }
+        case ply_type::float64: { double v;   std::memcpy(&v, bytes, 8); return v; }
+        default: return 0;
+    }
+}
+
+struct ply_property {
+    std::string name;
+    ply_type type = ply_type::none;       // type of the value, or of the list items
+    ply_type count_type = ply_type::none; // type of the list length, none if not a list
+    size_t offset = 0;                    // byte offset in fixed-size records
+};
+
+struct ply_element {
+    std::string name;
+    size_t count = 0;
+    std::vector<ply_property> properties;
+    size_t record_size = 0; // 0 if the records contain lists and vary in size
+
+    int find(const char* property) const {
+        for (size_t i = 0; i < properties.size(); ++i)
+            if (properties[i].name == property)
+                return static_cast<int>(i);
+        return -1;
+    }
+
+    bool size_of(const char* record, const char* end, bool swap_bytes, size_t& size) const {
+        // Size of one record, also when it contains lists. Returns false if the record
+        // doesn't fit before end; each list count is only read once it is known to be there.
+        const size_t available = static_cast<size_t>(end - record);
+        if (record_size > 0) {
+            size = record_size;
+            return size <= available;
+        }
+        size = 0;
+        for (const auto& property : properties) {
+            if (property.count_type == ply_type::none) {
+                size += ply_type_size(property.type);
+            }
+            else {
+                size_t count_size = ply_type_size(property.count_type);
+                if (count_size > available - size)
+                    return false;
+                double items = ply_read(record + size, property.count_type, swap_bytes);
+                if (!(items >= 0 && items <= static_cast<double>(available)))
+                    return false;
+                size += count_size + static_cast<size_t>(items) * ply_type_size(property.type);
+            }
+            if (size > available)
+                return false;
+        }
+        return true;
+    }
+};
+
+inline bool parse_ply_header(const char* begin, const char* end, std::vector<ply_element>& elements,
+                             bool& big_endian, const char*& body, std::string& error) {
+    const char* header_end = begin;
+    const char* marker = "end_header";
+    const size_t marker_length = std::strlen(marker);
+    while (true) {
+        if (header_end >= end) {
+            error = "no end_header";
+            return false;
+        }
+        // The file is mapped, not a C string: only compare bytes that are on this line
+        const char* line_end = next_line(header_end, end);
+        if (static_cast<size_t>(line_end - header_end) >= marker_length
+                && std::memcmp(header_end, marker, marker_length) == 0) {
+            body = line_end;
+            break;
+        }
+        header_end = line_end;
+    }
+
+    std::istringstream header(std::string(begin, header_end));
+    std::string line;
+    std::getline(header, line);
+    if (line.compare(0, 3, "ply") != 0) {
+        error = "not a PLY file";
+        return false;
+    }
+    bool have_format = false;
+    while (std::getline(header, line)) {
+        std::istringstream words(line);
+        std::string keyword;
+        words >> keyword;
+        if (keyword == "format") {
+            std::string format;
+            words >> format;
+            if (format == "binary_little_endian" || format == "binary_big_endian") {
+                big_endian = format == "binary_big_endian";
+                have_format = true;
+            }
+            else {
+                error = "only binary PLY files are supported, not " + format;
+                return false;
+            }
+        }
+        else if (keyword == "element") {
+            ply_element element;
+            words >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if (keyword == "property") {
+            if (elements.empty()) {
+                error = "property outside of an element";
+                return false;
+            }
+            ply_property property;
+            std::string type;
+            words >> type;
+            if (type == "list") {
+                std::string count_type, item_type;
+                words >> count_type >> item_type;
+                property.count_type = ply_type_from_name(count_type);
+                property.type = ply_type_from_name(item_type);
+                if (property.count_type == ply_type::none) {
+                    error = "unknown type " + count_type;
+                    return false;
+                }
+            }
+            else {
+                property.type = ply_type_from_name(type);
+            }
+            if (property.type == ply_type::none) {
+                error = "unknown property type in: " + line;
+                return false;
+            }
+            words >> property.name;
+            elements.back().properties.push_back(property);
+        }
+        // comment and obj_info lines are ignored
+    }
+    if (!have_format) {
+        error = "no format line";
+        return false;
+    }
+
+    for (auto& element : elements) {
+        size_t size = 0;
+        bool fixed = true;
+        for (auto& property : element.properties) {
+            property.offset = size;
+            if (property.count_type != ply_type::none)
+                fixed = false;
+            size += ply_type_size(property.type);
+        }
+        element.record_size = fixed ? size : 0;
+    }
+    return true;
+}
+
+inline bool load_ply(const std::string& path, mesh_data& mesh, int thread_count = 0) {
+    mapped_file file;
+    if (!file.open(path)) {
+        std::clog << "Could not open " << path << std::endl;
+        return false;
+    }
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    std::vector<ply_element> elements;
+    bool big_endian = false;
+    const char* p = nullptr;
+    std::string error;
+    if (!parse_ply_header(begin, end, elements, big_endian, p, error)) {
+        std::clog << path << ": " << error << std::endl;
+        return false;
+    }
+    const uint16_t probe = 1;
+    bool machine_big_endian = *reinterpret_cast<const uint8_t*>(&probe) == 0;
+    bool swap_bytes = big_endian != machine_big_endian;
+
+    thread_pool pool(thread_count);
+    const int block = 1 << 16; // records decoded per parallel_for item
+    auto blocks = [block](size_t count) { return static_cast<int>((count + block - 1) / block); };
+
+    mesh = mesh_data();
+    bool have_vertices = false, have_faces = false;
+    for (const auto& element : elements) {
+        if (element.name == "vertex" && !have_vertices) {
+            int x = element.find("x"), y = element.find("y"), z = element.find("z");
+            int nx = element.find("nx"), ny = element.find("ny"), nz = element.find("nz");
+            if (x < 0 || y < 0 || z < 0 || element.record_size == 0) {
+                std::clog << path << ": vertices need fixed-size x, y and z properties" << std::endl;
+                return false;
+            }
+            if (static_cast<size_t>(end - p) / element.record_size < element.count) {
+                std::clog << path << ": file ends inside the vertex list" << std::endl;
+                return false;
+            }
+            bool normals = nx >= 0 && ny >= 0 && nz >= 0;
+            const auto& props = element.properties;
+            mesh.positions.resize(element.count);
+            if (normals)
+                mesh.normals.resize(element.count);
+            const char* records = p;
+            pool.parallel_for(blocks(element.count), [&](int b, int) {
+                size_t first = static_cast<size_t>(b) * block;
+                size_t last = std::min(first + block, element.count);
+                for (size_t i = first; i < last; ++i) {
+                    const char* record = records + i * element.record_size;
+                    mesh.positions[i] = point3(ply_read(record + props[x].offset, props[x].type, swap_bytes),
+                                               ply_read(record + props[y].offset, props[y].type, swap_bytes),
+                                               ply_read(record + props[z].offset, props[z].type, swap_bytes));
+                    if (normals)
+                        mesh.normals[i] = vec3(ply_read(record + props[nx].offset, props[nx].type, swap_bytes),
+                                               ply_read(record + props[ny].offset, props[ny].type, swap_bytes),
+                                               ply_read(record + props[nz].offset, props[nz].type, swap_bytes));
+                }
+            });
+            p += element.count * element.record_size;
+            have_vertices = true;
+        }
+        else if (element.name == "face" && !have_faces) {
+            int list = element.find("vertex_indices");
+            if (list < 0)
+                list = element.find("vertex_index");
+            if (list < 0 || element.properties[list].count_type == ply_type::none) {
+                std::clog << path << ": faces need a vertex_indices list" << std::endl;
+                return false;
+            }
+            const ply_property& indices = element.properties[list];
+
+            // Scanned meshes are nearly always pure triangle lists. Then every record has
+            // the same size and the faces can be decoded in parallel; check that first and
+            // fall back to walking the records one by one for anything else.
+            bool other_lists = false;
+            size_t before = 0, after = 0;
+            for (size_t k = 0; k < element.properties.size(); ++k) {
+                const auto& property = element.properties[k];
+                if (static_cast<int>(k) == list)
+                    continue;
+                if (property.count_type != ply_type::none)
+                    other_lists = true;
+                (static_cast<int>(k) < list ? before : after) += ply_type_size(property.type);
+            }
+            size_t count_size = ply_type_size(indices.count_type);
+            size_t index_size = ply_type_size(indices.type);
+            size_t triangle_record = before + count_size + 3 * index_size + after;
+
+            bool all_triangles = !other_lists && static_cast<size_t>(end - p) / triangle_record >= element.count;
+            if (all_triangles) {
+                std::vector<char> block_ok(blocks(element.count), 1);
+                const char* records = p;
+                pool.parallel_for(blocks(element.count), [&](int b, int) {
+                    size_t first = static_cast<size_t>(b) * block;
+                    size_t last = std::min(first + block, element.count);
+                    for (size_t i = first; i < last; ++i)
+                        if (ply_read(records + i * triangle_record + before, indices.count_type, swap_bytes) != 3)
+                            block_ok[b] = 0;
+                });
+                for (char ok : block_ok)
+                    all_triangles = all_triangles && ok;
+            }
+
+            if (all_triangles) {
+                mesh.indices.resize(3 * element.count);
+                const char* records = p;
+                pool.parallel_for(blocks(element.count), [&](int b, int) {
+                    size_t first = static_cast<size_t>(b) * block;
+                    size_t last = std::min(first + block, element.count);
+                    for (size_t i = first; i < last; ++i) {
+                        const char* items = records + i * triangle_record + before + count_size;
+                        for (int c = 0; c < 3; ++c)
+                            mesh.indices[3*i + c] = static_cast<uint32_t>(ply_read(items + c * index_size, indices.type, swap_bytes));
+                    }
+                });
+                p += element.count * triangle_record;
+            }
+            else {
+                mesh.indices.reserve(3 * element.count);
+                for (size_t i = 0; i < element.count; ++i) {
+                    // Once the whole record is known to fit, every count inside it can be read
+                    size_t record_size;
+                    if (!element.size_of(p, end, swap_bytes, record_size)) {
+                        std::clog << path << ": file ends inside the face list" << std::endl;
+                        return false;
+                    }
+                    const char* list_start = p;
+                    for (int k = 0; k < list; ++k)
+                        list_start += element.properties[k].count_type == ply_type::none
+                            ? ply_type_size(element.properties[k].type)
+                            : ply_type_size(element.properties[k].count_type)
+                              + ply_type_size(element.properties[k].type)
+                                * static_cast<size_t>(ply_read(list_start, element.properties[k].count_type, swap_bytes));
+                    size_t corners = static_cast<size_t>(ply_read(list_start, indices.count_type, swap_bytes));
+                    const char* items = list_start + count_size;
+                    for (size_t c = 1; c + 1 < corners; ++c) {
+                        mesh.indices.push_back(static_cast<uint32_t>(ply_read(items, indices.type, swap_bytes)));
+                        mesh.indices.push_back(static_cast<uint32_t>(ply_read(items + c * index_size, indices.type, swap_bytes)));
+                        mesh.indices.push_back(static_cast<uint32_t>(ply_read(items + (c + 1) * index_size, indices.type, swap_bytes)));
+                    }
+                    p += record_size;
+                }
+            }
+            have_faces = true;
+        }
+        else {
+            // Some other element (edges, materials, ...): skip it
+            for (size_t i = 0; i < element.count; ++i) {
+                size_t record_size;
+                if (!element.size_of(p, end, swap_bytes, record_size)) {
+                    std::clog << path << ": file ends inside element " << element.name << std::endl;
+                    return false;
+                }
+                p += record_size;
+            }
+        }
+        if (p > end) {
+            std::clog << path << ": file ends inside element " << element.name << std::endl;
+            return false;
+        }
+    }
+
+    for (uint32_t index : mesh.indices) {
+        if (index >= mesh.positions.size()) {
+            std::clog << path << ": face refers to a missing vertex" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool load_mesh(const std::string& path, mesh_data& mesh, int thread_count = 0) {
+    // Picks the loader from the file extension
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    for (auto& c : extension)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    if (extension == "obj")
+        return load_obj(path, mesh, thread_count);
+    if (extension == "ply")
+        return load_ply(path, mesh, thread_count);
+    std::clog << "Unknown mesh format: " << path << std::endl;
+    return false;
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include "common.h"
+
+#include "aabb.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Morton codes and the radix sort that orders items by them, shared by the LBVH builder
+// (bvh.h) and ray reordering in the wavefront integrator (wavefront.h).
+
+inline uint32_t spread_bits(uint32_t x) {
+    // Moves bit k of a 10 bit number to bit 3k
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x <<  8)) & 0x0300F00F;
+    x = (x | (x <<  4)) & 0x030C30C3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+}
+
+inline uint32_t morton_code(const point3& p, const aabb& box, int bits) {
+    // Interleaves the cell coordinates of p on a grid of 2^bits cells per axis spanning box
+    // (bits at most 10), x in the highest bit of each triple. Points outside the box get the
+    // nearest cell.
+    const real cells = static_cast<real>(1u << bits);
+    uint32_t code = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        const interval& extent = box.axis(axis);
+        real offset = extent.size() > 0 ? (p[axis] - extent.min) / extent.size() : 0;
+        uint32_t cell = static_cast<uint32_t>(interval(0, cells - 1).clamp(offset * cells));
+        code |= spread_bits(cell) << (2 - axis);
+    }
+    return code;
+}
+
+template <typename chunk_function>
+inline void for_each_key_chunk(thread_pool* pool, int count, int chunks, const chunk_function& body) {
+    // Calls body(chunk_begin, chunk_end, chunk) for `chunks` consecutive chunks of [0, count)
+    if (chunks == 1) {
+        body(0, count, 0);
+        return;
+    }
+    pool->parallel_for(chunks, [&](int k, int) {
+        body(static_cast<int>(static_cast<long long>(count) * k / chunks),
+             static_cast<int>(static_cast<long long>(count) * (k + 1) / chunks), k);
+    });
+}
+
+inline void sort_morton_keys(std::vector<uint64_t>& keys, std::vector<uint64_t>& scratch,
+                             thread_pool* pool = nullptr, int chunks = 1) {
+    // Sorts keys by their upper 32 bits, where the callers keep a Morton code (the lower
+    // half is usually the item's index), with an LSD radix sort in four passes of 8 bits.
+    // Keys with equal codes keep their order. With a pool the keys are cut into `chunks`
+    // consecutive chunks; each counts its digits, then scatters its keys to the positions
+    // the counts give it.
+    const int radix = 256;
+    int count = static_cast<int>(keys.size());
+    if (!pool || chunks < 1)
+        chunks = 1;
+
+    scratch.resize(count);
+    std::vector<int> offsets(chunks * radix);
+    for (int shift = 32; shift < 64; shift += 8) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for_each_key_chunk(pool, count, chunks, [&](int begin, int end, int k) {
+            for (int i = begin; i < end; ++i)
+                ++offsets[k * radix + ((keys[i] >> shift) & (radix - 1))];
+        });
+        int position = 0;
+        for (int digit = 0; digit < radix; ++digit) {
+            for (int k = 0; k < chunks; ++k) {
+                int n = offsets[k * radix + digit];
+                offsets[k * radix + digit] = position;
+                position += n;
+            }
+        }
+        for_each_key_chunk(pool, count, chunks, [&](int begin, int end, int k) {
+            for (int i = begin; i < end; ++i)
+                scratch[offsets[k * radix + ((keys[i] >> shift) & (radix - 1))]++] = keys[i];
+        });
+        keys.swap(scratch);
+    }
+}
+
+#endif
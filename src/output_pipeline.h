@@ -0,0 +1,95 @@
+#ifndef OUTPUT_PIPELINE_H
+#define OUTPUT_PIPELINE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class output_pipeline {
+    // Background image encoding. Finished frames are submitted as jobs which dedicated
+    // writer threads encode and write to disk while the render threads move on to the
+    // next frame. The queue is bounded: submit() blocks while max_queued jobs are already
+    // waiting, so at most max_queued + writer_threads finished frames are held in memory.
+    public:
+    explicit output_pipeline(int writer_threads = 1, int max_queued = 2)
+        : max_waiting(max_queued > 0 ? max_queued : 1) {
+        int count = writer_threads > 0 ? writer_threads : 1;
+        for (int w = 0; w < count; ++w)
+            writers.emplace_back(&output_pipeline::writer_loop, this);
+    }
+
+    ~output_pipeline() {
+        finish();
+    }
+
+    output_pipeline(const output_pipeline&) = delete;
+    output_pipeline& operator=(const output_pipeline&) = delete;
+
+    void submit(std::function<void()> job) {
+        std::unique_lock<std::mutex> guard(lock);
+        space_available.wait(guard, [this] { return static_cast<int>(jobs.size()) < max_waiting; });
+        jobs.push_back(std::move(job));
+        job_available.notify_one();
+    }
+
+    void wait_idle() {
+        // Blocks until every submitted job has been written
+        std::unique_lock<std::mutex> guard(lock);
+        idle.wait(guard, [this] { return jobs.empty() && running == 0; });
+    }
+
+    void finish() {
+        // Writes out everything still queued and stops the writer threads
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (stopping)
+                return;
+            stopping = true;
+        }
+        job_available.notify_all();
+        for (auto& writer : writers)
+            writer.join();
+    }
+
+    private:
+    int max_waiting;
+    std::vector<std::thread> writers;
+
+    std::mutex lock;                         // guards everything below
+    std::condition_variable job_available;   // a job was queued or the pipeline is stopping
+    std::condition_variable space_available; // a job left the queue
+    std::condition_variable idle;            // the queue drained and no job is running
+    std::deque<std::function<void()>> jobs;
+    int running = 0;
+    bool stopping = false;
+
+    void writer_loop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                job_available.wait(guard, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return; // stopping and nothing left to write
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                ++running;
+            }
+            space_available.notify_one();
+
+            job();
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                --running;
+                if (jobs.empty() && running == 0)
+                    idle.notify_all();
+            }
+        }
+    }
+};
+
+#endif
@@ -15,7 +15,7 @@ class ray {
     point3 origin() const { return orig; }
     vec3 direction() const { return dir; }
 
-    point3 at(double t) const {
+    point3 at(real t) const {
         // Return coordintes of ray parameteri
         return orig + t*dir;
     }
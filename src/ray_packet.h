@@ -0,0 +1,147 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "common.h"
+
+#include "aabb.h"
+#include "ray.h"
+#include "simd.h"
+
+#include <cmath>
+#include <cstdint>
+
+struct ray_packet {
+    // Up to 64 rays traced together, e.g. the camera rays of an 8x8 block of pixels (see
+    // camera::render_tile_packets). Sets of rays are passed around as 64-bit masks, bit k
+    // standing for ray k. Besides the rays themselves the packet keeps their origins and
+    // reciprocal directions as a structure of arrays, so the kernels in
+    // ray_packet_kernel.h test several rays per SIMD instruction against one box or
+    // sphere, and bounds on all of them for the frustum test.
+    static const int max_size = 64;
+
+    simd_level level = best_simd_level(); // kernel used by packet_box_hits and packet_sphere_hits
+    int size = 0;
+    ray rays[max_size];
+    real t_max[max_size];       // end of each ray's interval, lowered to the closest hit found
+    uint64_t hits = 0;          // rays with a hit, whose hit_record has been written
+
+    real origin[3][max_size];
+    real direction[3][max_size];
+    real inv_direction[3][max_size];
+    real length_squared[max_size];
+
+    // Set by finish(). The frustum is only formed on axes along which every ray's
+    // direction has the same sign (frustum_axis), where a box's entry and exit distances
+    // are bounded by those of the packet's extreme rays.
+    bool frustum_axis[3];
+    real origin_min[3], origin_max[3];
+    real inv_min[3], inv_max[3];
+    bool direction_negative[3]; // per axis, to pick the near child during traversal
+
+    ray_packet() {
+        // The kernels work on whole groups of rays, so unused slots must hold numbers too
+        for (int k = 0; k < max_size; ++k) {
+            for (int a = 0; a < 3; ++a)
+                origin[a][k] = direction[a][k] = inv_direction[a][k] = 0;
+            length_squared[k] = 0;
+            t_max[k] = 0;
+        }
+    }
+
+    void clear() {
+        size = 0;
+        hits = 0;
+    }
+
+    int add(const ray& r, real ray_t_max) {
+        // Returns the ray's index in the packet, which must not be full
+        int k = size++;
+        rays[k] = r;
+        t_max[k] = ray_t_max;
+        point3 o = r.origin();
+        vec3 d = r.direction();
+        for (int a = 0; a < 3; ++a) {
+            origin[a][k] = o[a];
+            direction[a][k] = d[a];
+            inv_direction[a][k] = 1/d[a];
+        }
+        length_squared[k] = d.length_squared();
+        return k;
+    }
+
+    void finish() {
+        // Computes the frustum once all rays have been added
+        for (int a = 0; a < 3; ++a) {
+            origin_min[a] = origin_max[a] = origin[a][0];
+            inv_min[a] = inv_max[a] = inv_direction[a][0];
+            bool positive = true, negative = true;
+            for (int k = 0; k < size; ++k) {
+                origin_min[a] = fmin(origin_min[a], origin[a][k]);
+                origin_max[a] = fmax(origin_max[a], origin[a][k]);
+                inv_min[a] = fmin(inv_min[a], inv_direction[a][k]);
+                inv_max[a] = fmax(inv_max[a], inv_direction[a][k]);
+                // Axis-parallel rays (an infinite reciprocal) leave the axis out
+                positive = positive && inv_direction[a][k] > 0 && std::isfinite(inv_direction[a][k]);
+                negative = negative && inv_direction[a][k] < 0 && std::isfinite(inv_direction[a][k]);
+            }
+            frustum_axis[a] = size > 0 && (positive || negative);
+            direction_negative[a] = size > 0 && inv_direction[a][0] < 0;
+        }
+    }
+
+    uint64_t all() const {
+        return size == max_size ? ~uint64_t(0) : (uint64_t(1) << size) - 1;
+    }
+
+    bool coherent() const {
+        // Packets without a single frustum axis go through the scene one ray at a time
+        return frustum_axis[0] || frustum_axis[1] || frustum_axis[2];
+    }
+
+    bool frustum_may_hit(const aabb& box, real t_min) const {
+        // Conservative test of the whole packet against a box: false only when no ray can
+        // pass aabb::hit. Per axis the entry and exit distances (slab - origin) * inv are
+        // bounded by evaluating them at the corners of the origin and reciprocal ranges.
+        // Rounding is monotonic, so the corners also bound each ray's rounded distances.
+        const real far_scale = aabb::slab_far_scale();
+        real t_max = infinity;
+        for (int a = 0; a < 3; ++a) {
+            if (!frustum_axis[a])
+                continue;
+            const interval& slab = box.axis(a);
+            real near_plane = direction_negative[a] ? slab.max : slab.min;
+            real far_plane = direction_negative[a] ? slab.min : slab.max;
+
+            real n0 = near_plane - origin_max[a], n1 = near_plane - origin_min[a];
+            real t0 = fmin(fmin(n0 * inv_min[a], n0 * inv_max[a]), fmin(n1 * inv_min[a], n1 * inv_max[a]));
+            real f0 = far_plane - origin_max[a], f1 = far_plane - origin_min[a];
+            real t1 = fmax(fmax(f0 * inv_min[a], f0 * inv_max[a]), fmax(f1 * inv_min[a], f1 * inv_max[a]));
+            t1 *= far_scale;
+
+            if (t0 > t_min) t_min = t0;
+            if (t1 < t_max) t_max = t1;
+            if (t_max <= t_min)
+                return false;
+        }
+        return true;
+    }
+};
+
+#define RAY_BANDIT_KERNEL_FILE "ray_packet_kernel.h"
+#include "isa_kernels.h"
+
+inline uint64_t packet_box_hits(const ray_packet& packet, const aabb& box, real t_min, uint64_t rays) {
+    // The rays in the mask rays that pass aabb::hit over (t_min, their t_max)
+    simd_level kernel = simd_level_supported(packet.level) ? packet.level : best_simd_level();
+    return RAY_BANDIT_SIMD_DISPATCH(kernel, box_hits(packet, box, t_min, rays));
+}
+
+inline uint64_t packet_sphere_hits(const ray_packet& packet, const point3& center, real radius, real t_min,
+                                   uint64_t rays, real* roots) {
+    // The rays in the mask rays that hit the sphere within (t_min, their t_max), with the
+    // root sphere_shape::hit would find stored in roots[k]
+    simd_level kernel = simd_level_supported(packet.level) ? packet.level : best_simd_level();
+    return RAY_BANDIT_SIMD_DISPATCH(kernel, sphere_hits(packet, center, radius, t_min, rays, roots));
+}
+
+#endif
@@ -0,0 +1,109 @@
+// Vectorized packet tests of ray_packet.h, written against a `lanes` type that wraps one
+// SIMD instruction set. ray_packet.h builds this file once per instruction set through
+// isa_kernels.h, so there is deliberately no include guard.
+//
+// Unlike the kernels of sphere_batch and triangle_block, each lane holds a different ray
+// and the box or sphere is the same in all of them. The arithmetic mirrors aabb::hit and
+// sphere_shape::hit operation for operation, so a ray gets the same answer here as from
+// the scalar code.
+
+inline uint64_t box_hits(const ray_packet& packet, const aabb& box, real t_min, uint64_t rays) {
+    typedef typename lanes::value value;
+    typedef typename lanes::mask mask;
+
+    const uint64_t group_rays = (uint64_t(1) << lanes::width) - 1;
+    const value zero = lanes::broadcast(0);
+    const value far_scale = lanes::broadcast(aabb::slab_far_scale());
+    const value t_min_lanes = lanes::broadcast(t_min);
+
+    uint64_t result = 0;
+    for (int first = 0; first < packet.size; first += lanes::width) {
+        if (((rays >> first) & group_rays) == 0)
+            continue;
+
+        value low = t_min_lanes;
+        value high = lanes::load(packet.t_max + first);
+        for (int a = 0; a < 3; ++a) {
+            value o = lanes::load(packet.origin[a] + first);
+            value inv = lanes::load(packet.inv_direction[a] + first);
+            value t0 = lanes::mul(lanes::sub(lanes::broadcast(box.axis(a).min), o), inv);
+            value t1 = lanes::mul(lanes::sub(lanes::broadcast(box.axis(a).max), o), inv);
+            mask negative = lanes::less(inv, zero);
+            value entry = lanes::select(negative, t1, t0);
+            value exit = lanes::mul(lanes::select(negative, t0, t1), far_scale);
+            // Comparisons with NaN are false, so 0 * inf leaves the interval alone as in aabb::hit
+            low = lanes::select(lanes::greater(entry, low), entry, low);
+            high = lanes::select(lanes::less(exit, high), exit, high);
+        }
+        result |= static_cast<uint64_t>(lanes::bits(lanes::less(low, high))) << first;
+    }
+    return result & rays;
+}
+
+inline uint64_t sphere_hits(const ray_packet& packet, const point3& center, real radius, real t_min,
+                            uint64_t rays, real* roots) {
+    typedef typename lanes::value value;
+    typedef typename lanes::mask mask;
+
+    const uint64_t group_rays = (uint64_t(1) << lanes::width) - 1;
+    const value center_x = lanes::broadcast(center[0]);
+    const value center_y = lanes::broadcast(center[1]);
+    const value center_z = lanes::broadcast(center[2]);
+    const value rad = lanes::broadcast(radius);
+    const value rad_squared = lanes::mul(rad, rad);
+    const value zero = lanes::broadcast(0);
+    const value negative_zero = lanes::broadcast(-static_cast<real>(0));
+    const value t_min_lanes = lanes::broadcast(t_min);
+
+    uint64_t result = 0;
+    for (int first = 0; first < packet.size; first += lanes::width) {
+        if (((rays >> first) & group_rays) == 0)
+            continue;
+
+        value direction_x = lanes::load(packet.direction[0] + first);
+        value direction_y = lanes::load(packet.direction[1] + first);
+        value direction_z = lanes::load(packet.direction[2] + first);
+        value oc_x = lanes::sub(lanes::load(packet.origin[0] + first), center_x);
+        value oc_y = lanes::sub(lanes::load(packet.origin[1] + first), center_y);
+        value oc_z = lanes::sub(lanes::load(packet.origin[2] + first), center_z);
+        value a = lanes::load(packet.length_squared + first);
+
+        value half_b = lanes::add(lanes::add(lanes::mul(oc_x, direction_x), lanes::mul(oc_y, direction_y)),
+                                  lanes::mul(oc_z, direction_z));
+        value closest_x = lanes::sub(lanes::mul(a, oc_x), lanes::mul(half_b, direction_x));
+        value closest_y = lanes::sub(lanes::mul(a, oc_y), lanes::mul(half_b, direction_y));
+        value closest_z = lanes::sub(lanes::mul(a, oc_z), lanes::mul(half_b, direction_z));
+        value closest_squared = lanes::add(lanes::add(lanes::mul(closest_x, closest_x), lanes::mul(closest_y, closest_y)),
+                                           lanes::mul(closest_z, closest_z));
+        value scaled_discriminant = lanes::sub(lanes::mul(lanes::mul(lanes::mul(a, a), rad), rad), closest_squared);
+
+        mask crossing = lanes::not_less(scaled_discriminant, zero);
+        if (lanes::bits(crossing) == 0)
+            continue; // none of these rays reach the sphere
+
+        value c = lanes::sub(lanes::add(lanes::add(lanes::mul(oc_x, oc_x), lanes::mul(oc_y, oc_y)),
+                                        lanes::mul(oc_z, oc_z)),
+                             rad_squared);
+        value sqrtd = lanes::sqrt(lanes::div(scaled_discriminant, a));
+        value minus_half_b = lanes::sub(negative_zero, half_b); // exact negation, also of 0
+        value q = lanes::select(lanes::greater(half_b, zero),
+                                lanes::sub(minus_half_b, sqrtd), lanes::add(minus_half_b, sqrtd));
+        value near_root = lanes::div(q, a);
+        value far_root = lanes::div(c, q);
+        mask swapped = lanes::greater(near_root, far_root);
+        value low = lanes::select(swapped, far_root, near_root);
+        value high = lanes::select(swapped, near_root, far_root);
+
+        value t_max = lanes::load(packet.t_max + first);
+        mask low_inside = lanes::both(lanes::less(t_min_lanes, low), lanes::less(low, t_max));
+        value root = lanes::select(low_inside, low, high);
+        mask inside = lanes::both(crossing, lanes::both(lanes::less(t_min_lanes, root), lanes::less(root, t_max)));
+
+        unsigned hits = lanes::bits(inside);
+        if (hits == 0)
+            continue;
+        lanes::store(roots + first, root);
+        result |= static_cast<uint64_t>(hits) << first;
+    }
+    return result & rays;
+}
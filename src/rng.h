@@ -0,0 +1,162 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+// Random number generation.
+//
+// Every thread owns its own generator, so drawing a number never touches shared state.
+// While rendering, the generator is reseeded from a key made of (render seed, pixel,
+// sample, bounce) at the start of every camera sample and every bounce. A given path
+// therefore always sees the same random numbers no matter which thread traces it or in
+// which order the tiles are scheduled, so renders are bit-reproducible at any thread count.
+//
+// The engine is chosen at compile time. pcg32 is the default; define RAY_BANDIT_RNG_PHILOX
+// to use the counter-based philox4x32 instead. Both provide seed(key, stream),
+// next_uint() and next_double().
+
+inline uint64_t mix64(uint64_t z) {
+    // splitmix64 finalizer, used to turn structured keys into well spread seeds
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+inline double uint_to_double(uint32_t x) {
+    // Maps 32 random bits to a double in [0, 1)
+    return x * (1.0 / 4294967296.0);
+}
+
+class pcg32 {
+    // PCG-XSH-RR (O'Neill 2014): a 64-bit LCG whose output is permuted down to 32 bits.
+    // Each odd increment selects an independent stream.
+    public:
+    pcg32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+
+    void seed(uint64_t key, uint64_t stream) {
+        state = 0;
+        increment = (stream << 1) | 1;
+        next_uint();
+        state += key;
+        next_uint();
+    }
+
+    uint32_t next_uint() {
+        uint64_t old_state = state;
+        state = old_state * 6364136223846793005ULL + increment;
+        uint32_t xorshifted = static_cast<uint32_t>(((old_state >> 18) ^ old_state) >> 27);
+        uint32_t rotation = static_cast<uint32_t>(old_state >> 59);
+        return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+    }
+
+    double next_double() { return uint_to_double(next_uint()); }
+
+    private:
+    uint64_t state;
+    uint64_t increment;
+};
+
+class philox4x32 {
+    // Philox4x32-10 (Salmon et al. 2011). Counter-based: the n-th output is a pure function
+    // of (key, stream, n), so any position in a stream can be reached without stepping
+    // through the ones before it. Blocks of four outputs are generated at a time.
+    public:
+    philox4x32() { seed(0, 0); }
+
+    void seed(uint64_t key, uint64_t stream) {
+        key0 = static_cast<uint32_t>(key);
+        key1 = static_cast<uint32_t>(key >> 32);
+        counter_stream = stream;
+        block_index = 0;
+        buffered = 4;
+    }
+
+    uint32_t next_uint() {
+        if (buffered == 4) {
+            generate_block();
+            buffered = 0;
+        }
+        return block[buffered++];
+    }
+
+    double next_double() { return uint_to_double(next_uint()); }
+
+    private:
+    uint32_t key0, key1;
+    uint64_t counter_stream;
+    uint64_t block_index;
+    uint32_t block[4];
+    int buffered;
+
+    static void mul_hi_lo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+        uint64_t product = static_cast<uint64_t>(a) * b;
+        hi = static_cast<uint32_t>(product >> 32);
+        lo = static_cast<uint32_t>(product);
+    }
+
+    void generate_block() {
+        uint32_t c[4] = {
+            static_cast<uint32_t>(block_index), static_cast<uint32_t>(block_index >> 32),
+            static_cast<uint32_t>(counter_stream), static_cast<uint32_t>(counter_stream >> 32)
+        };
+        uint32_t k0 = key0, k1 = key1;
+        for (int round = 0; round < 10; ++round) {
+            uint32_t hi0, lo0, hi1, lo1;
+            mul_hi_lo(0xD2511F53u, c[0], hi0, lo0);
+            mul_hi_lo(0xCD9E8D57u, c[2], hi1, lo1);
+            c[0] = hi1 ^ c[1] ^ k0;
+            c[1] = lo1;
+            c[2] = hi0 ^ c[3] ^ k1;
+            c[3] = lo0;
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+        for (int i = 0; i < 4; ++i)
+            block[i] = c[i];
+        ++block_index;
+    }
+};
+
+#ifdef RAY_BANDIT_RNG_PHILOX
+typedef philox4x32 rng_engine;
+#else
+typedef pcg32 rng_engine;
+#endif
+
+struct rng_path_key {
+    // Identifies the camera sample the current thread is tracing
+    uint64_t seed;
+    uint64_t pixel;
+    uint32_t sample;
+};
+
+inline rng_engine& thread_rng() {
+    static thread_local rng_engine engine;
+    return engine;
+}
+
+inline rng_path_key& thread_rng_key() {
+    static thread_local rng_path_key key = {0, 0, 0};
+    return key;
+}
+
+inline void rng_begin_bounce(uint32_t bounce) {
+    // Reseeds this thread's generator for the given bounce of the current path.
+    // Bounce 0 is used for the camera ray itself.
+    const rng_path_key& key = thread_rng_key();
+    uint64_t path = mix64(key.seed ^ mix64(key.pixel));
+    uint64_t sample_bounce = (static_cast<uint64_t>(key.sample) << 32) | bounce;
+    thread_rng().seed(mix64(path ^ sample_bounce), path);
+}
+
+inline void rng_begin_sample(uint64_t seed, uint64_t pixel, uint32_t sample) {
+    // Starts the random stream of one camera sample
+    rng_path_key& key = thread_rng_key();
+    key.seed = seed;
+    key.pixel = pixel;
+    key.sample = sample;
+    rng_begin_bounce(0);
+}
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rng.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Sample sequences for the 2D decisions of a path: pixel jitter, lens position and the
+// scatter direction of every bounce.
+//
+// Each of these decisions reads one "dimension pair" of the active sequence: pair 0 is the
+// pixel jitter, pair 1 the lens sample, and bounce b starts at pair 2b. With independent
+// sampling every pair is just two fresh random numbers. The other samplers spread the
+// sample_size samples of a pixel evenly over each pair, which converges much faster than
+// independent sampling, so the same image quality needs far fewer samples per pixel.
+//
+// Like the RNG, the sampler state lives in thread locals so materials can draw from it
+// without it being threaded through every scatter call.
+
+enum class sampler_type {
+    independent, // uniform random numbers, the original behaviour
+    stratified,  // jittered grid with a per-pixel random order of the strata
+    sobol,       // Owen-scrambled Sobol (0,2) sequence, decorrelated per pixel
+    blue_noise   // one shared scrambled Sobol sequence, shifted per pixel by a blue noise mask
+                 // so the remaining error is spread as high-frequency, less visible noise
+};
+
+inline uint32_t reverse_bits(uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+inline uint32_t sobol_dimension_1(uint32_t index) {
+    // Second dimension of the Sobol sequence (primitive polynomial x + 1). The first
+    // dimension is the van der Corput sequence, i.e. reverse_bits(index).
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1) {
+        if (index & 1)
+            result ^= v;
+    }
+    return result;
+}
+
+inline uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+    // Hash-based nested uniform scramble (Burley 2020, after Laine and Karras). Every bit
+    // is flipped depending on the bits above it, which keeps the stratification of the
+    // (0,2) sequence intact while randomizing it.
+    x = reverse_bits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits(x);
+}
+
+inline uint32_t kensler_permute(uint32_t i, uint32_t length, uint32_t seed) {
+    // Maps i in [0, length) to a random permutation of [0, length) chosen by seed
+    // (Kensler 2013, "Correlated Multi-Jittered Sampling")
+    uint32_t w = length - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;             i *= 0xe170893du;
+        i ^= seed >> 16;       i ^= (i & w) >> 4;
+        i ^= seed >> 8;        i *= 0x0929eb3fu;
+        i ^= seed >> 23;       i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;   i *= 0x6935fa69u;
+        i ^= (i & w) >> 11;    i *= 0x74dcb303u;
+        i ^= (i & w) >> 2;     i *= 0x9e501cc3u;
+        i ^= (i & w) >> 2;     i *= 0xc860a3dfu;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= length);
+    return (i + seed) % length;
+}
+
+class blue_noise_mask {
+    // Tileable 64x64 blue noise threshold masks built with the void-and-cluster method
+    // (Ulichney 1993). The masks are generated once, the first time they are needed.
+    public:
+    static const int size = 64;
+
+    static const blue_noise_mask& get(int which) {
+        static const blue_noise_mask masks[2] = { blue_noise_mask(0x1234), blue_noise_mask(0xbeef) };
+        return masks[which & 1];
+    }
+
+    double at(uint32_t x, uint32_t y) const {
+        return values[(y % size) * size + (x % size)];
+    }
+
+    private:
+    std::vector<double> values;
+
+    explicit blue_noise_mask(uint64_t seed) {
+        const int n = size * size;
+        const double sigma = 1.5;
+
+        // Gaussian energy kernel over toroidal distances
+        std::vector<double> kernel(n);
+        for (int dy = 0; dy < size; ++dy) {
+            for (int dx = 0; dx < size; ++dx) {
+                int wx = dx < size/2 ? dx : size - dx;
+                int wy = dy < size/2 ? dy : size - dy;
+                kernel[dy * size + dx] = std::exp(-(wx*wx + wy*wy) / (2 * sigma * sigma));
+            }
+        }
+
+        std::vector<char> filled(n, 0);
+        std::vector<double> energy(n, 0.0);
+        auto splat = [&](int p, double sign) {
+            int px = p % size, py = p / size;
+            for (int q = 0; q < n; ++q) {
+                int dx = (q % size - px + size) % size;
+                int dy = (q / size - py + size) % size;
+                energy[q] += sign * kernel[dy * size + dx];
+            }
+        };
+        auto extreme = [&](char state, bool largest) {
+            // Tightest cluster (largest energy among filled) or largest void (smallest
+            // energy among empty)
+            int best = -1;
+            for (int q = 0; q < n; ++q) {
+                if (filled[q] != state)
+                    continue;
+                if (best < 0 || (largest ? energy[q] > energy[best] : energy[q] < energy[best]))
+                    best = q;
+            }
+            return best;
+        };
+
+        // Random initial pattern with a tenth of the cells set
+        pcg32 rng;
+        rng.seed(seed, 0);
+        int initial = n / 10;
+        for (int placed = 0; placed < initial;) {
+            int p = static_cast<int>(rng.next_uint() % n);
+            if (!filled[p]) {
+                filled[p] = 1;
+                splat(p, 1);
+                ++placed;
+            }
+        }
+
+        // Spread it out: move the tightest cluster into the largest void until that
+        // stops changing anything
+        while (true) {
+            int cluster = extreme(1, true);
+            filled[cluster] = 0;
+            splat(cluster, -1);
+            int hole = extreme(0, false);
+            filled[hole] = 1;
+            splat(hole, 1);
+            if (hole == cluster)
+                break;
+        }
+
+        // Rank the initial points by removing tightest clusters, then rank the rest by
+        // filling the largest voids
+        std::vector<int> rank(n, 0);
+        std::vector<char> prototype = filled;
+        std::vector<double> prototype_energy = energy;
+        for (int r = initial - 1; r >= 0; --r) {
+            int cluster = extreme(1, true);
+            filled[cluster] = 0;
+            splat(cluster, -1);
+            rank[cluster] = r;
+        }
+        filled = prototype;
+        energy = prototype_energy;
+        for (int r = initial; r < n; ++r) {
+            int hole = extreme(0, false);
+            filled[hole] = 1;
+            splat(hole, 1);
+            rank[hole] = r;
+        }
+
+        values.resize(n);
+        for (int q = 0; q < n; ++q)
+            values[q] = (rank[q] + 0.5) / n;
+    }
+};
+
+struct sample_state {
+    // The camera sample the current thread is tracing, as seen by the sampler
+    sampler_type type;
+    uint32_t seed;
+    uint32_t pixel_x, pixel_y;
+    uint32_t pixel_hash;
+    uint32_t index;     // sample number within the pixel
+    uint32_t count;     // samples per pixel, used to size the strata
+    uint32_t dimension; // next dimension pair to hand out
+};
+
+inline sample_state& thread_sample_state() {
+    static thread_local sample_state state = { sampler_type::independent, 0, 0, 0, 0, 0, 1, 0 };
+    return state;
+}
+
+inline void begin_camera_sample(sampler_type type, uint64_t seed, int x, int y, int width,
+                                int sample, int samples_per_pixel) {
+    // Starts both the random stream and the sample sequence of one camera sample
+    uint64_t pixel = static_cast<uint64_t>(y) * width + x;
+    rng_begin_sample(seed, pixel, static_cast<uint32_t>(sample));
+
+    sample_state& state = thread_sample_state();
+    state.type = type;
+    state.seed = static_cast<uint32_t>(mix64(seed));
+    state.pixel_x = static_cast<uint32_t>(x);
+    state.pixel_y = static_cast<uint32_t>(y);
+    state.pixel_hash = static_cast<uint32_t>(mix64(seed ^ mix64(pixel)));
+    state.index = static_cast<uint32_t>(sample);
+    state.count = static_cast<uint32_t>(samples_per_pixel > 0 ? samples_per_pixel : 1);
+    state.dimension = 0;
+}
+
+inline void begin_bounce(int bounce) {
+    // Moves the random stream and the sample sequence on to the given bounce
+    rng_begin_bounce(static_cast<uint32_t>(bounce));
+    thread_sample_state().dimension = 2 * static_cast<uint32_t>(bounce);
+}
+
+inline void resume_camera_sample(sampler_type type, uint64_t seed, int x, int y, int width,
+                                 int sample, int samples_per_pixel, int bounce) {
+    // Picks a camera sample up again at the given bounce, for integrators that switch
+    // between many paths on one thread: the streams continue exactly as they would have
+    // after begin_camera_sample and begin_bounce(bounce). The generator is only seeded for
+    // the bounce, not for the camera ray first.
+    uint64_t pixel = static_cast<uint64_t>(y) * width + x;
+    rng_path_key& key = thread_rng_key();
+    key.seed = seed;
+    key.pixel = pixel;
+    key.sample = static_cast<uint32_t>(sample);
+    rng_begin_bounce(static_cast<uint32_t>(bounce));
+
+    sample_state& state = thread_sample_state();
+    state.type = type;
+    state.seed = static_cast<uint32_t>(mix64(seed));
+    state.pixel_x = static_cast<uint32_t>(x);
+    state.pixel_y = static_cast<uint32_t>(y);
+    state.pixel_hash = static_cast<uint32_t>(mix64(seed ^ mix64(pixel)));
+    state.index = static_cast<uint32_t>(sample);
+    state.count = static_cast<uint32_t>(samples_per_pixel > 0 ? samples_per_pixel : 1);
+    state.dimension = 2 * static_cast<uint32_t>(bounce);
+}
+
+inline void stratified_grid(int samples_per_pixel, uint32_t& columns, uint32_t& rows) {
+    // The columns x rows grid of strata the stratified sampler lays over a pixel's samples
+    uint32_t count = static_cast<uint32_t>(samples_per_pixel > 0 ? samples_per_pixel : 1);
+    columns = static_cast<uint32_t>(std::sqrt(static_cast<double>(count)));
+    rows = count / columns;
+}
+
+inline void sample_2d(double& u1, double& u2) {
+    // Next 2D sample in [0, 1)^2 of the active sequence
+    sample_state& state = thread_sample_state();
+    uint32_t pair = state.dimension++;
+
+    switch (state.type) {
+    case sampler_type::stratified: {
+        uint32_t columns, rows;
+        stratified_grid(static_cast<int>(state.count), columns, rows);
+        uint32_t strata = columns * rows;
+        if (state.index < strata) {
+            uint32_t stratum = kensler_permute(state.index, strata,
+                                               static_cast<uint32_t>(mix64(state.pixel_hash ^ (uint64_t(pair) << 32))));
+            u1 = ((stratum % columns) + thread_rng().next_double()) / columns;
+            u2 = ((stratum / columns) + thread_rng().next_double()) / rows;
+            return;
+        }
+        // samples beyond the last full grid are placed at random
+        break;
+    }
+    case sampler_type::sobol: {
+        uint32_t pair_hash = static_cast<uint32_t>(mix64(state.pixel_hash ^ (uint64_t(pair) << 32)));
+        uint32_t index = owen_scramble(state.index, pair_hash);
+        u1 = uint_to_double(owen_scramble(reverse_bits(index), pair_hash ^ 0x5bd1e995u));
+        u2 = uint_to_double(owen_scramble(sobol_dimension_1(index), pair_hash ^ 0x68e31da4u));
+        return;
+    }
+    case sampler_type::blue_noise: {
+        // The same scrambled points are used in every pixel, only the toroidal shift read
+        // from the masks differs, which turns the error between neighbours into blue noise
+        uint32_t pair_hash = static_cast<uint32_t>(mix64(state.seed ^ (uint64_t(pair) << 32)));
+        uint32_t index = owen_scramble(state.index, pair_hash);
+        double s1 = uint_to_double(owen_scramble(reverse_bits(index), pair_hash ^ 0x5bd1e995u));
+        double s2 = uint_to_double(owen_scramble(sobol_dimension_1(index), pair_hash ^ 0x68e31da4u));
+        uint32_t offset_x = pair_hash & 63, offset_y = (pair_hash >> 6) & 63;
+        s1 += blue_noise_mask::get(0).at(state.pixel_x + offset_x, state.pixel_y + offset_y);
+        s2 += blue_noise_mask::get(1).at(state.pixel_x + offset_x, state.pixel_y + offset_y);
+        u1 = s1 >= 1 ? s1 - 1 : s1;
+        u2 = s2 >= 1 ? s2 - 1 : s2;
+        return;
+    }
+    case sampler_type::independent:
+        break;
+    }
+
+    u1 = thread_rng().next_double();
+    u2 = thread_rng().next_double();
+}
+
+#endif
@@ -0,0 +1,882 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "common.h"
+
+#include "camera.h"
+#include "instance.h"
+#include "mapped_file.h"
+#include "material_table.h"
+#include "mesh_cache.h"
+#include "mesh_io.h"
+#include "scene_objects_list.h"
+#include "sphere.h"
+#include "triangle.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+// Scene files: materials, primitives, meshes and camera settings, so scenes can change
+// without rebuilding the renderer.
+//
+// The text form has one statement per line; `#` starts a comment:
+//
+//   camera <setting> <value...>         e.g. camera look_from -2 2 1
+//   material <name> lambertian1 <r g b> <reflectance>     (also lambertian2, lambertian3)
+//   material <name> metal <r g b> <fuzz>
+//   material <name> dielectric <refractive index ratio>
+//   sphere <x y z> <radius> <material>
+//   triangle <a> <b> <c> [<normal>] <material>    (normal from the winding if left out)
+//   mesh <path> <material> [sah | lbvh]           (OBJ or PLY, relative to the scene file)
+//   geometry <name> <path> <material> [sah | lbvh]  (a mesh that is only drawn by instances)
+//   instance <geometry> <material | -> <transform...>
+//
+// An instance places a copy of a geometry without duplicating its triangles; `-` keeps the
+// geometry's material. The transform is a sequence of translate <x y z>, scale <x y z>,
+// rotate_x/rotate_y/rotate_z <degrees>, rotate <axis x y z> <degrees> and matrix <12
+// numbers, row by row>, applied in the order written, e.g.
+//
+//   instance tree bark scale 2 2 2 rotate_y 30 translate 10 0 -4
+//
+// Animation: with `camera frames <count>` above 1 the renderer writes that many frames. A
+// `motion <transform...>` line after an instance moves it every frame: frame f uses the
+// instance transform applied after the motion f times, so the motion happens in the
+// geometry's own space (rotate_y spins the object in place). `camera orbit <degrees>`
+// turns look_from around look_at (about v_up) by that much per frame, for turntables.
+//
+// Camera settings are the camera members of the same name: aspect_ratio, image_width,
+// sample_size, max_depth, v_fov, look_from, look_at, v_up, defocus_angle, focus_dist,
+// seed, sampler (independent, stratified, sobol, blue_noise), adaptive_sampling,
+// min_samples, adaptive_threshold, russian_roulette, rr_min_depth, wavefront, reorder_rays
+// and packets. Numbers may also be written as fractions, e.g. `camera aspect_ratio 16/9`.
+// Counts must be whole numbers: image_width, sample_size and max_depth at least 1, the
+// seed a plain unsigned integer. aspect_ratio and focus_dist must be positive and v_fov
+// between 0 and 180 degrees. Materials must be defined before they're used, a triangle
+// without a normal must not be degenerate, and instance and motion transforms must be
+// invertible.
+//
+// The binary form holds the same scene_description as fixed-size records for scenes with
+// millions of primitives: the scene_file_header, then the scene_camera, the materials,
+// spheres, triangles, mesh, geometry and instance records as arrays, then the strings
+// (native byte order).
+
+enum class scene_material_kind : uint32_t { lambertian1, lambertian2, lambertian3, metal, dielectric };
+
+struct scene_material {
+    scene_material_kind kind;
+    uint32_t reserved;
+    double albedo[3];
+    double parameter;   // reflectance, fuzz or refractive index ratio, depending on kind
+};
+
+struct scene_sphere {
+    double center[3];
+    double radius;
+    uint32_t material;  // index into scene_description::materials
+    uint32_t reserved;
+};
+
+struct scene_triangle {
+    double vertex[3][3];
+    double normal[3];
+    uint32_t material;
+    uint32_t reserved;
+};
+
+struct scene_mesh {
+    std::string path;   // as written in the scene file
+    uint32_t material;
+    bvh_build_method method;
+};
+
+static const uint32_t scene_no_material = 0xffffffff;
+
+struct scene_instance {
+    double transform[3][4];   // object to world, see affine_transform
+    double motion[3][4];      // applied once more every frame, the identity for still instances
+    uint32_t geometry;        // index into scene_description::geometries
+    uint32_t material;        // scene_no_material keeps the geometry's material
+};
+
+struct scene_camera {
+    // The camera settings a scene file controls; unset ones keep the camera defaults
+    double aspect_ratio;
+    int32_t image_width, sample_size, max_depth;
+    int32_t sampler;    // sampler_type
+    double v_fov;
+    double look_from[3], look_at[3], v_up[3];
+    double defocus_angle, focus_dist;
+    uint64_t seed;
+    int32_t adaptive_sampling, min_samples;
+    double adaptive_threshold;
+    int32_t russian_roulette, rr_min_depth;
+    int32_t wavefront, reorder_rays;
+    int32_t packets;
+    int32_t frames;           // not camera members: the animation length and turntable speed
+    double orbit;
+};
+
+inline scene_camera camera_settings(const camera& cam) {
+    scene_camera s = {};
+    s.aspect_ratio = cam.aspect_ratio;
+    s.image_width = cam.image_width;
+    s.sample_size = cam.sample_size;
+    s.max_depth = cam.max_depth;
+    s.sampler = static_cast<int32_t>(cam.sampler);
+    s.v_fov = cam.v_fov;
+    for (int a = 0; a < 3; ++a) {
+        s.look_from[a] = cam.look_from[a];
+        s.look_at[a] = cam.look_at[a];
+        s.v_up[a] = cam.v_up[a];
+    }
+    s.defocus_angle = cam.defocus_angle;
+    s.focus_dist = cam.focus_dist;
+    s.seed = cam.seed;
+    s.adaptive_sampling = cam.adaptive_sampling;
+    s.min_samples = cam.min_samples;
+    s.adaptive_threshold = cam.adaptive_threshold;
+    s.russian_roulette = cam.russian_roulette;
+    s.rr_min_depth = cam.rr_min_depth;
+    s.wavefront = cam.wavefront;
+    s.reorder_rays = cam.reorder_rays;
+    s.packets = cam.packets;
+    s.frames = 1;
+    s.orbit = 0;
+    return s;
+}
+
+inline void apply_camera_settings(const scene_camera& s, camera& cam) {
+    cam.aspect_ratio = s.aspect_ratio;
+    cam.image_width = s.image_width;
+    cam.sample_size = s.sample_size;
+    cam.max_depth = s.max_depth;
+    cam.sampler = static_cast<sampler_type>(s.sampler);
+    cam.v_fov = s.v_fov;
+    cam.look_from = point3(s.look_from[0], s.look_from[1], s.look_from[2]);
+    cam.look_at = point3(s.look_at[0], s.look_at[1], s.look_at[2]);
+    cam.v_up = vec3(s.v_up[0], s.v_up[1], s.v_up[2]);
+    cam.defocus_angle = s.defocus_angle;
+    cam.focus_dist = s.focus_dist;
+    cam.seed = static_cast<unsigned long>(s.seed);
+    cam.adaptive_sampling = s.adaptive_sampling != 0;
+    cam.min_samples = s.min_samples;
+    cam.adaptive_threshold = s.adaptive_threshold;
+    cam.russian_roulette = s.russian_roulette != 0;
+    cam.rr_min_depth = s.rr_min_depth;
+    cam.wavefront = s.wavefront != 0;
+    cam.reorder_rays = s.reorder_rays != 0;
+    cam.packets = s.packets != 0;
+}
+
+struct scene_description {
+    // A scene as read from a scene file, before any objects are built
+    scene_camera camera = camera_settings(::camera());
+    std::vector<scene_material> materials;
+    std::vector<std::string> material_names; // one per material, for the text form
+    std::vector<scene_sphere> spheres;
+    std::vector<scene_triangle> triangles;
+    std::vector<scene_mesh> meshes;
+    std::vector<scene_mesh> geometries;      // meshes placed only through instances
+    std::vector<std::string> geometry_names;
+    std::vector<scene_instance> instances;
+    std::string base_dir;   // directory of the scene file, mesh paths are relative to it
+};
+
+// Text form
+
+inline bool scene_word(const char*& p, const char* end, std::string& word) {
+    // Next blank separated word on the line
+    skip_blanks(p, end);
+    const char* start = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#')
+        ++p;
+    word.assign(start, p);
+    return p > start;
+}
+
+inline bool scene_number(const char*& p, const char* end, double& out) {
+    // A number, or a fraction of two numbers
+    if (!parse_real(p, end, out))
+        return false;
+    if (p < end && *p == '/') {
+        double denominator;
+        ++p;
+        if (!parse_real(p, end, denominator) || denominator == 0)
+            return false;
+        out /= denominator;
+    }
+    return true;
+}
+
+inline bool scene_numbers(const char*& p, const char* end, double* out, int count) {
+    for (int i = 0; i < count; ++i)
+        if (!scene_number(p, end, out[i]))
+            return false;
+    return true;
+}
+
+inline bool scene_line_done(const char* p, const char* end) {
+    // Only blanks or a comment left on the line
+    skip_blanks(p, end);
+    return p == end || *p == '\n' || *p == '#';
+}
+
+inline bool scene_count(double value, int32_t minimum, int32_t& out) {
+    // An integer setting: whole, at least minimum and within int32_t
+    if (!(value >= minimum && value <= std::numeric_limits<int32_t>::max()) || value != std::floor(value))
+        return false;
+    out = static_cast<int32_t>(value);
+    return true;
+}
+
+inline bool scene_between(double value, double low, double high) {
+    // Strictly between low and high, so never NaN
+    return value > low && value < high;
+}
+
+inline bool scene_real(double value, double low, double high, double& out) {
+    // A real setting strictly between low and high
+    if (!scene_between(value, low, high))
+        return false;
+    out = value;
+    return true;
+}
+
+inline bool scene_seed(const char*& p, const char* end, uint64_t& out) {
+    // Seeds are read as integers: a double rounds those above 2^53 and can't be cast to
+    // uint64_t when out of range
+    skip_blanks(p, end);
+    const char* start = p;
+    uint64_t value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        unsigned digit = *p - '0';
+        if (value > (std::numeric_limits<uint64_t>::max() - digit) / 10)
+            return false;
+        value = 10*value + digit;
+    }
+    out = value;
+    return p > start;
+}
+
+inline bool scene_camera_valid(const scene_camera& cam) {
+    // What the text parser enforces setting by setting, for camera records read as a whole
+    const double unbounded = std::numeric_limits<double>::infinity();
+    return cam.image_width >= 1 && cam.sample_size >= 1 && cam.max_depth >= 1 && cam.sampler >= 0 && cam.sampler < 4
+        && cam.min_samples >= 0 && cam.rr_min_depth >= 0 && cam.frames >= 0
+        && scene_between(cam.aspect_ratio, 0, unbounded) && scene_between(cam.v_fov, 0, 180)
+        && scene_between(cam.focus_dist, 0, unbounded);
+}
+
+inline bool scene_normal_valid(const double (&normal)[3]) {
+    // Triangles need a normal of finite, nonzero length; degenerate ones have none
+    double length_squared = normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2];
+    return length_squared > 0 && length_squared <= std::numeric_limits<double>::max();
+}
+
+inline bool parse_camera_setting(const char*& p, const char* end, scene_camera& cam) {
+    std::string name;
+    if (!scene_word(p, end, name))
+        return false;
+    double v[3];
+    if (name == "look_from" || name == "look_at" || name == "v_up") {
+        if (!scene_numbers(p, end, v, 3))
+            return false;
+        double* target = name == "look_from" ? cam.look_from : name == "look_at" ? cam.look_at : cam.v_up;
+        for (int a = 0; a < 3; ++a)
+            target[a] = v[a];
+        return true;
+    }
+    if (name == "sampler") {
+        std::string kind;
+        if (!scene_word(p, end, kind))
+            return false;
+        const char* kinds[] = { "independent", "stratified", "sobol", "blue_noise" };
+        for (int k = 0; k < 4; ++k) {
+            if (kind == kinds[k]) {
+                cam.sampler = k;
+                return true;
+            }
+        }
+        return false;
+    }
+    if (name == "adaptive_sampling" || name == "russian_roulette" || name == "wavefront" || name == "reorder_rays"
+        || name == "packets") {
+        std::string flag;
+        if (!scene_word(p, end, flag) || (flag != "true" && flag != "false" && flag != "1" && flag != "0"))
+            return false;
+        int32_t& setting = name == "adaptive_sampling" ? cam.adaptive_sampling
+                         : name == "russian_roulette" ? cam.russian_roulette
+                         : name == "wavefront" ? cam.wavefront
+                         : name == "reorder_rays" ? cam.reorder_rays : cam.packets;
+        setting = flag == "true" || flag == "1";
+        return true;
+    }
+    if (name == "seed")
+        return scene_seed(p, end, cam.seed);
+
+    if (!scene_number(p, end, v[0]))
+        return false;
+    const double unbounded = std::numeric_limits<double>::infinity();
+    if (name == "aspect_ratio")            return scene_real(v[0], 0, unbounded, cam.aspect_ratio);
+    else if (name == "image_width")        return scene_count(v[0], 1, cam.image_width);
+    else if (name == "sample_size")        return scene_count(v[0], 1, cam.sample_size);
+    else if (name == "max_depth")          return scene_count(v[0], 1, cam.max_depth);
+    else if (name == "v_fov")              return scene_real(v[0], 0, 180, cam.v_fov);
+    else if (name == "defocus_angle")      cam.defocus_angle = v[0];
+    else if (name == "focus_dist")         return scene_real(v[0], 0, unbounded, cam.focus_dist);
+    else if (name == "min_samples")        return scene_count(v[0], 0, cam.min_samples);
+    else if (name == "adaptive_threshold") cam.adaptive_threshold = v[0];
+    else if (name == "rr_min_depth")       return scene_count(v[0], 0, cam.rr_min_depth);
+    else if (name == "frames")             return scene_count(v[0], 0, cam.frames);
+    else if (name == "orbit")              cam.orbit = v[0];
+    else return false;
+    return true;
+}
+
+inline bool parse_material(const char*& p, const char* end, scene_description& scene,
+                           std::map<std::string, uint32_t>& names) {
+    std::string name, kind;
+    if (!scene_word(p, end, name) || !scene_word(p, end, kind) || names.count(name))
+        return false;
+    scene_material m = {};
+    if (kind == "dielectric") {
+        m.kind = scene_material_kind::dielectric;
+        if (!scene_number(p, end, m.parameter))
+            return false;
+    }
+    else {
+        if (kind == "lambertian1")      m.kind = scene_material_kind::lambertian1;
+        else if (kind == "lambertian2") m.kind = scene_material_kind::lambertian2;
+        else if (kind == "lambertian3") m.kind = scene_material_kind::lambertian3;
+        else if (kind == "metal")       m.kind = scene_material_kind::metal;
+        else return false;
+        if (!scene_numbers(p, end, m.albedo, 3) || !scene_number(p, end, m.parameter))
+            return false;
+    }
+    names[name] = static_cast<uint32_t>(scene.materials.size());
+    scene.materials.push_back(m);
+    scene.material_names.push_back(name);
+    return true;
+}
+
+inline bool scene_material_ref(const char*& p, const char* end, const std::map<std::string, uint32_t>& names,
+                               uint32_t& id) {
+    std::string name;
+    if (!scene_word(p, end, name))
+        return false;
+    auto found = names.find(name);
+    if (found == names.end())
+        return false;
+    id = found->second;
+    return true;
+}
+
+inline bool parse_scene_mesh(const char*& p, const char* end, const std::map<std::string, uint32_t>& names,
+                             scene_mesh& mesh) {
+    // <path> <material> [sah | lbvh]
+    mesh.method = bvh_build_method::sah;
+    if (!scene_word(p, end, mesh.path) || !scene_material_ref(p, end, names, mesh.material))
+        return false;
+    std::string method;
+    if (!scene_word(p, end, method))
+        return true;
+    if (method == "lbvh")
+        mesh.method = bvh_build_method::lbvh;
+    return method == "sah" || method == "lbvh";
+}
+
+inline bool parse_transform(const char*& p, const char* end, affine_transform& t) {
+    // Transform operations up to the end of the line, each applied after the ones before
+    std::string op;
+    double v[12];
+    while (scene_word(p, end, op)) {
+        affine_transform step;
+        if (op == "translate" && scene_numbers(p, end, v, 3))
+            step = affine_transform::translate(vec3(v[0], v[1], v[2]));
+        else if (op == "scale" && scene_numbers(p, end, v, 3))
+            step = affine_transform::scale(vec3(v[0], v[1], v[2]));
+        else if (op == "rotate_x" && scene_number(p, end, v[0]))
+            step = affine_transform::rotate(vec3(1, 0, 0), v[0]);
+        else if (op == "rotate_y" && scene_number(p, end, v[0]))
+            step = affine_transform::rotate(vec3(0, 1, 0), v[0]);
+        else if (op == "rotate_z" && scene_number(p, end, v[0]))
+            step = affine_transform::rotate(vec3(0, 0, 1), v[0]);
+        else if (op == "rotate" && scene_numbers(p, end, v, 4))
+            step = affine_transform::rotate(vec3(v[0], v[1], v[2]), v[3]);
+        else if (op == "matrix" && scene_numbers(p, end, v, 12)) {
+            for (int k = 0; k < 12; ++k)
+                step.m[k / 4][k % 4] = v[k];
+        }
+        else
+            return false;
+        t = step * t;
+    }
+    return std::fabs(t.determinant()) > 0; // the inverse is needed to trace rays
+}
+
+inline bool parse_scene_text(const char* begin, const char* end, scene_description& scene, std::string& error) {
+    // Parses the text form into scene. On failure, error names the offending line.
+    std::map<std::string, uint32_t> names, geometry_names;
+    std::string keyword;
+    int line_number = 0;
+    for (const char* line = begin; line < end; line = next_line(line, end)) {
+        ++line_number;
+        const char* p = line;
+        if (!scene_word(p, end, keyword))
+            continue; // blank or comment
+
+        bool ok = false;
+        if (keyword == "camera") {
+            ok = parse_camera_setting(p, end, scene.camera);
+        }
+        else if (keyword == "material") {
+            ok = parse_material(p, end, scene, names);
+        }
+        else if (keyword == "sphere") {
+            scene_sphere s = {};
+            ok = scene_numbers(p, end, s.center, 3) && scene_number(p, end, s.radius)
+              && scene_material_ref(p, end, names, s.material);
+            if (ok)
+                scene.spheres.push_back(s);
+        }
+        else if (keyword == "triangle") {
+            // 9 or 12 numbers, then the material
+            scene_triangle t = {};
+            double v[12];
+            int count = 0;
+            while (count < 12 && scene_number(p, end, v[count]))
+                ++count;
+            ok = (count == 9 || count == 12) && scene_material_ref(p, end, names, t.material);
+            if (ok) {
+                for (int k = 0; k < 9; ++k)
+                    t.vertex[k / 3][k % 3] = v[k];
+                vec3 normal = count == 12 ? vec3(v[9], v[10], v[11])
+                                          : unit_vector(cross(vec3(v[3] - v[0], v[4] - v[1], v[5] - v[2]),
+                                                              vec3(v[6] - v[0], v[7] - v[1], v[8] - v[2])));
+                for (int a = 0; a < 3; ++a)
+                    t.normal[a] = normal[a];
+                ok = scene_normal_valid(t.normal);
+                if (ok)
+                    scene.triangles.push_back(t);
+            }
+        }
+        else if (keyword == "mesh") {
+            scene_mesh m;
+            ok = parse_scene_mesh(p, end, names, m);
+            if (ok)
+                scene.meshes.push_back(m);
+        }
+        else if (keyword == "geometry") {
+            std::string name;
+            scene_mesh m;
+            ok = scene_word(p, end, name) && !geometry_names.count(name) && parse_scene_mesh(p, end, names, m);
+            if (ok) {
+                geometry_names[name] = static_cast<uint32_t>(scene.geometries.size());
+                scene.geometries.push_back(m);
+                scene.geometry_names.push_back(name);
+            }
+        }
+        else if (keyword == "instance") {
+            scene_instance in = {};
+            in.material = scene_no_material;
+            std::string material;
+            affine_transform t;
+            ok = scene_material_ref(p, end, geometry_names, in.geometry) && scene_word(p, end, material);
+            if (ok && material != "-") {
+                auto found = names.find(material);
+                ok = found != names.end();
+                if (ok)
+                    in.material = found->second;
+            }
+            ok = ok && parse_transform(p, end, t);
+            if (ok) {
+                affine_transform still;
+                for (int k = 0; k < 12; ++k) {
+                    in.transform[k / 4][k % 4] = t.m[k / 4][k % 4];
+                    in.motion[k / 4][k % 4] = still.m[k / 4][k % 4];
+                }
+                scene.instances.push_back(in);
+            }
+        }
+        else if (keyword == "motion") {
+            affine_transform t;
+            ok = !scene.instances.empty() && parse_transform(p, end, t);
+            if (ok) {
+                for (int k = 0; k < 12; ++k)
+                    scene.instances.back().motion[k / 4][k % 4] = t.m[k / 4][k % 4];
+            }
+        }
+
+        if (!ok || !scene_line_done(p, end)) {
+            const char* line_end = next_line(line, end);
+            while (line_end > line && (line_end[-1] == '\n' || line_end[-1] == '\r'))
+                --line_end;
+            error = "line " + std::to_string(line_number) + ": can't read \"" + std::string(line, line_end) + "\"";
+            return false;
+        }
+    }
+    return true;
+}
+
+inline affine_transform scene_transform(const double (&m)[3][4]) {
+    affine_transform t;
+    for (int k = 0; k < 12; ++k)
+        t.m[k / 4][k % 4] = static_cast<real>(m[k / 4][k % 4]);
+    return t;
+}
+
+inline bool scene_transform_valid(const double (&m)[3][4]) {
+    // The check parse_transform makes, for transforms read as a whole
+    return std::fabs(scene_transform(m).determinant()) > 0;
+}
+
+inline bool scene_instance_moves(const scene_instance& in) {
+    affine_transform still;
+    for (int k = 0; k < 12; ++k)
+        if (in.motion[k / 4][k % 4] != still.m[k / 4][k % 4])
+            return true;
+    return false;
+}
+
+inline affine_transform scene_instance_transform(const scene_instance& in, int frame) {
+    // The instance transform after `frame` steps of its motion, with the motion raised to
+    // that power by squaring so late frames cost no more than early ones
+    affine_transform result = scene_transform(in.transform), step = scene_transform(in.motion);
+    for (unsigned n = static_cast<unsigned>(frame); n > 0; n >>= 1) {
+        if (n & 1)
+            result = result * step;
+        step = step * step;
+    }
+    return result;
+}
+
+inline bool save_scene_text(const std::string& path, const scene_description& scene) {
+    FILE* out = std::fopen(path.c_str(), "w");
+    if (!out)
+        return false;
+    const scene_camera& c = scene.camera;
+    const char* samplers[] = { "independent", "stratified", "sobol", "blue_noise" };
+    std::fprintf(out, "camera aspect_ratio %.17g\ncamera image_width %d\ncamera sample_size %d\ncamera max_depth %d\n"
+                      "camera sampler %s\ncamera v_fov %.17g\ncamera look_from %.17g %.17g %.17g\n"
+                      "camera look_at %.17g %.17g %.17g\ncamera v_up %.17g %.17g %.17g\n"
+                      "camera defocus_angle %.17g\ncamera focus_dist %.17g\ncamera seed %llu\n"
+                      "camera adaptive_sampling %d\ncamera min_samples %d\ncamera adaptive_threshold %.17g\n"
+                      "camera russian_roulette %d\ncamera rr_min_depth %d\ncamera wavefront %d\n"
+                      "camera reorder_rays %d\ncamera packets %d\ncamera frames %d\ncamera orbit %.17g\n\n",
+                 c.aspect_ratio, c.image_width, c.sample_size, c.max_depth, samplers[c.sampler], c.v_fov,
+                 c.look_from[0], c.look_from[1], c.look_from[2], c.look_at[0], c.look_at[1], c.look_at[2],
+                 c.v_up[0], c.v_up[1], c.v_up[2], c.defocus_angle, c.focus_dist,
+                 static_cast<unsigned long long>(c.seed), c.adaptive_sampling, c.min_samples, c.adaptive_threshold,
+                 c.russian_roulette, c.rr_min_depth, c.wavefront, c.reorder_rays, c.packets, c.frames, c.orbit);
+
+    const char* kinds[] = { "lambertian1", "lambertian2", "lambertian3", "metal", "dielectric" };
+    for (size_t i = 0; i < scene.materials.size(); ++i) {
+        const scene_material& m = scene.materials[i];
+        if (m.kind == scene_material_kind::dielectric)
+            std::fprintf(out, "material %s dielectric %.17g\n", scene.material_names[i].c_str(), m.parameter);
+        else
+            std::fprintf(out, "material %s %s %.17g %.17g %.17g %.17g\n", scene.material_names[i].c_str(),
+                         kinds[static_cast<int>(m.kind)], m.albedo[0], m.albedo[1], m.albedo[2], m.parameter);
+    }
+    for (const auto& s : scene.spheres)
+        std::fprintf(out, "sphere %.17g %.17g %.17g %.17g %s\n", s.center[0], s.center[1], s.center[2], s.radius,
+                     scene.material_names[s.material].c_str());
+    for (const auto& t : scene.triangles) {
+        std::fprintf(out, "triangle");
+        for (int k = 0; k < 9; ++k)
+            std::fprintf(out, " %.17g", t.vertex[k / 3][k % 3]);
+        std::fprintf(out, " %.17g %.17g %.17g %s\n", t.normal[0], t.normal[1], t.normal[2],
+                     scene.material_names[t.material].c_str());
+    }
+    for (const auto& m : scene.meshes)
+        std::fprintf(out, "mesh %s %s %s\n", m.path.c_str(), scene.material_names[m.material].c_str(),
+                     m.method == bvh_build_method::lbvh ? "lbvh" : "sah");
+    for (size_t i = 0; i < scene.geometries.size(); ++i) {
+        const scene_mesh& m = scene.geometries[i];
+        std::fprintf(out, "geometry %s %s %s %s\n", scene.geometry_names[i].c_str(), m.path.c_str(),
+                     scene.material_names[m.material].c_str(), m.method == bvh_build_method::lbvh ? "lbvh" : "sah");
+    }
+    for (const auto& in : scene.instances) {
+        std::fprintf(out, "instance %s %s matrix", scene.geometry_names[in.geometry].c_str(),
+                     in.material == scene_no_material ? "-" : scene.material_names[in.material].c_str());
+        for (int k = 0; k < 12; ++k)
+            std::fprintf(out, " %.17g", in.transform[k / 4][k % 4]);
+        std::fprintf(out, "\n");
+        if (scene_instance_moves(in)) {
+            std::fprintf(out, "motion matrix");
+            for (int k = 0; k < 12; ++k)
+                std::fprintf(out, " %.17g", in.motion[k / 4][k % 4]);
+            std::fprintf(out, "\n");
+        }
+    }
+    return std::fclose(out) == 0;
+}
+
+// Binary form
+
+struct scene_file_header {
+    char magic[8];        // "RBSCENE\0"
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t material_count, sphere_count, triangle_count, mesh_count, geometry_count, instance_count;
+    uint64_t text_bytes;  // mesh paths, material names, geometry paths and names, each followed by a 0 byte
+};
+
+struct scene_mesh_record {
+    uint32_t material;
+    uint32_t method;      // bvh_build_method
+};
+
+static const uint32_t scene_file_version = 6;
+static const char scene_file_magic[8] = { 'R', 'B', 'S', 'C', 'E', 'N', 'E', 0 };
+
+inline bool save_scene_binary(const std::string& path, const scene_description& scene) {
+    std::string text;
+    for (const auto& m : scene.meshes)
+        text.append(m.path).push_back('\0');
+    for (const auto& name : scene.material_names)
+        text.append(name).push_back('\0');
+    for (const auto& m : scene.geometries)
+        text.append(m.path).push_back('\0');
+    for (const auto& name : scene.geometry_names)
+        text.append(name).push_back('\0');
+    std::vector<scene_mesh_record> meshes;
+    for (const auto* list : { &scene.meshes, &scene.geometries }) {
+        for (const auto& m : *list) {
+            scene_mesh_record record = { m.material, static_cast<uint32_t>(m.method) };
+            meshes.push_back(record);
+        }
+    }
+
+    scene_file_header header = {};
+    std::memcpy(header.magic, scene_file_magic, 8);
+    header.version = scene_file_version;
+    header.material_count = scene.materials.size();
+    header.sphere_count = scene.spheres.size();
+    header.triangle_count = scene.triangles.size();
+    header.mesh_count = scene.meshes.size();
+    header.geometry_count = scene.geometries.size();
+    header.instance_count = scene.instances.size();
+    header.text_bytes = text.size();
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(&scene.camera), sizeof(scene.camera));
+    out.write(reinterpret_cast<const char*>(scene.materials.data()), scene.materials.size() * sizeof(scene_material));
+    out.write(reinterpret_cast<const char*>(scene.spheres.data()), scene.spheres.size() * sizeof(scene_sphere));
+    out.write(reinterpret_cast<const char*>(scene.triangles.data()), scene.triangles.size() * sizeof(scene_triangle));
+    out.write(reinterpret_cast<const char*>(meshes.data()), meshes.size() * sizeof(scene_mesh_record));
+    out.write(reinterpret_cast<const char*>(scene.instances.data()), scene.instances.size() * sizeof(scene_instance));
+    out.write(text.data(), text.size());
+    return static_cast<bool>(out);
+}
+
+template <typename T>
+inline bool read_scene_array(const char*& p, const char* end, uint64_t count, std::vector<T>& out) {
+    if (count > static_cast<uint64_t>(end - p) / sizeof(T))
+        return false;
+    out.resize(count);
+    std::memcpy(out.data(), p, count * sizeof(T));
+    p += count * sizeof(T);
+    return true;
+}
+
+inline bool parse_scene_binary(const char* begin, const char* end, scene_description& scene, std::string& error) {
+    // The arrays are copied out as they are; only the camera settings, triangle normals,
+    // material kinds and references, build methods and instance transforms are checked
+    error = "not a valid binary scene";
+    scene_file_header header;
+    if (static_cast<size_t>(end - begin) < sizeof(header) + sizeof(scene_camera))
+        return false;
+    std::memcpy(&header, begin, sizeof(header));
+    if (std::memcmp(header.magic, scene_file_magic, 8) != 0)
+        return false;
+    if (header.version != scene_file_version) {
+        error = "binary scene version " + std::to_string(header.version) + " is not supported";
+        return false;
+    }
+    const char* p = begin + sizeof(header);
+    std::memcpy(&scene.camera, p, sizeof(scene_camera));
+    p += sizeof(scene_camera);
+    if (!scene_camera_valid(scene.camera)) {
+        error = "invalid camera settings in binary scene";
+        return false;
+    }
+
+    std::vector<scene_mesh_record> meshes;
+    if (!read_scene_array(p, end, header.material_count, scene.materials)
+            || !read_scene_array(p, end, header.sphere_count, scene.spheres)
+            || !read_scene_array(p, end, header.triangle_count, scene.triangles)
+            || header.mesh_count > std::numeric_limits<uint64_t>::max() - header.geometry_count
+            || !read_scene_array(p, end, header.mesh_count + header.geometry_count, meshes)
+            || !read_scene_array(p, end, header.instance_count, scene.instances)
+            || header.text_bytes != static_cast<uint64_t>(end - p))
+        return false;
+
+    std::vector<std::string> strings;
+    for (const char* s = p; s < end; ) {
+        const char* terminator = static_cast<const char*>(std::memchr(s, '\0', end - s));
+        if (!terminator)
+            return false;
+        strings.push_back(std::string(s, terminator));
+        s = terminator + 1;
+    }
+    size_t mesh_count = header.mesh_count, geometry_count = header.geometry_count;
+    if (strings.size() != mesh_count + scene.materials.size() + 2 * geometry_count)
+        return false;
+    scene.meshes.resize(mesh_count);
+    scene.geometries.resize(geometry_count);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        bool geometry = i >= mesh_count;
+        scene_mesh& m = geometry ? scene.geometries[i - mesh_count] : scene.meshes[i];
+        m.path = strings[geometry ? i + scene.materials.size() : i];
+        m.material = meshes[i].material;
+        if (meshes[i].method > static_cast<uint32_t>(bvh_build_method::lbvh))
+            return false;
+        m.method = static_cast<bvh_build_method>(meshes[i].method);
+    }
+    auto names = strings.begin() + mesh_count;
+    scene.material_names.assign(names, names + scene.materials.size());
+    scene.geometry_names.assign(names + scene.materials.size() + geometry_count, strings.end());
+
+    size_t material_count = scene.materials.size();
+    for (const auto& s : scene.spheres)
+        if (s.material >= material_count) return false;
+    for (const auto& t : scene.triangles)
+        if (t.material >= material_count || !scene_normal_valid(t.normal)) return false;
+    for (const auto& m : scene.meshes)
+        if (m.material >= material_count) return false;
+    for (const auto& m : scene.geometries)
+        if (m.material >= material_count) return false;
+    for (const auto& in : scene.instances)
+        if (in.geometry >= scene.geometries.size()
+                || (in.material >= material_count && in.material != scene_no_material)
+                || !scene_transform_valid(in.transform) || !scene_transform_valid(in.motion)) return false;
+    for (const auto& m : scene.materials)
+        if (static_cast<uint32_t>(m.kind) > static_cast<uint32_t>(scene_material_kind::dielectric)) return false;
+    return true;
+}
+
+// Loading and building
+
+inline bool load_scene(const std::string& path, scene_description& scene) {
+    // Reads a scene file in either form, told apart by the binary magic
+    mapped_file file;
+    if (!file.open(path)) {
+        std::clog << "Could not open " << path << std::endl;
+        return false;
+    }
+    scene = scene_description();
+    size_t slash = path.find_last_of('/');
+    scene.base_dir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    std::string error;
+    bool binary = file.size() >= 8 && std::memcmp(begin, scene_file_magic, 8) == 0;
+    bool ok = binary ? parse_scene_binary(begin, end, scene, error) : parse_scene_text(begin, end, scene, error);
+    if (!ok)
+        std::clog << path << ": " << error << std::endl;
+    return ok;
+}
+
+inline shared_ptr<material> make_scene_material(const scene_material& m) {
+    color albedo(m.albedo[0], m.albedo[1], m.albedo[2]);
+    switch (m.kind) {
+        case scene_material_kind::lambertian2: return make_shared<lambertian2>(albedo, m.parameter);
+        case scene_material_kind::lambertian3: return make_shared<lambertian3>(albedo, m.parameter);
+        case scene_material_kind::metal:       return make_shared<metal>(albedo, m.parameter);
+        case scene_material_kind::dielectric:  return make_shared<dielectric>(m.parameter);
+        default:                               return make_shared<lambertian1>(albedo, m.parameter);
+    }
+}
+
+inline shared_ptr<triangle_mesh> load_scene_mesh(const scene_description& scene, const scene_mesh& m,
+                                                 material_id first_id, const std::string& mesh_cache_dir) {
+    std::string path = (!m.path.empty() && m.path[0] == '/') ? m.path : scene.base_dir + m.path;
+    if (!mesh_cache_dir.empty())
+        return load_mesh_cached(path, mesh_cache_dir, first_id + m.material, m.method);
+    mesh_data data;
+    if (!load_mesh(path, data))
+        return nullptr;
+    return make_shared<triangle_mesh>(std::move(data), first_id + m.material, m.method);
+}
+
+inline bool build_scene(const scene_description& scene, scene_objects_list& world, material_table& materials,
+                        camera& cam, const std::string& mesh_cache_dir = "",
+                        std::vector<shared_ptr<instance>>* instances = nullptr) {
+    // Adds the scene's materials and objects to materials and world (materials first, so
+    // scene material i gets id first_id + i) and applies its camera settings. Meshes are
+    // loaded through the mesh cache in mesh_cache_dir if one is given. The instances, in
+    // scene order and placed for frame 0, are also added to instances if it's given, so
+    // set_scene_frame can move them.
+    material_id first_id = static_cast<material_id>(materials.size());
+    for (const auto& m : scene.materials)
+        materials.add(make_scene_material(m));
+
+    for (const auto& s : scene.spheres)
+        world.add(make_shared<sphere>(point3(s.center[0], s.center[1], s.center[2]), s.radius,
+                                      first_id + s.material));
+    for (const auto& t : scene.triangles) {
+        point3 v[3];
+        for (int k = 0; k < 3; ++k)
+            v[k] = point3(t.vertex[k][0], t.vertex[k][1], t.vertex[k][2]);
+        world.add(make_shared<triangle>(v[0], v[1], v[2], vec3(t.normal[0], t.normal[1], t.normal[2]),
+                                        first_id + t.material));
+    }
+    for (const auto& m : scene.meshes) {
+        auto mesh = load_scene_mesh(scene, m, first_id, mesh_cache_dir);
+        if (!mesh)
+            return false;
+        world.add(mesh);
+    }
+
+    // Each geometry is loaded once and shared by all of its instances
+    std::vector<shared_ptr<const scene_object>> geometries;
+    for (const auto& m : scene.geometries) {
+        auto mesh = load_scene_mesh(scene, m, first_id, mesh_cache_dir);
+        if (!mesh)
+            return false;
+        geometries.push_back(mesh);
+    }
+    for (const auto& in : scene.instances) {
+        affine_transform t = scene_transform(in.transform);
+        auto placed = in.material == scene_no_material
+                    ? make_shared<instance>(geometries[in.geometry], t)
+                    : make_shared<instance>(geometries[in.geometry], t, first_id + in.material);
+        world.add(placed);
+        if (instances)
+            instances->push_back(placed);
+    }
+
+    apply_camera_settings(scene.camera, cam);
+    return true;
+}
+
+inline int set_scene_frame(const scene_description& scene, const std::vector<shared_ptr<instance>>& instances,
+                           int frame, camera& cam) {
+    // Moves the instances built by build_scene and the camera to where they are in frame.
+    // Returns the number of instances that moved; any bvh over them needs an update().
+    int moved = 0;
+    for (size_t i = 0; i < scene.instances.size() && i < instances.size(); ++i) {
+        if (scene_instance_moves(scene.instances[i])) {
+            instances[i]->set_transform(scene_instance_transform(scene.instances[i], frame));
+            ++moved;
+        }
+    }
+    const scene_camera& c = scene.camera;
+    point3 look_at(c.look_at[0], c.look_at[1], c.look_at[2]);
+    point3 look_from(c.look_from[0], c.look_from[1], c.look_from[2]);
+    auto turn = affine_transform::rotate(vec3(c.v_up[0], c.v_up[1], c.v_up[2]), c.orbit * frame);
+    cam.look_from = look_at + turn.vector(look_from - look_at);
+    return moved;
+}
+
+#endif
@@ -1,18 +1,23 @@
 #ifndef SCENE_OBJECTS_H
 #define SCENE_OBJECTS_H
 
+#include "aabb.h"
 #include "interval.h"
 #include "ray.h"
+#include "ray_packet.h"
 
-class material; // Declaration of a class 'material'. Solves circular reference problem.
+#include <cstdint>
+
+// Index of a material in the scene's material_table (see material_table.h)
+typedef uint32_t material_id;
 
 class hit_record {
     // Class which allows us to send a bunch of arguements grouped together to other functions
     public:
     point3 p;
     vec3 normal;
-    shared_ptr<material> mat;
-    double t;
+    material_id mat;
+    real t;
     bool ray_facing_inwards;
 
     inline void set_face_normal(const ray& r, const vec3& outward_normal) {
@@ -30,6 +35,24 @@ class scene_object {
     virtual ~scene_object() = default;
 
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+    // Tests the rays in the mask rays of packet over (t_min, packet.t_max[k]). For each ray
+    // that hits, writes records[k], lowers packet.t_max[k] to the hit and sets its bit in
+    // packet.hits. Objects with a test for many rays at once override this; by default
+    // the rays are tested one at a time.
+    virtual void hit_packet(ray_packet& packet, real t_min, uint64_t rays, hit_record* records) const {
+        hit_record rec;
+        for (int k = 0; k < packet.size; ++k) {
+            if (((rays >> k) & 1) && hit(packet.rays[k], interval(t_min, packet.t_max[k]), rec)) {
+                records[k] = rec;
+                packet.t_max[k] = rec.t;
+                packet.hits |= uint64_t(1) << k;
+            }
+        }
+    }
+
+    // Box enclosing the whole object, used to build acceleration structures such as the BVH
+    virtual aabb bounding_box() const = 0;
 };
 
 
@@ -16,10 +16,14 @@ class scene_objects_list : public scene_object {
     scene_objects_list() {}
     scene_objects_list(shared_ptr<scene_object> object) { add(object); }
 
-    void clear() { objects.clear(); }
+    void clear() {
+	    objects.clear();
+	    bbox = aabb();
+    }
 
     void add(shared_ptr<scene_object> object) {
 	    objects.push_back(object);
+	    bbox = aabb(bbox, object->bounding_box());
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
@@ -39,6 +43,11 @@ class scene_objects_list : public scene_object {
 	    
 	    return hit_anything;
     }
+
+    aabb bounding_box() const override { return bbox; }
+
+    private:
+    aabb bbox;
 };
 
 
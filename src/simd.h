@@ -0,0 +1,258 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Runtime selection between SIMD instruction sets. Kernels are compiled for every set the
+// compiler can target (with `#pragma GCC target`, so the binary itself still runs on any
+// x86-64 CPU) and dispatched on what the CPU running the program supports.
+//
+// Each namespace simd_sse4, simd_avx2 and simd_avx512 defines a `lanes` type with the
+// handful of operations the kernels need, on vectors of `real`: 4/8/16 lanes for float and
+// 2/4/8 for double. simd_scalar::lanes is the one lane fallback. Kernels are written once
+// against `lanes` and included into each namespace (see sphere_batch_kernel.h).
+
+#include "common.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__clang__)
+#define RAY_BANDIT_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define RAY_BANDIT_X86_SIMD 0
+#endif
+
+enum class simd_level { scalar, sse4, avx2, avx512 };
+
+inline const char* simd_level_name(simd_level level) {
+    switch (level) {
+        case simd_level::sse4:   return "sse4.1";
+        case simd_level::avx2:   return "avx2";
+        case simd_level::avx512: return "avx512";
+        default:                 return "scalar";
+    }
+}
+
+inline simd_level detect_simd_level() {
+    // Widest instruction set both this CPU and this build support
+#if RAY_BANDIT_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return simd_level::avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return simd_level::avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return simd_level::sse4;
+#endif
+    return simd_level::scalar;
+}
+
+inline simd_level best_simd_level() {
+    static const simd_level level = detect_simd_level();
+    return level;
+}
+
+inline bool simd_level_supported(simd_level level) {
+    return static_cast<int>(level) <= static_cast<int>(best_simd_level());
+}
+
+namespace simd_scalar {
+struct lanes {
+    typedef real value;
+    typedef bool mask;
+    static const int width = 1;
+    static value load(const real* p) { return *p; }
+    static value load_bytes(const uint8_t* p) { return *p; } // width unsigned bytes, converted
+    static void store(real* p, value v) { *p = v; }
+    static value broadcast(real x) { return x; }
+    static value add(value a, value b) { return a + b; }
+    static value sub(value a, value b) { return a - b; }
+    static value mul(value a, value b) { return a * b; }
+    static value div(value a, value b) { return a / b; }
+    static value sqrt(value a) { return std::sqrt(a); }
+    static mask less(value a, value b) { return a < b; }
+    static mask greater(value a, value b) { return a > b; }
+    static mask equal(value a, value b) { return a == b; }
+    static mask not_less(value a, value b) { return !(a < b); }
+    static mask both(mask a, mask b) { return a && b; }
+    static value select(mask m, value a, value b) { return m ? a : b; }
+    static unsigned bits(mask m) { return m ? 1u : 0u; }
+};
+}
+
+#if RAY_BANDIT_X86_SIMD
+
+// Kernels must match the scalar code bit for bit, so none of the regions below enable FMA
+// and contraction of separate multiplies and adds is switched off.
+
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#pragma GCC optimize("fp-contract=off")
+namespace simd_sse4 {
+struct lanes {
+#ifdef RAY_BANDIT_FLOAT
+    typedef __m128 value;
+    typedef __m128 mask;
+    static const int width = 4;
+    static value load(const real* p) { return _mm_loadu_ps(p); }
+    static value load_bytes(const uint8_t* p) {
+        int32_t b;
+        std::memcpy(&b, p, 4);
+        return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(b)));
+    }
+    static void store(real* p, value v) { _mm_storeu_ps(p, v); }
+    static value broadcast(real x) { return _mm_set1_ps(x); }
+    static value add(value a, value b) { return _mm_add_ps(a, b); }
+    static value sub(value a, value b) { return _mm_sub_ps(a, b); }
+    static value mul(value a, value b) { return _mm_mul_ps(a, b); }
+    static value div(value a, value b) { return _mm_div_ps(a, b); }
+    static value sqrt(value a) { return _mm_sqrt_ps(a); }
+    static mask less(value a, value b) { return _mm_cmplt_ps(a, b); }
+    static mask greater(value a, value b) { return _mm_cmpgt_ps(a, b); }
+    static mask equal(value a, value b) { return _mm_cmpeq_ps(a, b); }
+    static mask not_less(value a, value b) { return _mm_cmpnlt_ps(a, b); }
+    static mask both(mask a, mask b) { return _mm_and_ps(a, b); }
+    static value select(mask m, value a, value b) { return _mm_blendv_ps(b, a, m); } // m ? a : b
+    static unsigned bits(mask m) { return static_cast<unsigned>(_mm_movemask_ps(m)); }
+#else
+    typedef __m128d value;
+    typedef __m128d mask;
+    static const int width = 2;
+    static value load(const real* p) { return _mm_loadu_pd(p); }
+    static value load_bytes(const uint8_t* p) {
+        uint16_t b;
+        std::memcpy(&b, p, 2);
+        return _mm_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(b)));
+    }
+    static void store(real* p, value v) { _mm_storeu_pd(p, v); }
+    static value broadcast(real x) { return _mm_set1_pd(x); }
+    static value add(value a, value b) { return _mm_add_pd(a, b); }
+    static value sub(value a, value b) { return _mm_sub_pd(a, b); }
+    static value mul(value a, value b) { return _mm_mul_pd(a, b); }
+    static value div(value a, value b) { return _mm_div_pd(a, b); }
+    static value sqrt(value a) { return _mm_sqrt_pd(a); }
+    static mask less(value a, value b) { return _mm_cmplt_pd(a, b); }
+    static mask greater(value a, value b) { return _mm_cmpgt_pd(a, b); }
+    static mask equal(value a, value b) { return _mm_cmpeq_pd(a, b); }
+    static mask not_less(value a, value b) { return _mm_cmpnlt_pd(a, b); }
+    static mask both(mask a, mask b) { return _mm_and_pd(a, b); }
+    static value select(mask m, value a, value b) { return _mm_blendv_pd(b, a, m); } // m ? a : b
+    static unsigned bits(mask m) { return static_cast<unsigned>(_mm_movemask_pd(m)); }
+#endif
+};
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#pragma GCC optimize("fp-contract=off")
+namespace simd_avx2 {
+struct lanes {
+#ifdef RAY_BANDIT_FLOAT
+    typedef __m256 value;
+    typedef __m256 mask;
+    static const int width = 8;
+    static value load(const real* p) { return _mm256_loadu_ps(p); }
+    static value load_bytes(const uint8_t* p) {
+        return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+    }
+    static void store(real* p, value v) { _mm256_storeu_ps(p, v); }
+    static value broadcast(real x) { return _mm256_set1_ps(x); }
+    static value add(value a, value b) { return _mm256_add_ps(a, b); }
+    static value sub(value a, value b) { return _mm256_sub_ps(a, b); }
+    static value mul(value a, value b) { return _mm256_mul_ps(a, b); }
+    static value div(value a, value b) { return _mm256_div_ps(a, b); }
+    static value sqrt(value a) { return _mm256_sqrt_ps(a); }
+    static mask less(value a, value b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static mask greater(value a, value b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static mask equal(value a, value b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static mask not_less(value a, value b) { return _mm256_cmp_ps(a, b, _CMP_NLT_UQ); }
+    static mask both(mask a, mask b) { return _mm256_and_ps(a, b); }
+    static value select(mask m, value a, value b) { return _mm256_blendv_ps(b, a, m); }
+    static unsigned bits(mask m) { return static_cast<unsigned>(_mm256_movemask_ps(m)); }
+#else
+    typedef __m256d value;
+    typedef __m256d mask;
+    static const int width = 4;
+    static value load(const real* p) { return _mm256_loadu_pd(p); }
+    static value load_bytes(const uint8_t* p) {
+        int32_t b;
+        std::memcpy(&b, p, 4);
+        return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(b)));
+    }
+    static void store(real* p, value v) { _mm256_storeu_pd(p, v); }
+    static value broadcast(real x) { return _mm256_set1_pd(x); }
+    static value add(value a, value b) { return _mm256_add_pd(a, b); }
+    static value sub(value a, value b) { return _mm256_sub_pd(a, b); }
+    static value mul(value a, value b) { return _mm256_mul_pd(a, b); }
+    static value div(value a, value b) { return _mm256_div_pd(a, b); }
+    static value sqrt(value a) { return _mm256_sqrt_pd(a); }
+    static mask less(value a, value b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static mask greater(value a, value b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static mask equal(value a, value b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static mask not_less(value a, value b) { return _mm256_cmp_pd(a, b, _CMP_NLT_UQ); }
+    static mask both(mask a, mask b) { return _mm256_and_pd(a, b); }
+    static value select(mask m, value a, value b) { return _mm256_blendv_pd(b, a, m); }
+    static unsigned bits(mask m) { return static_cast<unsigned>(_mm256_movemask_pd(m)); }
+#endif
+};
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#pragma GCC optimize("fp-contract=off")
+namespace simd_avx512 {
+struct lanes {
+#ifdef RAY_BANDIT_FLOAT
+    typedef __m512 value;
+    typedef __mmask16 mask;
+    static const int width = 16;
+    static value load(const real* p) { return _mm512_loadu_ps(p); }
+    static value load_bytes(const uint8_t* p) {
+        return _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+    }
+    static void store(real* p, value v) { _mm512_storeu_ps(p, v); }
+    static value broadcast(real x) { return _mm512_set1_ps(x); }
+    static value add(value a, value b) { return _mm512_add_ps(a, b); }
+    static value sub(value a, value b) { return _mm512_sub_ps(a, b); }
+    static value mul(value a, value b) { return _mm512_mul_ps(a, b); }
+    static value div(value a, value b) { return _mm512_div_ps(a, b); }
+    static value sqrt(value a) { return _mm512_sqrt_ps(a); }
+    static mask less(value a, value b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static mask greater(value a, value b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static mask equal(value a, value b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+    static mask not_less(value a, value b) { return _mm512_cmp_ps_mask(a, b, _CMP_NLT_UQ); }
+    static mask both(mask a, mask b) { return static_cast<mask>(a & b); }
+    static value select(mask m, value a, value b) { return _mm512_mask_blend_ps(m, b, a); }
+    static unsigned bits(mask m) { return static_cast<unsigned>(m); }
+#else
+    typedef __m512d value;
+    typedef __mmask8 mask;
+    static const int width = 8;
+    static value load(const real* p) { return _mm512_loadu_pd(p); }
+    static value load_bytes(const uint8_t* p) {
+        return _mm512_maskz_cvtepi32_pd(0xFF, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+    }
+    static void store(real* p, value v) { _mm512_storeu_pd(p, v); }
+    static value broadcast(real x) { return _mm512_set1_pd(x); }
+    static value add(value a, value b) { return _mm512_add_pd(a, b); }
+    static value sub(value a, value b) { return _mm512_sub_pd(a, b); }
+    static value mul(value a, value b) { return _mm512_mul_pd(a, b); }
+    static value div(value a, value b) { return _mm512_div_pd(a, b); }
+    static value sqrt(value a) { return _mm512_sqrt_pd(a); }
+    static mask less(value a, value b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static mask greater(value a, value b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+    static mask equal(value a, value b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+    static mask not_less(value a, value b) { return _mm512_cmp_pd_mask(a, b, _CMP_NLT_UQ); }
+    static mask both(mask a, mask b) { return static_cast<mask>(a & b); }
+    static value select(mask m, value a, value b) { return _mm512_mask_blend_pd(m, b, a); }
+    static unsigned bits(mask m) { return static_cast<unsigned>(m); }
+#endif
+};
+}
+#pragma GCC pop_options
+
+#endif
+
+#endif
@@ -4,41 +4,96 @@
 #include "scene_objects.h"
 #include "vec3.h"
 
-class sphere : public scene_object {
-    public:
-    sphere(point3 _center, double _radius, shared_ptr<material> _material) : center(_center), radius(_radius), mat(_material) {}
+struct sphere_shape {
+    // Plain sphere data with a non-virtual hit test. Containers that store spheres by
+    // value (see typed_scene_list.h) call it directly so the compiler can inline it.
+    point3 center;
+    real radius; // may be negative for hollow glass spheres, which flips the normals
+    material_id mat;
 
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const {
         vec3 oc = r.origin() - center;
         auto a = r.direction().length_squared();
         auto half_b = dot(oc, r.direction());
         auto c = oc.length_squared() - radius*radius;
 
-        auto discriminant = half_b*half_b - a*c;
-        if (discriminant < 0) return false;
-        auto sqrtd = sqrt(discriminant);
+        // half_b*half_b - a*c cancels catastrophically for large or distant spheres
+        // (fatal in single precision), so compute the discriminant from the squared
+        // distance between the center and the ray instead, which is equivalent.
+        // Everything is scaled by a so misses are rejected without a division.
+        vec3 scaled_closest = a*oc - half_b*r.direction();
+        auto scaled_discriminant = a*a*radius*radius - scaled_closest.length_squared();
+        if (scaled_discriminant < 0) return false;
+        auto sqrtd = sqrt(scaled_discriminant / a);
+
+        // Avoid subtracting nearly equal values: get the larger magnitude root directly
+        // and the other one from the product of the roots, c/a
+        auto q = half_b > 0 ? -half_b - sqrtd : -half_b + sqrtd;
+        auto near_root = q / a, far_root = c / q;
+        if (near_root > far_root) {
+            auto swap = near_root;
+            near_root = far_root;
+            far_root = swap;
+        }
 
         // Find the nearest root between t_min and t_max
-        auto root = (-half_b - sqrtd) / a;
+        auto root = near_root;
         if (!ray_t.surrounds(root)) {
-            root = (-half_b + sqrtd) / a;
+            root = far_root;
             if (!ray_t.surrounds(root))
                 return false; // both roots out of range
         }
 
+        set_hit(r, root, rec);
+        return true;
+    }
+
+    void set_hit(const ray& r, real root, hit_record& rec) const {
+        // Fills in rec for a hit at ray parameter root
         rec.t = root;
         rec.p = r.at(rec.t);
         vec3 outward_normal = (rec.p - center) / radius; // divide by radius for unit length
         rec.set_face_normal(r, outward_normal);
         rec.mat = mat;
+    }
 
-        return true;
+    aabb bounding_box() const {
+        // radius may be negative (hollow glass spheres), the box only cares about its size
+        auto radius_vec = vec3(fabs(radius), fabs(radius), fabs(radius));
+        return aabb(center - radius_vec, center + radius_vec);
     }
+};
+
+class sphere : public scene_object {
+    public:
+    sphere(point3 _center, real _radius, material_id _material) : shape{_center, _radius, _material} {
+        bbox = shape.bounding_box();
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return shape.hit(r, ray_t, rec);
+    }
+
+    void hit_packet(ray_packet& packet, real t_min, uint64_t rays, hit_record* records) const override {
+        // Tests several of the packet's rays per SIMD instruction, see ray_packet_kernel.h
+        real roots[ray_packet::max_size];
+        uint64_t hits = packet_sphere_hits(packet, shape.center, shape.radius, t_min, rays, roots);
+        while (hits) {
+            int k = __builtin_ctzll(hits);
+            hits &= hits - 1;
+            shape.set_hit(packet.rays[k], roots[k], records[k]);
+            packet.t_max[k] = roots[k];
+            packet.hits |= uint64_t(1) << k;
+        }
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    const sphere_shape& data() const { return shape; }
 
     private:
-    point3 center;
-    double radius;
-    shared_ptr<material> mat;
+    sphere_shape shape;
+    aabb bbox;
 
 };
 
@@ -0,0 +1,94 @@
+#ifndef SPHERE_BATCH_H
+#define SPHERE_BATCH_H
+
+#include "common.h"
+
+#include "scene_objects.h"
+#include "simd.h"
+#include "sphere.h"
+
+#include <vector>
+
+#define RAY_BANDIT_KERNEL_FILE "sphere_batch_kernel.h"
+#include "isa_kernels.h"
+
+class sphere_batch : public scene_object {
+    // Spheres stored as a structure of arrays (one array per center coordinate, radius and
+    // material) so a single SIMD instruction works on several spheres at once. hit() tests
+    // the ray against 2-16 spheres per instruction, depending on the instruction set and
+    // the precision of `real`, and reports the same closest hit as calling sphere_shape::hit
+    // on every sphere in turn. The instruction set is picked at runtime (see simd.h);
+    // `level` can be lowered to compare the kernels.
+    public:
+    simd_level level = best_simd_level();
+
+    sphere_batch() {}
+
+    void add(const sphere_shape& s) {
+        // Fill the next padding slot, or grow the arrays by one padded block
+        if (count == center_x.size()) {
+            // Padding spheres have a NaN center, which no ray ever hits
+            const real nan = std::numeric_limits<real>::quiet_NaN();
+            center_x.resize(count + block_size, nan);
+            center_y.resize(count + block_size, nan);
+            center_z.resize(count + block_size, nan);
+            radius.resize(count + block_size, 0);
+            mat.resize(count + block_size, 0);
+        }
+        center_x[count] = s.center[0];
+        center_y[count] = s.center[1];
+        center_z[count] = s.center[2];
+        radius[count] = s.radius;
+        mat[count] = s.mat;
+        ++count;
+        bbox = aabb(bbox, s.bounding_box());
+    }
+
+    void clear() {
+        center_x.clear();
+        center_y.clear();
+        center_z.clear();
+        radius.clear();
+        mat.clear();
+        count = 0;
+        bbox = aabb();
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    sphere_shape operator[](size_t i) const {
+        return sphere_shape{point3(center_x[i], center_y[i], center_z[i]), radius[i], mat[i]};
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (count == 0)
+            return false;
+
+        real closest_t = ray_t.max;
+        size_t closest_index = 0;
+        simd_level kernel = simd_level_supported(level) ? level : best_simd_level();
+        // The arrays always hold whole blocks of 16, which every width divides; the scalar
+        // kernel can stop at the last sphere
+        size_t tested = kernel == simd_level::scalar ? count : center_x.size();
+        bool found = RAY_BANDIT_SIMD_DISPATCH(kernel, closest_sphere(center_x.data(), center_y.data(), center_z.data(),
+                                                                     radius.data(), tested, r, ray_t, closest_t,
+                                                                     closest_index));
+
+        if (found)
+            (*this)[closest_index].set_hit(r, closest_t, rec);
+        return found;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    private:
+    static const size_t block_size = 16; // lanes of the widest kernel (AVX-512 float)
+
+    std::vector<real> center_x, center_y, center_z, radius;
+    std::vector<material_id> mat;
+    size_t count = 0; // spheres added; the arrays are padded up to a multiple of block_size
+    aabb bbox;
+};
+
+#endif
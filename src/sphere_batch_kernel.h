@@ -0,0 +1,93 @@
+// Vectorized closest-hit loop of sphere_batch, written against a `lanes` type that wraps
+// one SIMD instruction set. sphere_batch.h builds this file once per instruction set
+// through isa_kernels.h, so there is deliberately no include guard.
+//
+// The arithmetic mirrors sphere_shape::hit operation for operation (same order, no fused
+// multiply-adds), so every lane computes exactly the root the scalar code would. That only
+// holds while the scalar code isn't contracted to FMA itself, e.g. by -march=native.
+
+inline bool closest_sphere(const real* center_x, const real* center_y, const real* center_z,
+                           const real* radius, size_t count, const ray& r, interval ray_t,
+                           real& closest_t, size_t& closest_index) {
+    // count must be a multiple of lanes::width. On a hit, closest_t and closest_index
+    // describe the nearest sphere whose root lies inside ray_t.
+    typedef typename lanes::value value;
+    typedef typename lanes::mask mask;
+
+    point3 origin = r.origin();
+    vec3 direction = r.direction();
+    real a = direction.length_squared();
+
+    const value origin_x = lanes::broadcast(origin[0]);
+    const value origin_y = lanes::broadcast(origin[1]);
+    const value origin_z = lanes::broadcast(origin[2]);
+    const value direction_x = lanes::broadcast(direction[0]);
+    const value direction_y = lanes::broadcast(direction[1]);
+    const value direction_z = lanes::broadcast(direction[2]);
+    const value a_lanes = lanes::broadcast(a);
+    const value a_squared = lanes::broadcast(a*a);
+    const value zero = lanes::broadcast(0);
+    const value negative_zero = lanes::broadcast(-static_cast<real>(0));
+    const value t_min = lanes::broadcast(ray_t.min);
+
+    bool hit_anything = false;
+    real t_max = ray_t.max;
+    real roots[lanes::width];
+
+    for (size_t first = 0; first < count; first += lanes::width) {
+        value oc_x = lanes::sub(origin_x, lanes::load(center_x + first));
+        value oc_y = lanes::sub(origin_y, lanes::load(center_y + first));
+        value oc_z = lanes::sub(origin_z, lanes::load(center_z + first));
+        value rad = lanes::load(radius + first);
+        value rad_squared = lanes::mul(rad, rad);
+
+        value half_b = lanes::add(lanes::add(lanes::mul(oc_x, direction_x), lanes::mul(oc_y, direction_y)),
+                                  lanes::mul(oc_z, direction_z));
+        value closest_x = lanes::sub(lanes::mul(a_lanes, oc_x), lanes::mul(half_b, direction_x));
+        value closest_y = lanes::sub(lanes::mul(a_lanes, oc_y), lanes::mul(half_b, direction_y));
+        value closest_z = lanes::sub(lanes::mul(a_lanes, oc_z), lanes::mul(half_b, direction_z));
+        value closest_squared = lanes::add(lanes::add(lanes::mul(closest_x, closest_x), lanes::mul(closest_y, closest_y)),
+                                           lanes::mul(closest_z, closest_z));
+        value scaled_discriminant = lanes::sub(lanes::mul(lanes::mul(a_squared, rad), rad), closest_squared);
+
+        mask crossing = lanes::not_less(scaled_discriminant, zero);
+        if (lanes::bits(crossing) == 0)
+            continue; // the ray misses all of these spheres
+
+        value c = lanes::sub(lanes::add(lanes::add(lanes::mul(oc_x, oc_x), lanes::mul(oc_y, oc_y)),
+                                        lanes::mul(oc_z, oc_z)),
+                             rad_squared);
+        value sqrtd = lanes::sqrt(lanes::div(scaled_discriminant, a_lanes));
+        value minus_half_b = lanes::sub(negative_zero, half_b); // exact negation, also of 0
+        value q = lanes::select(lanes::greater(half_b, zero),
+                                lanes::sub(minus_half_b, sqrtd), lanes::add(minus_half_b, sqrtd));
+        value near_root = lanes::div(q, a_lanes);
+        value far_root = lanes::div(c, q);
+        mask swapped = lanes::greater(near_root, far_root);
+        value low = lanes::select(swapped, far_root, near_root);
+        value high = lanes::select(swapped, near_root, far_root);
+
+        value t_max_lanes = lanes::broadcast(t_max);
+        mask low_inside = lanes::both(lanes::less(t_min, low), lanes::less(low, t_max_lanes));
+        value root = lanes::select(low_inside, low, high);
+        mask inside = lanes::both(crossing, lanes::both(lanes::less(t_min, root), lanes::less(root, t_max_lanes)));
+
+        unsigned hits = lanes::bits(inside);
+        if (hits == 0)
+            continue;
+
+        // Walk the hits in sphere order and keep strictly closer ones, which gives the
+        // same winner as testing the spheres one after another
+        lanes::store(roots, root);
+        for (int lane = 0; lane < lanes::width; ++lane) {
+            if ((hits >> lane) & 1u && roots[lane] < t_max) {
+                t_max = roots[lane];
+                closest_index = first + lane;
+                hit_anything = true;
+            }
+        }
+    }
+
+    closest_t = t_max;
+    return hit_anything;
+}
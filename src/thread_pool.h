@@ -0,0 +1,170 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline int default_thread_count() {
+    // hardware_concurrency() is allowed to return 0 when it can't tell
+    unsigned int n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : static_cast<int>(n);
+}
+
+class thread_pool {
+    // A fixed set of worker threads which run parallel_for jobs using work stealing.
+    // Each job's items are dealt out in contiguous blocks, one deque per worker. A worker
+    // takes items from the front of its own deque and, once that runs dry, steals from the
+    // back of another worker's deque. That way a worker which drew a block of cheap items
+    // (e.g. tiles of empty sky) ends up helping the ones stuck on expensive items.
+    // The thread calling parallel_for takes part as worker 0.
+    public:
+    explicit thread_pool(int threads = 0)
+        : thread_count(threads > 0 ? threads : default_thread_count()),
+          queues(new work_queue[thread_count]) {
+        for (int w = 1; w < thread_count; ++w)
+            workers.emplace_back(&thread_pool::worker_loop, this, w);
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    int size() const { return thread_count; }
+
+    template <typename Func>
+    void parallel_for(int count, const Func& body) {
+        // Calls body(item, worker) for every item in [0, count) and returns once all of
+        // them are finished. `worker` is in [0, size()) and is unique among the threads
+        // running at the same time, so it can index per-thread scratch data.
+        // Calls made from inside a running job are executed inline on the calling thread.
+        // Nested in a job of this pool, they keep that thread's worker index, so scratch
+        // data stays private. Nested in another pool's job, worker is 0, which is only
+        // unique if no other thread uses this pool at the same time.
+        if (count <= 0)
+            return;
+        const job_context& context = current_context();
+        if (thread_count == 1 || context.pool) {
+            int worker = context.pool == this ? context.worker : 0;
+            for (int i = 0; i < count; ++i)
+                body(i, worker);
+            return;
+        }
+
+        for (int w = 0; w < thread_count; ++w) {
+            int begin = static_cast<int>(static_cast<long long>(count) * w / thread_count);
+            int end   = static_cast<int>(static_cast<long long>(count) * (w + 1) / thread_count);
+            for (int i = begin; i < end; ++i)
+                queues[w].items.push_back(i);
+        }
+
+        std::function<void(int, int)> job = [&body](int item, int worker) { body(item, worker); };
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            current_job = &job;
+            pending = thread_count - 1;
+            ++generation;
+        }
+        wake.notify_all();
+
+        run_items(0);
+
+        std::unique_lock<std::mutex> guard(state_lock);
+        finished.wait(guard, [this] { return pending == 0; });
+        current_job = nullptr;
+    }
+
+    private:
+    struct work_queue {
+        std::mutex lock;
+        std::deque<int> items;
+    };
+
+    int thread_count;
+    std::unique_ptr<work_queue[]> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex state_lock;              // guards everything below
+    std::condition_variable wake;       // signalled when a job is posted or the pool stops
+    std::condition_variable finished;   // signalled when the last helper finishes a job
+    const std::function<void(int, int)>* current_job = nullptr;
+    unsigned long generation = 0;       // bumped once per posted job
+    int pending = 0;                    // helpers that haven't finished the current job
+    bool stopping = false;
+
+    struct job_context {
+        const thread_pool* pool;  // whose job this thread is running, null outside jobs
+        int worker;               // the thread's worker index in that pool
+    };
+
+    static job_context& current_context() {
+        static thread_local job_context context = { nullptr, 0 };
+        return context;
+    }
+
+    bool take_own(int w, int& item) {
+        std::lock_guard<std::mutex> guard(queues[w].lock);
+        if (queues[w].items.empty())
+            return false;
+        item = queues[w].items.front();
+        queues[w].items.pop_front();
+        return true;
+    }
+
+    bool steal(int w, int& item) {
+        // Try the other workers in turn, starting with our neighbour
+        for (int k = 1; k < thread_count; ++k) {
+            auto& victim = queues[(w + k) % thread_count];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.items.empty()) {
+                item = victim.items.back();
+                victim.items.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run_items(int w) {
+        job_context outer = current_context();
+        current_context() = job_context{ this, w };
+        int item;
+        while (take_own(w, item) || steal(w, item))
+            (*current_job)(item, w);
+        current_context() = outer;
+    }
+
+    void worker_loop(int w) {
+        unsigned long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(state_lock);
+                wake.wait(guard, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            run_items(w);
+            {
+                std::lock_guard<std::mutex> guard(state_lock);
+                if (--pending == 0)
+                    finished.notify_one();
+            }
+        }
+    }
+};
+
+#endif
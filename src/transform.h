@@ -0,0 +1,124 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "common.h"
+
+#include "aabb.h"
+
+class affine_transform {
+    // Affine map p -> A p + b, stored as the 3x4 matrix [A | b]. Transforms compose like
+    // matrices: (a * b) applies b first, then a.
+    public:
+    real m[3][4];
+
+    affine_transform() {
+        for (int row = 0; row < 3; ++row)
+            for (int col = 0; col < 4; ++col)
+                m[row][col] = row == col ? 1 : 0;
+    }
+
+    static affine_transform translate(const vec3& offset) {
+        affine_transform t;
+        for (int row = 0; row < 3; ++row)
+            t.m[row][3] = offset[row];
+        return t;
+    }
+
+    static affine_transform scale(const vec3& factors) {
+        affine_transform t;
+        for (int row = 0; row < 3; ++row)
+            t.m[row][row] = factors[row];
+        return t;
+    }
+
+    static affine_transform rotate(const vec3& axis, double degrees) {
+        // Counterclockwise rotation about axis (through the origin) when looking down it
+        vec3 u = unit_vector(axis);
+        double angle = degrees_to_radians(degrees);
+        double c = std::cos(angle), s = std::sin(angle), k = 1 - c;
+        double x = u[0], y = u[1], z = u[2];
+        affine_transform t;
+        t.m[0][0] = x*x*k + c;   t.m[0][1] = x*y*k - z*s; t.m[0][2] = x*z*k + y*s;
+        t.m[1][0] = y*x*k + z*s; t.m[1][1] = y*y*k + c;   t.m[1][2] = y*z*k - x*s;
+        t.m[2][0] = z*x*k - y*s; t.m[2][1] = z*y*k + x*s; t.m[2][2] = z*z*k + c;
+        return t;
+    }
+
+    point3 point(const point3& p) const {
+        return point3(m[0][0]*p[0] + m[0][1]*p[1] + m[0][2]*p[2] + m[0][3],
+                      m[1][0]*p[0] + m[1][1]*p[1] + m[1][2]*p[2] + m[1][3],
+                      m[2][0]*p[0] + m[2][1]*p[1] + m[2][2]*p[2] + m[2][3]);
+    }
+
+    vec3 vector(const vec3& v) const {
+        return vec3(m[0][0]*v[0] + m[0][1]*v[1] + m[0][2]*v[2],
+                    m[1][0]*v[0] + m[1][1]*v[1] + m[1][2]*v[2],
+                    m[2][0]*v[0] + m[2][1]*v[1] + m[2][2]*v[2]);
+    }
+
+    vec3 transposed_vector(const vec3& v) const {
+        // A^T v. Normals are carried from object to world space by the transpose of the
+        // world to object map, so they stay perpendicular to transformed surfaces.
+        return vec3(m[0][0]*v[0] + m[1][0]*v[1] + m[2][0]*v[2],
+                    m[0][1]*v[0] + m[1][1]*v[1] + m[2][1]*v[2],
+                    m[0][2]*v[0] + m[1][2]*v[1] + m[2][2]*v[2]);
+    }
+
+    aabb box(const aabb& b) const {
+        // Box around the transformed box: each output axis takes the smaller and larger
+        // product per input axis (Arvo's method), so no corners need transforming
+        if (b.empty())
+            return b;
+        interval axes[3];
+        for (int row = 0; row < 3; ++row) {
+            real lo = m[row][3], hi = m[row][3];
+            for (int col = 0; col < 3; ++col) {
+                real a = m[row][col] * b.axis(col).min;
+                real c = m[row][col] * b.axis(col).max;
+                lo += fmin(a, c);
+                hi += fmax(a, c);
+            }
+            axes[row] = interval(lo, hi);
+        }
+        return aabb(axes[0], axes[1], axes[2]);
+    }
+
+    double determinant() const {
+        return m[0][0] * (double(m[1][1])*m[2][2] - double(m[1][2])*m[2][1])
+             - m[0][1] * (double(m[1][0])*m[2][2] - double(m[1][2])*m[2][0])
+             + m[0][2] * (double(m[1][0])*m[2][1] - double(m[1][1])*m[2][0]);
+    }
+
+    affine_transform inverse() const {
+        // The inverse of A by cofactors (in double), then b' = -A^-1 b. A singular
+        // transform (e.g. a zero scale) has no inverse and gives non-finite entries.
+        double a[3][3];
+        for (int row = 0; row < 3; ++row)
+            for (int col = 0; col < 3; ++col)
+                a[row][col] = m[row][col];
+        double inv_det = 1 / determinant();
+        affine_transform t;
+        for (int row = 0; row < 3; ++row) {
+            for (int col = 0; col < 3; ++col) {
+                int r1 = (col + 1) % 3, r2 = (col + 2) % 3, c1 = (row + 1) % 3, c2 = (row + 2) % 3;
+                t.m[row][col] = static_cast<real>((a[r1][c1]*a[r2][c2] - a[r1][c2]*a[r2][c1]) * inv_det);
+            }
+        }
+        for (int row = 0; row < 3; ++row)
+            t.m[row][3] = -(t.m[row][0]*m[0][3] + t.m[row][1]*m[1][3] + t.m[row][2]*m[2][3]);
+        return t;
+    }
+};
+
+inline affine_transform operator*(const affine_transform& a, const affine_transform& b) {
+    affine_transform t;
+    for (int row = 0; row < 3; ++row) {
+        for (int col = 0; col < 4; ++col) {
+            t.m[row][col] = a.m[row][0]*b.m[0][col] + a.m[row][1]*b.m[1][col] + a.m[row][2]*b.m[2][col]
+                          + (col == 3 ? a.m[row][3] : 0);
+        }
+    }
+    return t;
+}
+
+#endif
@@ -3,49 +3,57 @@
 
 #include "scene_objects.h"
 #include "vec3.h"
+#include "watertight.h"
 
-class triangle : public scene_object {
-    public:
-    triangle(point3 v_a, point3 v_b, point3 v_c, vec3 n, shared_ptr<material> _mat) : vertex_a(v_a), vertex_b(v_b), vertex_c(v_c), normal(n), mat(_mat) {}
+struct triangle_shape {
+    // Plain triangle data with a non-virtual hit test, see sphere_shape
+    point3 vertex_a;
+    point3 vertex_b;
+    point3 vertex_c;
+    vec3   normal;
+    material_id mat;
 
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const {
+        return hit(watertight_ray(r), r, ray_t, rec);
+    }
 
-        // Does the ray intersect the plane in which the triangle is situated?
-        auto denom = dot(r.direction(), normal);
-        auto numer = dot((vertex_a - r.origin()), normal);
-        if (denom <= 0.01 & denom >= -0.01) {
-            return false; // line and plane are parallel
-                          // which we reject even if they coincide
-        }
-        // Does the point of intersection lie within the triangle's sides?
-        auto t = numer / denom;
-        if (!ray_t.surrounds(t)) {
-            return false; 
-        }
-        vec3 intersect_point = r.at(t);
-
-        if (dot((cross(vertex_b - vertex_a, intersect_point - vertex_a)), normal) < 0)
-            return false;
-        if (dot((cross(vertex_c - vertex_b, intersect_point - vertex_b)), normal) < 0)
+    bool hit(const watertight_ray& wr, const ray& r, interval ray_t, hit_record& rec) const {
+        // Watertight test (see watertight.h), so rays through a shared edge never slip
+        // between neighbouring triangles and grazing rays are not rejected. Loops over
+        // many triangles set up wr once per ray.
+        real t, weights[3];
+        if (!watertight_intersect<real>(wr, vertex_a, vertex_b, vertex_c, ray_t, t, weights))
             return false;
-        if (dot((cross(vertex_a - vertex_c, intersect_point - vertex_c)), normal) < 0)
-            return false;       
 
-        // std::cout << normal << " + " << intersect_point << std::endl;        
-        // We now know the ray intersects the triangle
         rec.t = t;
-        rec.p = intersect_point;
+        rec.p = r.at(t);
         rec.set_face_normal(r, unit_vector(normal)); // Might not be normalized
         rec.mat = mat;
         return true;
     }
 
+    aabb bounding_box() const {
+        return aabb(aabb(vertex_a, vertex_b), aabb(vertex_c, vertex_c)).pad();
+    }
+};
+
+class triangle : public scene_object {
+    public:
+    triangle(point3 v_a, point3 v_b, point3 v_c, vec3 n, material_id _mat) : shape{v_a, v_b, v_c, n, _mat} {
+        bbox = shape.bounding_box();
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return shape.hit(r, ray_t, rec);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    const triangle_shape& data() const { return shape; }
+
     private:
-    point3 vertex_a;
-    point3 vertex_b;
-    point3 vertex_c;
-    vec3   normal;
-    shared_ptr<material> mat;
+    triangle_shape shape;
+    aabb bbox;
 
 };
 
@@ -0,0 +1,44 @@
+#ifndef TRIANGLE_BLOCK_H
+#define TRIANGLE_BLOCK_H
+
+#include "common.h"
+
+#include "simd.h"
+#include "watertight.h"
+
+#include <cstdint>
+
+struct triangle_block {
+    // Up to `width` triangles stored for SIMD testing: the vertices are copied out of the
+    // index buffer into one array per corner and axis, so a group of lanes is tested with
+    // straight loads and no gathers. Unused slots past `count` are padding.
+    static const int width = 8;
+
+    real vertex[3][3][width]; // [corner][axis][slot]
+    uint32_t id[width];       // the triangle's index in its mesh
+    int count;
+};
+
+#define RAY_BANDIT_KERNEL_FILE "triangle_block_kernel.h"
+#include "isa_kernels.h"
+
+inline simd_level triangle_block_level(simd_level requested) {
+    // Widest supported instruction set up to requested whose vectors fit in a block: in the
+    // float build AVX-512 holds 16 lanes, more than a block, so AVX2 is used instead
+    simd_level level = simd_level_supported(requested) ? requested : best_simd_level();
+#if RAY_BANDIT_X86_SIMD
+    if (level == simd_level::avx512 && simd_avx512::lanes::width > triangle_block::width)
+        level = simd_level::avx2;
+#endif
+    return level;
+}
+
+inline bool closest_triangle(simd_level level, const triangle_block* blocks, int block_count,
+                             const watertight_ray& wr, interval ray_t, real& closest_t, real (&weights)[3],
+                             uint32_t& closest_id) {
+    // Dispatches to the kernel for level, which should come from triangle_block_level()
+    return RAY_BANDIT_SIMD_DISPATCH(level, closest_triangle(blocks, block_count, wr, ray_t, closest_t, weights,
+                                                            closest_id));
+}
+
+#endif
@@ -0,0 +1,101 @@
+// Vectorized watertight test of a ray against blocks of triangles, written against a
+// `lanes` type (see simd.h) and built by triangle_block.h once per instruction set through
+// isa_kernels.h, so there is deliberately no include guard. The math is that of
+// watertight_intersect.
+
+inline bool closest_triangle(const triangle_block* blocks, int block_count, const watertight_ray& wr,
+                             interval ray_t, real& closest_t, real (&weights)[3], uint32_t& closest_id) {
+    // Finds the nearest hit inside ray_t among the triangles of the blocks. On a hit,
+    // closest_t, weights and closest_id describe it.
+    typedef typename lanes::value value;
+
+    const value ox = lanes::broadcast(wr.origin[wr.kx]);
+    const value oy = lanes::broadcast(wr.origin[wr.ky]);
+    const value oz = lanes::broadcast(wr.origin[wr.kz]);
+    const value sx = lanes::broadcast(static_cast<real>(wr.sx));
+    const value sy = lanes::broadcast(static_cast<real>(wr.sy));
+    const value sz = lanes::broadcast(static_cast<real>(wr.sz));
+    const value zero = lanes::broadcast(0);
+    const value t_min = lanes::broadcast(ray_t.min);
+    const bool single_precision = sizeof(real) < sizeof(double);
+
+    bool hit_anything = false;
+    real t_max = ray_t.max;
+    real lane_t[lanes::width], lane_u[lanes::width], lane_v[lanes::width], lane_w[lanes::width];
+
+    for (int k = 0; k < block_count; ++k) {
+        const triangle_block& block = blocks[k];
+        for (int first = 0; first < triangle_block::width; first += lanes::width) {
+            value a_z = lanes::sub(lanes::load(block.vertex[0][wr.kz] + first), oz);
+            value b_z = lanes::sub(lanes::load(block.vertex[1][wr.kz] + first), oz);
+            value c_z = lanes::sub(lanes::load(block.vertex[2][wr.kz] + first), oz);
+            value a_x = lanes::sub(lanes::sub(lanes::load(block.vertex[0][wr.kx] + first), ox), lanes::mul(sx, a_z));
+            value a_y = lanes::sub(lanes::sub(lanes::load(block.vertex[0][wr.ky] + first), oy), lanes::mul(sy, a_z));
+            value b_x = lanes::sub(lanes::sub(lanes::load(block.vertex[1][wr.kx] + first), ox), lanes::mul(sx, b_z));
+            value b_y = lanes::sub(lanes::sub(lanes::load(block.vertex[1][wr.ky] + first), oy), lanes::mul(sy, b_z));
+            value c_x = lanes::sub(lanes::sub(lanes::load(block.vertex[2][wr.kx] + first), ox), lanes::mul(sx, c_z));
+            value c_y = lanes::sub(lanes::sub(lanes::load(block.vertex[2][wr.ky] + first), oy), lanes::mul(sy, c_z));
+
+            value u = lanes::sub(lanes::mul(c_x, b_y), lanes::mul(c_y, b_x));
+            value v = lanes::sub(lanes::mul(a_x, c_y), lanes::mul(a_y, c_x));
+            value w = lanes::sub(lanes::mul(b_x, a_y), lanes::mul(b_y, a_x));
+
+            // Lanes with a negative and a positive edge function are outside the triangle
+            unsigned outside = (lanes::bits(lanes::less(u, zero)) | lanes::bits(lanes::less(v, zero))
+                                | lanes::bits(lanes::less(w, zero)))
+                             & (lanes::bits(lanes::greater(u, zero)) | lanes::bits(lanes::greater(v, zero))
+                                | lanes::bits(lanes::greater(w, zero)));
+            int used = block.count - first; // lanes past the block's last triangle are padding
+            unsigned valid = used >= lanes::width ? (1u << lanes::width) - 1 : (1u << (used > 0 ? used : 0)) - 1;
+            unsigned degenerate = 0; // lanes redone in double, see watertight_intersect
+            if (single_precision)
+                degenerate = valid & (lanes::bits(lanes::equal(u, zero)) | lanes::bits(lanes::equal(v, zero))
+                                      | lanes::bits(lanes::equal(w, zero)));
+            unsigned candidates = valid & ~outside & ~degenerate;
+            if ((candidates | degenerate) == 0)
+                continue;
+
+            value det = lanes::add(lanes::add(u, v), w);
+            value scaled_t = lanes::add(lanes::add(lanes::mul(u, lanes::mul(sz, a_z)), lanes::mul(v, lanes::mul(sz, b_z))),
+                                        lanes::mul(w, lanes::mul(sz, c_z)));
+            value t = lanes::div(scaled_t, det);
+            // t is NaN for det == 0, which fails both tests
+            unsigned inside = candidates
+                            & lanes::bits(lanes::both(lanes::less(t_min, t), lanes::less(t, lanes::broadcast(t_max))));
+            if ((inside | degenerate) == 0)
+                continue;
+
+            lanes::store(lane_t, t);
+            lanes::store(lane_u, u);
+            lanes::store(lane_v, v);
+            lanes::store(lane_w, w);
+            real lane_det[lanes::width];
+            lanes::store(lane_det, det);
+
+            // Walk the candidates in triangle order and keep strictly closer ones
+            for (int lane = 0; lane < lanes::width; ++lane) {
+                int slot = first + lane;
+                if ((degenerate >> lane) & 1u) {
+                    point3 a(block.vertex[0][0][slot], block.vertex[0][1][slot], block.vertex[0][2][slot]);
+                    point3 b(block.vertex[1][0][slot], block.vertex[1][1][slot], block.vertex[1][2][slot]);
+                    point3 c(block.vertex[2][0][slot], block.vertex[2][1][slot], block.vertex[2][2][slot]);
+                    if (watertight_intersect<double>(wr, a, b, c, interval(ray_t.min, t_max), t_max, weights)) {
+                        closest_id = block.id[slot];
+                        hit_anything = true;
+                    }
+                }
+                else if ((inside >> lane) & 1u && lane_t[lane] < t_max) {
+                    t_max = lane_t[lane];
+                    weights[0] = lane_u[lane] / lane_det[lane];
+                    weights[1] = lane_v[lane] / lane_det[lane];
+                    weights[2] = lane_w[lane] / lane_det[lane];
+                    closest_id = block.id[slot];
+                    hit_anything = true;
+                }
+            }
+        }
+    }
+
+    closest_t = t_max;
+    return hit_anything;
+}
@@ -0,0 +1,236 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "common.h"
+
+#include "bvh.h"
+#include "scene_objects.h"
+#include "triangle_block.h"
+#include "watertight.h"
+#include "wide_bvh.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+struct mesh_data {
+    // Indexed triangle list as produced by the loaders in mesh_io.h. Triangle i uses the
+    // positions indices[3i], indices[3i+1] and indices[3i+2]. Normals are optional: when
+    // present they are per vertex and share `indices`, unless normal_indices is filled,
+    // in which case that list (same layout as indices) picks the normal of each corner.
+    std::vector<point3> positions;
+    std::vector<vec3> normals;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> normal_indices;
+
+    size_t triangle_count() const { return indices.size() / 3; }
+};
+
+struct triangle_mesh_arrays {
+    // Everything a built triangle_mesh traces with, as plain arrays that refer to each other
+    // only by index. They point either into the mesh's own buffers or straight into a
+    // mapped cache file (see mesh_cache.h).
+    const point3* positions = nullptr;
+    size_t position_count = 0;
+    const vec3* normals = nullptr;             // null without vertex normals
+    size_t normal_count = 0;
+    const uint32_t* indices = nullptr;         // 3 per triangle, in BVH order
+    const uint32_t* normal_indices = nullptr;  // null unless normals have their own indices
+    size_t triangle_count = 0;
+    const wide_bvh_node<8>* nodes = nullptr;
+    size_t node_count = 0;
+    const triangle_block* blocks = nullptr;
+    size_t block_count = 0;
+    aabb bbox;
+};
+
+class triangle_mesh : public scene_object {
+    // A whole triangle mesh as a single scene object. Vertices are stored once and shared
+    // through the index buffer, all triangles share one material, and the mesh carries its
+    // own BVH over the triangles. That costs far fewer bytes per triangle than a separate
+    // triangle object with its vtable pointer, shared_ptr and duplicated vertices.
+    //
+    // The BVH is built binary and collapsed into an 8 wide tree with quantized boxes (see
+    // wide_bvh.h). Its leaves hold up to triangle_block::width triangles, copied into
+    // triangle_blocks so a leaf is tested with one SIMD pass of the watertight kernel (see
+    // triangle_block.h and watertight.h). The instruction set is picked at runtime;
+    // `level` can be lowered to compare the kernels.
+    public:
+    simd_level level = best_simd_level();
+
+    triangle_mesh(mesh_data data, material_id _mat, bvh_build_method method = bvh_build_method::sah,
+                  int thread_count = 0) : mesh(std::move(data)), mat(_mat) {
+        // Builds the BVH and triangle blocks for the mesh
+        size_t count = mesh.triangle_count();
+        mesh.indices.resize(3 * count); // drop a trailing partial triangle
+        bool separate_normals = !mesh.normal_indices.empty();
+        if (separate_normals && mesh.normal_indices.size() < mesh.indices.size()) {
+            // not a normal for every corner, so ignore them
+            mesh.normal_indices.clear();
+            mesh.normals.clear();
+            separate_normals = false;
+        }
+        mesh.normal_indices.resize(separate_normals ? mesh.indices.size() : 0);
+        if (!separate_normals && mesh.normals.size() != mesh.positions.size())
+            mesh.normals.clear(); // not one normal per vertex, so ignore them
+
+        std::vector<aabb> boxes(count);
+        for (size_t i = 0; i < count; ++i) {
+            const point3& a = mesh.positions[mesh.indices[3*i]];
+            const point3& b = mesh.positions[mesh.indices[3*i + 1]];
+            const point3& c = mesh.positions[mesh.indices[3*i + 2]];
+            boxes[i] = aabb(aabb(a, b), aabb(c, c)).pad();
+        }
+
+        // Put the triangles in tree order so each leaf covers a contiguous range, then
+        // collapse the binary tree into the wide one used for tracing
+        bvh_tree binary;
+        binary.max_leaf_size = triangle_block::width;
+        binary.leaf_group = triangle_block::width;
+        binary.method = method;
+        binary.thread_count = thread_count;
+        auto order = binary.build(boxes);
+        reorder_corners(mesh.indices, order);
+        if (separate_normals)
+            reorder_corners(mesh.normal_indices, order);
+        tree_metrics = binary.metrics();
+        tree_build_seconds = binary.build_seconds;
+        tree.build(binary);
+        make_blocks();
+
+        view.positions = mesh.positions.data();
+        view.position_count = mesh.positions.size();
+        view.normals = mesh.normals.empty() ? nullptr : mesh.normals.data();
+        view.normal_count = mesh.normals.size();
+        view.indices = mesh.indices.data();
+        view.normal_indices = separate_normals ? mesh.normal_indices.data() : nullptr;
+        view.triangle_count = count;
+        view.nodes = tree.data();
+        view.node_count = tree.size();
+        view.blocks = blocks.data();
+        view.block_count = blocks.size();
+        view.bbox = tree.bounding_box();
+    }
+
+    triangle_mesh(const triangle_mesh_arrays& arrays, shared_ptr<const void> storage, material_id _mat)
+        : mat(_mat), view(arrays), external_storage(std::move(storage)) {
+        // Uses arrays of an already built mesh as they are; storage keeps them alive
+        tree.attach(view.nodes, view.node_count, view.bbox);
+    }
+
+    // The arrays point into the mesh's own buffers
+    triangle_mesh(const triangle_mesh&) = delete;
+    triangle_mesh& operator=(const triangle_mesh&) = delete;
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        watertight_ray wr(r);
+        simd_level kernel = triangle_block_level(level);
+        return tree.hit_leaves(r, ray_t, rec, [&](int first, int count, interval leaf_t, hit_record& closest) {
+            // Leaves refer to their first block; the rest follow it
+            int block_count = (count + triangle_block::width - 1) / triangle_block::width;
+            real t, weights[3];
+            uint32_t id;
+            if (!closest_triangle(kernel, &view.blocks[first], block_count, wr, leaf_t, t, weights, id))
+                return false;
+            set_hit(r, id, t, weights, closest);
+            return true;
+        });
+    }
+
+    aabb bounding_box() const override { return tree.bounding_box(); }
+
+    size_t triangle_count() const { return view.triangle_count; }
+    size_t vertex_count() const { return view.position_count; }
+    bool has_normals() const { return view.normals != nullptr; }
+    int node_count() const { return static_cast<int>(tree.size()); }
+    size_t node_bytes() const { return tree.memory_bytes(); }
+    bvh_metrics metrics() const { return tree_metrics; } // of the binary tree before collapsing
+    double build_seconds() const { return tree_build_seconds; }
+
+    int block_count() const { return static_cast<int>(view.block_count); }
+
+    size_t memory_bytes() const {
+        // Heap memory held by the mesh buffers, its BVH and the triangle blocks; a mesh
+        // using external arrays holds next to none
+        return mesh.positions.capacity() * sizeof(point3) + mesh.normals.capacity() * sizeof(vec3)
+             + mesh.indices.capacity() * sizeof(uint32_t) + mesh.normal_indices.capacity() * sizeof(uint32_t)
+             + tree.memory_bytes() + blocks.capacity() * sizeof(triangle_block);
+    }
+
+    const triangle_mesh_arrays& arrays() const { return view; }
+
+    private:
+    mesh_data mesh;
+    material_id mat;
+    triangle_mesh_arrays view;
+    shared_ptr<const void> external_storage;
+    wide_bvh_tree<8> tree;
+    bvh_metrics tree_metrics;
+    double tree_build_seconds = 0;
+    std::vector<triangle_block> blocks;
+
+    static void reorder_corners(std::vector<uint32_t>& corners, const std::vector<int>& order) {
+        std::vector<uint32_t> reordered(corners.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            reordered[3*i]     = corners[3*order[i]];
+            reordered[3*i + 1] = corners[3*order[i] + 1];
+            reordered[3*i + 2] = corners[3*order[i] + 2];
+        }
+        corners.swap(reordered);
+    }
+
+    void make_blocks() {
+        // Copies the triangles of every leaf into consecutive blocks and points the leaf at
+        // the first of them
+        blocks.clear();
+        tree.for_each_leaf([&](int32_t& first, int count) {
+            int first_triangle = first;
+            first = static_cast<int32_t>(blocks.size());
+            for (int begin = 0; begin < count; begin += triangle_block::width) {
+                triangle_block block = {};
+                block.count = std::min(count - begin, int(triangle_block::width));
+                for (int slot = 0; slot < block.count; ++slot) {
+                    uint32_t id = static_cast<uint32_t>(first_triangle + begin + slot);
+                    block.id[slot] = id;
+                    for (int corner = 0; corner < 3; ++corner) {
+                        const point3& vertex = mesh.positions[mesh.indices[3*id + corner]];
+                        for (int axis = 0; axis < 3; ++axis)
+                            block.vertex[corner][axis][slot] = vertex[axis];
+                    }
+                }
+                blocks.push_back(block);
+            }
+        });
+        blocks.shrink_to_fit();
+    }
+
+    void set_hit(const ray& r, uint32_t i, real t, const real (&weights)[3], hit_record& rec) const {
+        // Fills in rec for a hit on triangle i at ray parameter t, with the barycentric
+        // coordinates of the hit point in weights
+        const point3& a = view.positions[view.indices[3*i]];
+        const point3& b = view.positions[view.indices[3*i + 1]];
+        const point3& c = view.positions[view.indices[3*i + 2]];
+        rec.t = t;
+        rec.p = r.at(t);
+        rec.mat = mat;
+
+        // The geometric normal decides which side was hit; interpolated vertex normals
+        // only smooth the shading and are flipped to the same side
+        vec3 geometric_normal = unit_vector(cross(b - a, c - a));
+        rec.ray_facing_inwards = dot(r.direction(), geometric_normal) < 0;
+        vec3 normal = geometric_normal;
+        if (view.normals) {
+            const uint32_t* corner = view.normal_indices ? &view.normal_indices[3*i] : &view.indices[3*i];
+            vec3 shading_normal = weights[0] * view.normals[corner[0]] + weights[1] * view.normals[corner[1]]
+                                + weights[2] * view.normals[corner[2]];
+            if (shading_normal.length_squared() > 0) {
+                normal = unit_vector(shading_normal);
+                if (dot(normal, geometric_normal) < 0)
+                    normal = -normal;
+            }
+        }
+        rec.normal = rec.ray_facing_inwards ? normal : -normal;
+    }
+};
+
+#endif
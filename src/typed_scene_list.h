@@ -0,0 +1,99 @@
+#ifndef TYPED_SCENE_LIST_H
+#define TYPED_SCENE_LIST_H
+
+#include "scene_objects.h"
+#include "scene_objects_list.h"
+#include "sphere.h"
+#include "sphere_batch.h"
+#include "triangle.h"
+
+#include <memory>
+#include <vector>
+
+class typed_scene_list : public scene_object {
+    // Scene container which keeps each built-in primitive type in its own contiguous array
+    // of plain structs. hit() runs one loop per type and calls the shapes' non-virtual hit
+    // tests, so there is no pointer chase or indirect call per primitive and the kernels
+    // can be inlined. Spheres are kept in a sphere_batch and tested several at a time.
+    // Objects of any other scene_object type go into a fallback list which is tested
+    // through the virtual interface as before.
+    public:
+    sphere_batch spheres;
+    std::vector<triangle_shape> triangles;
+    std::vector<shared_ptr<scene_object>> others;
+
+    typed_scene_list() {}
+    typed_scene_list(const scene_objects_list& list) {
+        for (const auto& object : list.objects)
+            add(object);
+    }
+
+    void clear() {
+        spheres.clear();
+        triangles.clear();
+        others.clear();
+        bbox = aabb();
+    }
+
+    void add(const sphere_shape& s) {
+        spheres.add(s);
+        bbox = aabb(bbox, s.bounding_box());
+    }
+
+    void add(const triangle_shape& t) {
+        triangles.push_back(t);
+        bbox = aabb(bbox, t.bounding_box());
+    }
+
+    void add(shared_ptr<scene_object> object) {
+        // Built-in primitives are copied into their typed arrays, anything else is kept
+        // as is in the fallback list
+        if (auto s = std::dynamic_pointer_cast<sphere>(object))
+            add(s->data());
+        else if (auto t = std::dynamic_pointer_cast<triangle>(object))
+            add(t->data());
+        else {
+            others.push_back(object);
+            bbox = aabb(bbox, object->bounding_box());
+        }
+    }
+
+    size_t size() const { return spheres.size() + triangles.size() + others.size(); }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        bool hit_anything = false;
+        auto closest_so_far = ray_t.max;
+
+        // Each shape only writes rec when it finds a closer hit, so no temporary
+        // record has to be copied
+        if (spheres.hit(r, ray_t, rec)) {
+            hit_anything = true;
+            closest_so_far = rec.t;
+        }
+        watertight_ray wr(r);
+        for (const auto& t : triangles) {
+            if (t.hit(wr, r, interval(ray_t.min, closest_so_far), rec)) {
+                hit_anything = true;
+                closest_so_far = rec.t;
+            }
+        }
+
+        hit_record temp_rec;
+        for (const auto& object : others) {
+            if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec)) {
+                hit_anything = true;
+                closest_so_far = temp_rec.t;
+                rec = temp_rec;
+            }
+        }
+
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    private:
+    aabb bbox;
+};
+
+#endif
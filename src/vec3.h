@@ -10,18 +10,18 @@ using std::sqrt;
 
 class vec3 {
     public:
-        double e[3];
+        real e[3];
         
         vec3() : e{0, 0, 0} {}
-        vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+        vec3(real e0, real e1, real e2) : e{e0, e1, e2} {}
 
-        double x() const { return e[0]; }
-        double y() const { return e[1]; }
-        double z() const { return e[2]; }
+        real x() const { return e[0]; }
+        real y() const { return e[1]; }
+        real z() const { return e[2]; }
 
         vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-        double operator[](int i) const { return e[i]; }
-        double& operator[](int i) { return e[i]; }
+        real operator[](int i) const { return e[i]; }
+        real& operator[](int i) { return e[i]; }
 
         vec3& operator+=(const vec3 &v) {
             e[0] += v.e[0];
@@ -30,22 +30,22 @@ class vec3 {
             return *this;
         }
 
-        vec3& operator*=(double t) {
+        vec3& operator*=(real t) {
             e[0] *= t;
             e[1] *= t;
             e[2] *= t;
             return *this;
         }
 
-        vec3& operator/=(double t) {
+        vec3& operator/=(real t) {
             return *this *= 1/t;
         }
 
-        double length() const {
+        real length() const {
             return sqrt(length_squared());
         }
 
-        double length_squared() const {
+        real length_squared() const {
             return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
         }
 
@@ -61,7 +61,7 @@ class vec3 {
             return vec3(random_double(), random_double(), random_double());
 	}
 
-	    static vec3 random(double min, double max) {
+	    static vec3 random(real min, real max) {
             return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
 	}
 };
@@ -87,19 +87,19 @@ inline vec3 operator*(const vec3 &u, const vec3 &v) {
     return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline vec3 operator*(double t, const vec3 &v) {
+inline vec3 operator*(real t, const vec3 &v) {
     return vec3(t*v.e[0], t*v.e[1], t*v.e[2]);
 }
 
-inline vec3 operator*(const vec3 &v, double t) {
+inline vec3 operator*(const vec3 &v, real t) {
     return t * v;
 }
 
-inline vec3 operator/(const vec3 &v, double t) {
+inline vec3 operator/(const vec3 &v, real t) {
     return (1/t) * v;
 }
 
-inline double dot(const vec3 &u, const vec3 &v) {
+inline real dot(const vec3 &u, const vec3 &v) {
     return u.e[0] * v.e[0]
          + u.e[1] * v.e[1]
          + u.e[2] * v.e[2];
@@ -116,13 +116,26 @@ inline vec3 unit_vector(vec3 v) {
 }
 
 inline vec3 random_in_unit_disk() {
-    // keep on generating random vectors until one is in the unit disk
-    // on the x-y plane
-    while (true) {
-        auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0);
-        if (p.length_squared() < 1)
-            return p;
-    } 
+    // map the next 2D sample onto the unit disk on the x-y plane
+    // using the concentric mapping (Shirley and Chiu), which keeps
+    // well spread out samples well spread out on the disk
+    double u1, u2;
+    sample_2d(u1, u2);
+    auto a = static_cast<real>(2*u1 - 1);
+    auto b = static_cast<real>(2*u2 - 1);
+    if (a == 0 && b == 0)
+        return vec3(0, 0, 0);
+
+    real radius, theta;
+    if (fabs(a) > fabs(b)) {
+        radius = a;
+        theta = (pi/4) * (b/a);
+    }
+    else {
+        radius = b;
+        theta = pi/2 - (pi/4) * (a/b);
+    }
+    return vec3(radius*cos(theta), radius*sin(theta), 0);
 }
 
 inline vec3 random_in_unit_sphere() {
@@ -135,7 +148,14 @@ inline vec3 random_in_unit_sphere() {
 }
 
 inline vec3 random_unit_vector() {
-    return unit_vector(random_in_unit_sphere());
+    // map the next 2D sample uniformly onto the unit sphere:
+    // z is uniform in [-1, 1] and the angle around the z axis uniform in [0, 2pi)
+    double u1, u2;
+    sample_2d(u1, u2);
+    auto z = static_cast<real>(1 - 2*u1);
+    auto r = sqrt(fmax(real(0), 1 - z*z));
+    auto phi = static_cast<real>(2*pi*u2);
+    return vec3(r*cos(phi), r*sin(phi), z);
 }
 
 inline vec3 random_on_hemisphere(const vec3& normal) {
@@ -150,19 +170,19 @@ inline vec3 reflect(const vec3& v, const vec3& n) {
     return v - 2*dot(v, n)*n;
 }
 
-inline vec3 refract(const vec3& v, const vec3& n, double refract_index_ratio) {
-    auto cos_theta = fmin(dot(v, -n), 1.0);
-    auto sin_theta = sqrt(1.0 - cos_theta*cos_theta);
+inline vec3 refract(const vec3& v, const vec3& n, real refract_index_ratio) {
+    auto cos_theta = fmin(dot(v, -n), real(1));
+    auto sin_theta = sqrt(1 - cos_theta*cos_theta);
     
     // Calculates reflectance coeeficents using Schlick's approximation
     auto R0 = pow((1 - refract_index_ratio) / (1 + refract_index_ratio), 2);
     auto R1 =  R0 + (1 - R0) * pow((1 - cos_theta), 5);
 
-    if ((sin_theta * refract_index_ratio > 1.0) || R1 > random_double()) {
+    if ((sin_theta * refract_index_ratio > 1) || R1 > random_double()) {
         return reflect(v, n);
     }
     vec3 r_perp = refract_index_ratio * (v + cos_theta*n);
-    vec3 r_para = -1 * sqrt(1.0 - r_perp.length_squared()) * n;
+    vec3 r_para = -1 * sqrt(1 - r_perp.length_squared()) * n;
     if (std::isnan(r_para.x())) {
         std::cout << "[" <<  r_perp.length_squared() << " " << v.length_squared() << " " << (-n).length_squared() << "]" << std::endl;
     }
@@ -0,0 +1,85 @@
+#ifndef WATERTIGHT_H
+#define WATERTIGHT_H
+
+#include "common.h"
+
+// Watertight ray/triangle intersection (Woop, Benthin and Wald, "Watertight Ray/Triangle
+// Intersection", JCGT 2013).
+//
+// The ray is turned into the +z axis by permuting the axes and shearing, which is set up
+// once per ray. Each triangle is then tested with three 2D edge functions on its sheared
+// vertices. Adjacent triangles evaluate their shared edge from the same two vertices, so
+// a ray through an edge or a vertex always hits at least one of the triangles sharing it:
+// there are no cracks, and there is no epsilon, so grazing rays are handled like any other.
+
+struct watertight_ray {
+    int kx, ky, kz;        // axis permutation: kz is the largest component of the direction
+    double sx, sy, sz;     // shear, kept in double for the double precision fallback
+    point3 origin;
+
+    watertight_ray(const ray& r) : origin(r.origin()) {
+        vec3 direction = r.direction();
+        kz = 0;
+        if (fabs(direction[1]) > fabs(direction[kz])) kz = 1;
+        if (fabs(direction[2]) > fabs(direction[kz])) kz = 2;
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        if (direction[kz] < 0) {
+            // keep the winding of the triangles intact
+            int swap = kx;
+            kx = ky;
+            ky = swap;
+        }
+        sx = static_cast<double>(direction[kx]) / direction[kz];
+        sy = static_cast<double>(direction[ky]) / direction[kz];
+        sz = 1.0 / direction[kz];
+    }
+};
+
+template <typename T>
+inline bool watertight_intersect(const watertight_ray& wr, const point3& a, const point3& b, const point3& c,
+                                 interval ray_t, real& t, real (&weights)[3]) {
+    // Computes in precision T. On a hit, t is the ray parameter and weights holds the
+    // barycentric coordinates of the hit point with respect to a, b and c.
+    const T sx = static_cast<T>(wr.sx), sy = static_cast<T>(wr.sy), sz = static_cast<T>(wr.sz);
+    const T ox = wr.origin[wr.kx], oy = wr.origin[wr.ky], oz = wr.origin[wr.kz];
+
+    const T a_z = static_cast<T>(a[wr.kz]) - oz;
+    const T b_z = static_cast<T>(b[wr.kz]) - oz;
+    const T c_z = static_cast<T>(c[wr.kz]) - oz;
+    const T a_x = (static_cast<T>(a[wr.kx]) - ox) - sx*a_z;
+    const T a_y = (static_cast<T>(a[wr.ky]) - oy) - sy*a_z;
+    const T b_x = (static_cast<T>(b[wr.kx]) - ox) - sx*b_z;
+    const T b_y = (static_cast<T>(b[wr.ky]) - oy) - sy*b_z;
+    const T c_x = (static_cast<T>(c[wr.kx]) - ox) - sx*c_z;
+    const T c_y = (static_cast<T>(c[wr.ky]) - oy) - sy*c_z;
+
+    // Scaled barycentric coordinates: signed areas of the sheared edges
+    T u = c_x*b_y - c_y*b_x;
+    T v = a_x*c_y - a_y*c_x;
+    T w = b_x*a_y - b_y*a_x;
+
+    // An edge function that comes out exactly 0 in single precision may have the wrong
+    // sign, which is where cracks would come from; redo those few tests in double
+    if (sizeof(T) < sizeof(double) && (u == 0 || v == 0 || w == 0))
+        return watertight_intersect<double>(wr, a, b, c, ray_t, t, weights);
+
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+        return false; // the ray passes outside one of the edges
+    T det = u + v + w;
+    if (det == 0)
+        return false; // the ray runs within the plane of the triangle
+
+    T scaled_t = u*(sz*a_z) + v*(sz*b_z) + w*(sz*c_z);
+    T hit_t = scaled_t / det;
+    if (!(ray_t.min < hit_t && hit_t < ray_t.max))
+        return false;
+
+    t = static_cast<real>(hit_t);
+    weights[0] = static_cast<real>(u / det);
+    weights[1] = static_cast<real>(v / det);
+    weights[2] = static_cast<real>(w / det);
+    return true;
+}
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "common.h"
+
+#include "color.h"
+#include "material_table.h"
+#include "morton.h"
+#include "sampler.h"
+#include "scene_objects.h"
+
+#include <algorithm>
+#include <chrono>
+#include <typeinfo>
+#include <vector>
+
+// Wavefront path tracing: instead of following one path from the camera to the sky before
+// starting the next (camera::ray_color), a whole batch of paths advances one bounce at a
+// time through separate stages:
+//
+//   intersect  every live path's ray against the world
+//   sort       the paths that hit something by material, with a counting sort
+//   shade      each material's scatter over all of its paths in one loop
+//
+// The shade loop calls the concrete material class's scatter directly, so the virtual call
+// and the switch between material code paths happen once per material and bounce rather
+// than once per ray. Paths that reach the sky, are absorbed or end by Russian roulette
+// drop out; the rest go on to the next bounce.
+//
+// Each path restores its own camera sample before it scatters (see resume_camera_sample),
+// so it draws exactly the random numbers camera::ray_color would, and both integrators
+// render the same image.
+//
+// With reorder set, the scattered rays are sorted before every bounce after the first
+// (see reorder), so rays that start close together and head the same way are
+// intersected one after another and find the BVH nodes and primitives they share still
+// in cache. Camera rays are already coherent and keep their order.
+
+struct wavefront_path {
+    ray r;
+    color throughput;   // product of the attenuations so far
+    color radiance;     // the sample's result once the path has ended
+    int pixel_x, pixel_y;
+    int sample;         // sample number within the pixel
+};
+
+struct wavefront_settings {
+    int max_depth;
+    bool russian_roulette;
+    int rr_min_depth;
+    sampler_type sampler;
+    uint64_t seed;
+    int image_width;
+    int sample_size;
+    bool reorder;
+};
+
+class wavefront_tracer {
+    // Traces batches of camera paths. The stage buffers are kept between batches, so each
+    // render thread should own one tracer.
+    public:
+    long long segments = 0;       // rays traced, i.e. calls to world.hit
+    long long roulette_kills = 0; // paths ended by Russian roulette
+    double reorder_seconds = 0;   // time spent sorting rays, see reorder
+
+    void trace(std::vector<wavefront_path>& paths, const scene_object& world, const material_table& materials,
+               const wavefront_settings& settings) {
+        // Sets the radiance of every path, whose ray must be its camera ray
+        int count = static_cast<int>(paths.size());
+        active.resize(count);
+        records.resize(count);
+        for (int k = 0; k < count; ++k)
+            active[k] = k;
+
+        aabb scene_box = world.bounding_box();
+        for (int depth = 0; depth < settings.max_depth && !active.empty(); ++depth) {
+            if (settings.reorder && depth > 0)
+                reorder(paths, scene_box);
+
+            // Intersect
+            hits.clear();
+            for (int k : active) {
+                wavefront_path& path = paths[k];
+                ++segments;
+                if (world.hit(path.r, interval(0.001, infinity), records[k]))
+                    hits.push_back(k);
+                else
+                    path.radiance = path.throughput * sky_color(path.r.direction());
+            }
+
+            // Sort by material
+            bucket_start.assign(materials.size() + 1, 0);
+            for (int k : hits)
+                ++bucket_start[records[k].mat + 1];
+            for (size_t m = 1; m < bucket_start.size(); ++m)
+                bucket_start[m] += bucket_start[m - 1];
+            sorted.resize(hits.size());
+            bucket_fill.assign(bucket_start.begin(), bucket_start.end() - 1);
+            for (int k : hits)
+                sorted[bucket_fill[records[k].mat]++] = k;
+
+            // Shade, one material at a time
+            active.clear();
+            int bounce = depth + 1; // every path still going has hit something depth + 1 times
+            for (size_t m = 0; m + 1 < bucket_start.size(); ++m) {
+                const int* first = sorted.data() + bucket_start[m];
+                const int* last = sorted.data() + bucket_start[m + 1];
+                if (first == last)
+                    continue;
+                // Only an exact type match takes the direct call; any other class goes
+                // through the virtual call, so overrides are always honoured
+                const material& mat = materials[static_cast<material_id>(m)];
+                const std::type_info& type = typeid(mat);
+                if (type == typeid(lambertian1))
+                    shade(static_cast<const lambertian1&>(mat), first, last, bounce, paths, settings);
+                else if (type == typeid(lambertian2))
+                    shade(static_cast<const lambertian2&>(mat), first, last, bounce, paths, settings);
+                else if (type == typeid(lambertian3))
+                    shade(static_cast<const lambertian3&>(mat), first, last, bounce, paths, settings);
+                else if (type == typeid(metal))
+                    shade(static_cast<const metal&>(mat), first, last, bounce, paths, settings);
+                else if (type == typeid(dielectric))
+                    shade(static_cast<const dielectric&>(mat), first, last, bounce, paths, settings);
+                else
+                    shade(mat, first, last, bounce, paths, settings);
+            }
+        }
+
+        // Paths still going have exceeded the depth limit, so no more light is propagated
+        for (int k : active)
+            paths[k].radiance = color(0, 0, 0);
+    }
+
+    private:
+    std::vector<int> active, hits, sorted;
+    std::vector<int> bucket_start, bucket_fill;
+    std::vector<hit_record> records;
+    std::vector<uint64_t> keys, sorted_keys;
+
+    void reorder(const std::vector<wavefront_path>& paths, const aabb& scene_box) {
+        // Sorts the active paths by the cell of the scene box their ray starts in (a 27 bit
+        // Morton code on a 512^3 grid, so nearby cells sort close together) and then by the
+        // octant of the ray's direction, with an LSD radix sort. Paths with equal keys keep
+        // their order.
+        auto start = std::chrono::steady_clock::now();
+        int count = static_cast<int>(active.size());
+        keys.resize(count);
+        for (int i = 0; i < count; ++i) {
+            const ray& r = paths[active[i]].r;
+            uint32_t code = (morton_code(r.origin(), scene_box, 9) << 3) | octant(r.direction());
+            keys[i] = (static_cast<uint64_t>(code) << 32) | static_cast<uint32_t>(active[i]);
+        }
+        sort_morton_keys(keys, sorted_keys);
+
+        for (int i = 0; i < count; ++i)
+            active[i] = static_cast<int>(static_cast<uint32_t>(keys[i]));
+        reorder_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static uint32_t octant(const vec3& direction) {
+        return (direction[0] < 0 ? 4u : 0u) | (direction[1] < 0 ? 2u : 0u) | (direction[2] < 0 ? 1u : 0u);
+    }
+
+    template <typename material_type>
+    static bool scatter(const material_type& mat, const ray& r_in, const hit_record& rec, color& attenuation,
+                        ray& scattered) {
+        // Calls the class's own scatter, which the compiler can inline into the shade loop
+        return mat.material_type::scatter(r_in, rec, attenuation, scattered);
+    }
+
+    static bool scatter(const material& mat, const ray& r_in, const hit_record& rec, color& attenuation,
+                        ray& scattered) {
+        return mat.scatter(r_in, rec, attenuation, scattered);
+    }
+
+    template <typename material_type>
+    void shade(const material_type& mat, const int* first, const int* last, int bounce,
+               std::vector<wavefront_path>& paths, const wavefront_settings& settings) {
+        for (const int* k = first; k != last; ++k) {
+            wavefront_path& path = paths[*k];
+            resume_camera_sample(settings.sampler, settings.seed, path.pixel_x, path.pixel_y, settings.image_width,
+                                 path.sample, settings.sample_size, bounce);
+            ray scattered;
+            color attenuation;
+            if (!scatter(mat, path.r, records[*k], attenuation, scattered)) {
+                path.radiance = color(0, 0, 0); // ray absorbed by material
+                continue;
+            }
+            path.throughput = path.throughput * attenuation;
+            path.r = scattered;
+
+            if (settings.russian_roulette && bounce >= settings.rr_min_depth) {
+                auto survival = fmin(1.0, fmax(path.throughput.x(), fmax(path.throughput.y(), path.throughput.z())));
+                if (random_double() >= survival) {
+                    ++roulette_kills;
+                    path.radiance = color(0, 0, 0);
+                    continue;
+                }
+                path.throughput /= survival;
+            }
+            active.push_back(*k);
+        }
+    }
+};
+
+#endif
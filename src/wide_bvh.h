@@ -0,0 +1,346 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "common.h"
+
+#include "aabb.h"
+#include "aligned_allocator.h"
+#include "bvh.h"
+#include "scene_objects.h"
+#include "scene_objects_list.h"
+#include "simd.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+template <int width>
+struct alignas(64) wide_bvh_node {
+    // Node of a wide BVH with up to `width` children. The child boxes are quantized to 8
+    // bits per plane on a grid spanning the node: plane q of axis a lies at
+    // origin[a] + q * 2^exponent[a]. The grid is rounded outwards, so a child box only ever
+    // grows. A 4 wide node fills one 64 byte cache line, an 8 wide node two.
+    float origin[3];
+    int8_t exponent[3];
+    uint8_t child_count;
+    uint8_t lo[3][width];   // [axis][child]
+    uint8_t hi[3][width];
+    int32_t child[width];   // interior children: node index, leaves: first primitive
+    uint16_t count[width];  // primitives of a leaf child, 0 for interior children
+
+    real scale(int axis) const {
+        // 2^exponent[axis], built from the exponent bits of a float
+        uint32_t bits = static_cast<uint32_t>(exponent[axis] + 127) << 23;
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+};
+
+static_assert(sizeof(wide_bvh_node<4>) == 64, "4 wide nodes should fill one cache line");
+static_assert(sizeof(wide_bvh_node<8>) == 128, "8 wide nodes should fill two cache lines");
+
+struct wide_bvh_ray {
+    // What the child box test needs of a ray, computed once per ray
+    point3 origin;
+    vec3 inv_direction;
+    bool negative[3];
+
+    wide_bvh_ray(const ray& r) : origin(r.origin()) {
+        vec3 direction = r.direction();
+        inv_direction = vec3(1/direction[0], 1/direction[1], 1/direction[2]);
+        for (int a = 0; a < 3; ++a)
+            negative[a] = direction[a] < 0;
+    }
+};
+
+#define RAY_BANDIT_KERNEL_FILE "wide_bvh_kernel.h"
+#include "isa_kernels.h"
+
+inline simd_level wide_bvh_level(simd_level requested, int width) {
+    // Widest supported instruction set up to requested whose vectors don't hold more lanes
+    // than a node has children
+    simd_level level = simd_level_supported(requested) ? requested : best_simd_level();
+#if RAY_BANDIT_X86_SIMD
+    if (level == simd_level::avx512 && simd_avx512::lanes::width > width)
+        level = simd_level::avx2;
+    if (level == simd_level::avx2 && simd_avx2::lanes::width > width)
+        level = simd_level::sse4;
+    if (level == simd_level::sse4 && simd_sse4::lanes::width > width)
+        level = simd_level::scalar;
+#endif
+    return level;
+}
+
+template <int width>
+inline unsigned intersect_children(simd_level level, const wide_bvh_node<width>& node, const wide_bvh_ray& r,
+                                   interval ray_t, real (&t_near)[width]) {
+    // Dispatches to the kernel for level, which should come from wide_bvh_level()
+    return RAY_BANDIT_SIMD_DISPATCH(level, intersect_children(node, r, ray_t, t_near));
+}
+
+template <int width>
+class wide_bvh_tree {
+    // A bvh_tree collapsed into nodes of up to `width` children with quantized boxes. Each
+    // node is tested against a ray with one SIMD pass over its children (see
+    // wide_bvh_kernel.h) and the children that are hit are visited nearest first.
+    // Collapsing keeps the leaves of the binary tree, so the owner's primitive order and
+    // leaf callbacks carry over unchanged.
+    public:
+    typedef wide_bvh_node<width> node;
+
+    simd_level level = best_simd_level();
+    std::vector<node, aligned_allocator<node>> nodes;
+
+    void build(const bvh_tree& tree) {
+        external = nullptr;
+        nodes.clear();
+        bbox = tree.bounding_box();
+        if (tree.nodes.empty())
+            return;
+        nodes.reserve(tree.nodes.size() / (width - 1) + 1);
+        collapse(tree, 0);
+        nodes.shrink_to_fit();
+    }
+
+    void attach(const node* data, size_t count, const aabb& box) {
+        // Traces through count nodes the caller keeps alive elsewhere (e.g. in a mapped
+        // cache file) instead of nodes, which is cleared
+        nodes.clear();
+        nodes.shrink_to_fit();
+        external = count > 0 ? data : nullptr;
+        external_count = count;
+        bbox = box;
+    }
+
+    const node* data() const { return external ? external : nodes.data(); }
+    size_t size() const { return external ? external_count : nodes.size(); }
+
+    template <typename leaf_function>
+    bool hit_leaves(const ray& r, interval ray_t, hit_record& rec, const leaf_function& hit_leaf) const {
+        // hit_leaf(first, count, ray_t, rec) tests the ray against primitives
+        // [first, first + count) and must only write rec when it reports a hit, which has to
+        // be the closest among them
+        const node* tree_nodes = data();
+        if (!tree_nodes || !bbox.hit(r, ray_t))
+            return false;
+
+        wide_bvh_ray wr(r);
+        simd_level kernel = wide_bvh_level(level, width);
+        bool hit_anything = false;
+        auto closest_so_far = ray_t.max;
+
+        struct entry {
+            int32_t index;
+            int count;      // 0 for a node
+            real t_near;    // where the ray enters the entry's box
+        };
+        entry stack[bvh_tree::max_depth * (width - 1) + 1];
+        int stack_size = 0;
+        stack[stack_size++] = { 0, 0, ray_t.min };
+
+        while (stack_size > 0) {
+            entry current = stack[--stack_size];
+            if (current.t_near >= closest_so_far)
+                continue; // a closer hit was found since it was pushed
+            if (current.count > 0) {
+                if (hit_leaf(current.index, current.count, interval(ray_t.min, closest_so_far), rec)) {
+                    hit_anything = true;
+                    closest_so_far = rec.t;
+                }
+                continue;
+            }
+
+            const node& n = tree_nodes[current.index];
+            real t_near[width];
+            unsigned hits = intersect_children(kernel, n, wr, interval(ray_t.min, closest_so_far), t_near);
+
+            // Push the children farthest first so the nearest is visited next
+            int first = stack_size;
+            for (int k = 0; k < width; ++k) {
+                if (!((hits >> k) & 1u))
+                    continue;
+                entry child = { n.child[k], n.count[k], t_near[k] };
+                int at = stack_size++;
+                while (at > first && stack[at - 1].t_near < child.t_near) {
+                    stack[at] = stack[at - 1];
+                    --at;
+                }
+                stack[at] = child;
+            }
+        }
+        return hit_anything;
+    }
+
+    template <typename leaf_function>
+    void for_each_leaf(const leaf_function& visit) {
+        // Calls visit(first, count) for every leaf; visit may change `first`, e.g. to point
+        // at the owner's own copy of the leaf's primitives
+        for (auto& n : nodes)
+            for (int k = 0; k < n.child_count; ++k)
+                if (n.count[k] > 0)
+                    visit(n.child[k], static_cast<int>(n.count[k]));
+    }
+
+    aabb bounding_box() const { return bbox; }
+
+    size_t memory_bytes() const { return nodes.capacity() * sizeof(node); } // attached nodes not included
+
+    private:
+    aabb bbox;
+    const node* external = nullptr;
+    size_t external_count = 0;
+
+    int collapse(const bvh_tree& tree, int binary_index) {
+        // Turns the binary subtree at binary_index into wide nodes and returns the index of
+        // the top one. Its children are found by repeatedly opening the interior child with
+        // the largest box, which is the one rays are most likely to enter.
+        int children[width];
+        int child_count = 0;
+        children[child_count++] = binary_index;
+        if (tree.nodes[binary_index].count == 0) {
+            child_count = 0;
+            children[child_count++] = binary_index + 1;
+            children[child_count++] = tree.nodes[binary_index].offset;
+        }
+        while (child_count < width) {
+            int largest = -1;
+            real largest_area = -1;
+            for (int k = 0; k < child_count; ++k) {
+                const bvh_node& c = tree.nodes[children[k]];
+                if (c.count == 0 && c.bbox.surface_area() > largest_area) {
+                    largest = k;
+                    largest_area = c.bbox.surface_area();
+                }
+            }
+            if (largest < 0)
+                break;
+            int opened = children[largest];
+            children[largest] = opened + 1;
+            children[child_count++] = tree.nodes[opened].offset;
+        }
+
+        int node_index = static_cast<int>(nodes.size());
+        nodes.push_back(node());
+        aabb box;
+        for (int k = 0; k < child_count; ++k)
+            box = aabb(box, tree.nodes[children[k]].bbox);
+        quantize_grid(box, nodes[node_index]);
+        nodes[node_index].child_count = static_cast<uint8_t>(child_count);
+        for (int k = 0; k < width; ++k) {
+            // Unused slots get an inverted box, and child_count masks them out as well
+            for (int a = 0; a < 3; ++a) {
+                nodes[node_index].lo[a][k] = 255;
+                nodes[node_index].hi[a][k] = 0;
+            }
+            nodes[node_index].child[k] = 0;
+            nodes[node_index].count[k] = 0;
+        }
+
+        for (int k = 0; k < child_count; ++k) {
+            const bvh_node& c = tree.nodes[children[k]];
+            quantize_box(c.bbox, nodes[node_index], k);
+            if (c.count > 0) {
+                nodes[node_index].child[k] = c.offset;
+                nodes[node_index].count[k] = static_cast<uint16_t>(c.count);
+            }
+            else {
+                int child = collapse(tree, children[k]);
+                nodes[node_index].child[k] = child;
+            }
+        }
+        return node_index;
+    }
+
+    static real plane(const node& n, int axis, int q) {
+        // Must be computed exactly like the kernel does it
+        return static_cast<real>(n.origin[axis]) + static_cast<real>(q) * n.scale(axis);
+    }
+
+    static void quantize_grid(const aabb& box, node& n) {
+        // Picks the grid of a node: its origin is at or below the box and 255 steps of the
+        // smallest power of two that reaches the top of the box
+        for (int a = 0; a < 3; ++a) {
+            const interval& extent = box.axis(a);
+            float origin = static_cast<float>(extent.min);
+            if (origin > extent.min)
+                origin = std::nextafter(origin, -std::numeric_limits<float>::infinity());
+            n.origin[a] = origin;
+            int exponent;
+            std::frexp(static_cast<double>(extent.max - origin) / 255, &exponent);
+            exponent = std::max(exponent, -126);
+            n.exponent[a] = static_cast<int8_t>(std::min(exponent, 127));
+            while (plane(n, a, 255) < extent.max && n.exponent[a] < 127)
+                ++n.exponent[a];
+        }
+    }
+
+    static void quantize_box(const aabb& box, node& n, int k) {
+        // Rounds the planes of child k's box outwards to the node's grid
+        for (int a = 0; a < 3; ++a) {
+            const interval& extent = box.axis(a);
+            real scale = n.scale(a);
+            int lo = static_cast<int>(std::max<real>(0, std::min<real>(255, std::floor((extent.min - n.origin[a]) / scale))));
+            int hi = static_cast<int>(std::max<real>(0, std::min<real>(255, std::ceil((extent.max - n.origin[a]) / scale))));
+            while (lo > 0 && plane(n, a, lo) > extent.min)
+                --lo;
+            while (hi < 255 && plane(n, a, hi) < extent.max)
+                ++hi;
+            n.lo[a][k] = static_cast<uint8_t>(lo);
+            n.hi[a][k] = static_cast<uint8_t>(hi);
+        }
+    }
+};
+
+
+template <int width>
+class wide_bvh : public scene_object {
+    // Wide BVH over a list of scene objects, see wide_bvh_tree. A drop-in replacement for
+    // bvh that needs a fraction of its memory for the nodes.
+    public:
+    wide_bvh(const scene_objects_list& list, bvh_build_method method = bvh_build_method::sah,
+             int thread_count = 0) {
+        const auto& src_objects = list.objects;
+        std::vector<aabb> boxes(src_objects.size());
+        for (size_t i = 0; i < src_objects.size(); ++i)
+            boxes[i] = src_objects[i]->bounding_box();
+
+        bvh_tree binary;
+        binary.method = method;
+        binary.thread_count = thread_count;
+        auto order = binary.build(boxes);
+        objects.reserve(order.size());
+        for (int index : order)
+            objects.push_back(src_objects[index]);
+        tree.build(binary);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        hit_record temp_rec;
+        return tree.hit_leaves(r, ray_t, rec, [&](int first, int count, interval leaf_t, hit_record& closest) {
+            bool hit_anything = false;
+            for (int i = first; i < first + count; ++i) {
+                // Objects may write to the record even when they miss
+                if (objects[i]->hit(r, leaf_t, temp_rec)) {
+                    hit_anything = true;
+                    leaf_t.max = temp_rec.t;
+                    closest = temp_rec;
+                }
+            }
+            return hit_anything;
+        });
+    }
+
+    aabb bounding_box() const override { return tree.bounding_box(); }
+
+    int node_count() const { return static_cast<int>(tree.size()); }
+    size_t node_bytes() const { return tree.memory_bytes(); }
+
+    void set_level(simd_level level) { tree.level = level; }
+
+    private:
+    wide_bvh_tree<width> tree;
+    std::vector<shared_ptr<scene_object>> objects;
+};
+
+#endif
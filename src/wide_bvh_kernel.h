@@ -0,0 +1,43 @@
+// Vectorized slab test of a ray against all child boxes of a wide_bvh_node, written
+// against a `lanes` type (see simd.h) and built by wide_bvh.h once per instruction set
+// through isa_kernels.h, so there is deliberately no include guard. The math is that of
+// aabb::hit on the dequantized boxes.
+
+template <int width>
+inline unsigned intersect_children(const wide_bvh_node<width>& node, const wide_bvh_ray& r, interval ray_t,
+                                   real (&t_near)[width]) {
+    // Returns a bit mask of the children whose boxes the ray passes through inside ray_t
+    // and writes the distance at which it enters each of them to t_near
+    typedef typename lanes::value value;
+
+    unsigned hits = 0;
+    for (int first = 0; first < width; first += lanes::width) {
+        value near = lanes::broadcast(ray_t.min);
+        value far = lanes::broadcast(ray_t.max);
+        for (int a = 0; a < 3; ++a) {
+            // The near plane of a slab is its low side unless the ray runs backwards
+            const uint8_t* near_plane = r.negative[a] ? node.hi[a] : node.lo[a];
+            const uint8_t* far_plane = r.negative[a] ? node.lo[a] : node.hi[a];
+            const value origin = lanes::broadcast(node.origin[a]);
+            const value scale = lanes::broadcast(node.scale(a));
+            const value ray_origin = lanes::broadcast(r.origin[a]);
+            const value inv_direction = lanes::broadcast(r.inv_direction[a]);
+            value t0 = lanes::mul(lanes::sub(lanes::add(origin, lanes::mul(lanes::load_bytes(near_plane + first), scale)),
+                                             ray_origin), inv_direction);
+            value t1 = lanes::mul(lanes::sub(lanes::add(origin, lanes::mul(lanes::load_bytes(far_plane + first), scale)),
+                                             ray_origin), inv_direction);
+            t1 = lanes::mul(t1, lanes::broadcast(aabb::slab_far_scale()));
+            // NaN distances (a ray in the plane of a slab) leave the interval alone, as in aabb::hit
+            near = lanes::select(lanes::greater(t0, near), t0, near);
+            far = lanes::select(lanes::less(t1, far), t1, far);
+        }
+        // Copied through a buffer since kernels wider than the node are compiled (though
+        // never dispatched to)
+        real lane_near[lanes::width];
+        lanes::store(lane_near, near);
+        for (int k = 0; k < lanes::width && first + k < width; ++k)
+            t_near[first + k] = lane_near[k];
+        hits |= lanes::bits(lanes::greater(far, near)) << first;
+    }
+    return hits & ((1u << node.child_count) - 1);
+}